@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../Memory/arena.h"
+#include "../Calc/program.h"
+#include "../Calc/lexer.h"
+#include "../Calc/names.h"
+#include "../Calc/compiler.h"
+#include "../Calc/batch.h"
+#include "../Calc/jit.h"
+#include "../Calc/context.h"
+
+// Expressions in the generated corpus, and the deepest of them.
+#define CORPUS_SIZE     4096
+#define CORPUS_DEPTH    6
+
+// Each benchmark repeats over the corpus for at least this long.
+#define BENCH_SECONDS   0.25
+
+// A result at least this many times slower than the baseline is flagged.
+#define BENCH_SLOWER    1.10
+
+#define BENCH_ARENA     4096
+#define BENCH_NAME      32
+
+// Rows evaluated by one run of the map benchmark.
+#define MAP_ROWS        (64 * BATCH_BLOCK)
+
+typedef struct {
+	char* text;
+	size_t length;
+} Expression;
+
+typedef struct {
+	const char* name;
+	size_t exprs;
+	double nsPerExpr;
+	double allocsPerExpr;
+	double exprsPerSec;
+} BenchResult;
+
+// State shared by the benchmarks: the corpus, and everything compiled from
+// it up front so each benchmark times one stage.
+typedef struct {
+	Expression* corpus;
+	int size;
+	NameTable* names;
+	Arena* arena;
+	Program* program;
+	Program** programs;
+	JitCode** native;
+	double vars[1];
+
+	// Contexts for the end to end benchmarks, which go through the public
+	// interface, without and with the program cache.
+	CalcContext* context;
+	CalcContext* cachedContext;
+} Bench;
+
+typedef void (*BenchFunction)(Bench* bench);
+
+uint64_t benchRandom(void);
+void generateExpression(char* text, size_t* length, int depth);
+void generateCorpus(Bench* bench);
+void runBenchmark(Bench* bench, const char* name, BenchFunction function,
+		size_t exprsPerRun, BenchResult* result);
+double benchNow(void);
+void benchLex(Bench* bench);
+void benchCompile(Bench* bench);
+void benchEval(Bench* bench);
+void benchEvalJit(Bench* bench);
+void benchEvaluate(Bench* bench);
+void benchEvaluateCached(Bench* bench);
+void benchMap(Bench* bench);
+void writeJson(const BenchResult* results, int count, FILE* out);
+void compareBaseline(const BenchResult* results, int count, const char* path);
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* data, size_t size);
+
+// Allocations counted by the wrappers below, which the linker substitutes
+// for malloc(), calloc() and realloc() with --wrap.
+size_t allocationCount = 0;
+
+// Times each stage over a corpus of generated expressions and prints a
+// table. The results are written as JSON to the file named by the first
+// argument, if any, after comparing them with the earlier results in the
+// file named by the second.
+int main(int argc, char** argv) {
+	Bench bench;
+	BenchResult results[8];
+	int count = 0;
+
+	bench.names = nameTableCreate();
+	bench.arena = arenaCreate(BENCH_ARENA);
+	bench.program = programCreate();
+	bench.vars[ANS_SLOT] = 1.5;
+	generateCorpus(&bench);
+
+	bench.context = calcContextCreate();
+	calcSetJitThreshold(bench.context, 0);
+	bench.cachedContext = calcContextCreate();
+	calcSetCacheLimit(bench.cachedContext, 64 << 20);
+
+	runBenchmark(&bench, "lex", benchLex, bench.size, &results[count++]);
+	runBenchmark(&bench, "compile", benchCompile, bench.size, &results[count++]);
+	runBenchmark(&bench, "eval", benchEval, bench.size, &results[count++]);
+	runBenchmark(&bench, "eval_jit", benchEvalJit, bench.size, &results[count++]);
+	runBenchmark(&bench, "end_to_end", benchEvaluate, bench.size,
+			&results[count++]);
+	runBenchmark(&bench, "end_to_end_cached", benchEvaluateCached, bench.size,
+			&results[count++]);
+	runBenchmark(&bench, "map_row", benchMap, MAP_ROWS, &results[count++]);
+
+	printf("%-18s %12s %14s %14s\n", "benchmark", "ns/expr", "allocs/expr",
+			"exprs/sec");
+
+	for(int i = 0; i < count; ++i) {
+		printf("%-18s %12.1f %14.3f %14.0f\n", results[i].name,
+				results[i].nsPerExpr, results[i].allocsPerExpr,
+				results[i].exprsPerSec);
+	}
+
+	if(argc > 2) {
+		compareBaseline(results, count, argv[2]);
+	}
+
+	if(argc > 1) {
+		FILE* out = fopen(argv[1], "w");
+
+		if(out == NULL) {
+			fprintf(stderr, "Error: cannot write '%s'.\n", argv[1]);
+			return 1;
+		}
+
+		writeJson(results, count, out);
+		fclose(out);
+	}
+
+	for(int i = 0; i < bench.size; ++i) {
+		free(bench.corpus[i].text);
+		programDestroy(bench.programs[i]);
+		jitFree(bench.native[i]);
+	}
+
+	free(bench.corpus);
+	free(bench.programs);
+	free(bench.native);
+	calcContextDestroy(bench.context);
+	calcContextDestroy(bench.cachedContext);
+	programDestroy(bench.program);
+	arenaDestroy(bench.arena);
+	nameTableDestroy(bench.names);
+	return 0;
+}
+
+void* __wrap_malloc(size_t size) {
+	++allocationCount;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	++allocationCount;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* data, size_t size) {
+	++allocationCount;
+	return __real_realloc(data, size);
+}
+
+// xorshift64*, seeded the same every run so the corpus never changes.
+uint64_t benchRandom(void) {
+	static uint64_t state = 0x9e3779b97f4a7c15u;
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545f4914f6cdd1du;
+}
+
+// Appends a random expression of at most the given depth. Leaves are
+// numbers, constants and ans, so most expressions cannot be folded away.
+void generateExpression(char* text, size_t* length, int depth) {
+	static const char* const leaves[] = { "ans", "ans", "pi", "e", "2", "0.5",
+			"3.25", "17", "1500" };
+	static const char* const functions[] = { "sqrt", "sin", "cos", "tan",
+			"exp", "log" };
+	static const char operators[] = "+-*/^";
+	uint64_t choice = benchRandom();
+
+	if(depth == 0 || choice % 4 == 0) {
+		*length += sprintf(text + *length, "%s",
+				leaves[(choice >> 8) % (sizeof(leaves) / sizeof(leaves[0]))]);
+	} else if(choice % 4 == 1) {
+		*length += sprintf(text + *length, "%s(",
+				functions[(choice >> 8) % (sizeof(functions) / sizeof(functions[0]))]);
+		generateExpression(text, length, depth - 1);
+		text[(*length)++] = ')';
+	} else {
+		text[(*length)++] = '(';
+		generateExpression(text, length, depth - 1);
+		*length += sprintf(text + *length, " %c ",
+				operators[(choice >> 8) % (sizeof(operators) - 1)]);
+		generateExpression(text, length, depth - 1);
+		text[(*length)++] = ')';
+	}
+
+	text[*length] = '\0';
+}
+
+// Generates expressions of every depth up to CORPUS_DEPTH, and compiles each
+// to a program and to native code for the evaluation benchmarks.
+void generateCorpus(Bench* bench) {
+	// An expression of depth d is at most about 2^d leaves and operators.
+	char* text = malloc(64 << CORPUS_DEPTH);
+
+	bench->corpus = malloc(CORPUS_SIZE * sizeof(Expression));
+	bench->programs = malloc(CORPUS_SIZE * sizeof(Program*));
+	bench->native = malloc(CORPUS_SIZE * sizeof(JitCode*));
+	bench->size = 0;
+
+	if(text == NULL || bench->corpus == NULL || bench->programs == NULL
+			|| bench->native == NULL) {
+		fprintf(stderr, "Allocation of corpus failed.\n");
+		exit(1);
+	}
+
+	while(bench->size < CORPUS_SIZE) {
+		TokenArray tokenArray;
+		size_t length = 0;
+
+		generateExpression(text, &length, 1 + bench->size % CORPUS_DEPTH);
+
+		// Every expression generated must compile, or the corpus would not
+		// be the one the results claim to measure.
+		if(compileExpression(text, length, bench->names, bench->program,
+				bench->arena, &tokenArray) != success
+				|| isProgramEmpty(bench->program)) {
+			fprintf(stderr, "Corpus expression failed to compile: %s\n", text);
+			exit(1);
+		}
+
+		Expression* expression = &bench->corpus[bench->size];
+
+		expression->text = malloc(length + 1);
+
+		if(expression->text == NULL) {
+			fprintf(stderr, "Allocation of corpus failed.\n");
+			exit(1);
+		}
+
+		memcpy(expression->text, text, length + 1);
+		expression->length = length;
+		bench->programs[bench->size] = programCopy(bench->program);
+		bench->native[bench->size] = jitCompile(bench->program);
+		++(bench->size);
+
+		arenaReset(bench->arena);
+	}
+
+	free(text);
+}
+
+// Repeats a benchmark for at least BENCH_SECONDS after one warm up run.
+void runBenchmark(Bench* bench, const char* name, BenchFunction function,
+		size_t exprsPerRun, BenchResult* result) {
+	size_t runs = 0;
+	double start, elapsed;
+
+	function(bench);
+
+	size_t allocations = allocationCount;
+	start = benchNow();
+
+	do {
+		function(bench);
+		++runs;
+		elapsed = benchNow() - start;
+	} while(elapsed < BENCH_SECONDS);
+
+	result->name = name;
+	result->exprs = runs * exprsPerRun;
+	result->nsPerExpr = elapsed * 1e9 / result->exprs;
+	result->allocsPerExpr = (double)(allocationCount - allocations) / result->exprs;
+	result->exprsPerSec = result->exprs / elapsed;
+}
+
+// Returns a monotonic time in seconds.
+double benchNow(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void benchLex(Bench* bench) {
+	for(int i = 0; i < bench->size; ++i) {
+		TokenArray tokenArray;
+
+		lexExpression(bench->corpus[i].text, bench->corpus[i].length,
+				bench->names, bench->arena, &tokenArray);
+		arenaReset(bench->arena);
+	}
+}
+
+// Lexes, parses, optimises and emits each expression.
+void benchCompile(Bench* bench) {
+	for(int i = 0; i < bench->size; ++i) {
+		TokenArray tokenArray;
+
+		compileExpression(bench->corpus[i].text, bench->corpus[i].length,
+				bench->names, bench->program, bench->arena, &tokenArray);
+		arenaReset(bench->arena);
+	}
+}
+
+void benchEval(Bench* bench) {
+	for(int i = 0; i < bench->size; ++i) {
+		double result;
+
+		programEval(bench->programs[i], bench->vars, bench->arena, &result);
+		arenaReset(bench->arena);
+	}
+}
+
+void benchEvalJit(Bench* bench) {
+	for(int i = 0; i < bench->size; ++i) {
+		double result;
+
+		if(bench->native[i] != NULL) {
+			jitRun(bench->native[i], bench->programs[i], bench->vars,
+					bench->arena, &result);
+		} else {
+			programEval(bench->programs[i], bench->vars, bench->arena, &result);
+		}
+
+		arenaReset(bench->arena);
+	}
+}
+
+void benchEvaluate(Bench* bench) {
+	for(int i = 0; i < bench->size; ++i) {
+		CalcResult result;
+
+		calcEvaluate(bench->context, bench->corpus[i].text,
+				bench->corpus[i].length, &result);
+	}
+}
+
+void benchEvaluateCached(Bench* bench) {
+	for(int i = 0; i < bench->size; ++i) {
+		CalcResult result;
+
+		calcEvaluate(bench->cachedContext, bench->corpus[i].text,
+				bench->corpus[i].length, &result);
+	}
+}
+
+// Evaluates one of the deepest expressions over a column, as --map does.
+void benchMap(Bench* bench) {
+	static double column[MAP_ROWS];
+	static double results[MAP_ROWS];
+	const double* columns[] = { column };
+
+	if(column[1] == 0) {
+		for(int i = 0; i < MAP_ROWS; ++i) {
+			column[i] = i * 0.001;
+		}
+	}
+
+	programEvalBatch(bench->programs[CORPUS_DEPTH - 1], columns, MAP_ROWS,
+			results, NULL);
+}
+
+// Writes one benchmark per line, so the file can be read back, or diffed,
+// line by line.
+void writeJson(const BenchResult* results, int count, FILE* out) {
+	fprintf(out, "{\n  \"corpus\": %d,\n  \"benchmarks\": [\n", CORPUS_SIZE);
+
+	for(int i = 0; i < count; ++i) {
+		fprintf(out, "    {\"name\": \"%s\", \"exprs\": %zu, \"ns_per_expr\": %.3f,"
+				" \"allocs_per_expr\": %.4f, \"exprs_per_sec\": %.0f}%s\n",
+				results[i].name, results[i].exprs, results[i].nsPerExpr,
+				results[i].allocsPerExpr, results[i].exprsPerSec,
+				(i + 1 < count) ? "," : "");
+	}
+
+	fprintf(out, "  ]\n}\n");
+}
+
+// Compares the results with a file written by writeJson(), flagging any
+// benchmark that got slower or allocates more.
+void compareBaseline(const BenchResult* results, int count, const char* path) {
+	FILE* in = fopen(path, "r");
+	char line[256];
+
+	if(in == NULL) {
+		fprintf(stderr, "No baseline '%s' to compare against.\n", path);
+		return;
+	}
+
+	printf("\n%-18s %12s %14s\n", "against baseline", "time", "allocs");
+
+	while(fgets(line, sizeof(line), in) != NULL) {
+		char name[BENCH_NAME];
+		size_t exprs;
+		double nsPerExpr, allocsPerExpr;
+
+		if(sscanf(line, " {\"name\": \"%31[^\"]\", \"exprs\": %zu, \"ns_per_expr\": %lf,"
+				" \"allocs_per_expr\": %lf", name, &exprs, &nsPerExpr,
+				&allocsPerExpr) != 4) {
+			continue;
+		}
+
+		for(int i = 0; i < count; ++i) {
+			if(strcmp(results[i].name, name) == 0) {
+				double ratio = results[i].nsPerExpr / nsPerExpr;
+
+				printf("%-18s %11.2fx %14.3f%s\n", name, ratio,
+						results[i].allocsPerExpr - allocsPerExpr,
+						(ratio > BENCH_SLOWER
+						|| results[i].allocsPerExpr > allocsPerExpr + 1e-3)
+						? "  REGRESSED" : "");
+			}
+		}
+	}
+
+	fclose(in);
+}
@@ -0,0 +1,184 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "program.h"
+#include "kernels.h"
+
+// Number of rows evaluated together. Each stack slot holds one block.
+#define BATCH_BLOCK 256
+
+Status programEvalBatch(const Program* program, const double* const* columns,
+		size_t count, double* results, Status* rowStatus);
+
+
+// Function definitions:
+
+// Runs the program over count rows, one instruction at a time across a block
+// of rows. columns[slot] holds the values of variable slot for every row.
+// rowStatus may be NULL; failed rows always produce NAN.
+// Returns success, or the status of the first failed row.
+Status programEvalBatch(const Program* program, const double* const* columns,
+		size_t count, double* results, Status* rowStatus) {
+	if(isProgramEmpty(program) || program->depth != 1) {
+		return evalFail;
+	}
+
+	// Each stack entry points at either a column, its own scratch block or
+	// a temporary's block. Temporaries follow the stack's blocks.
+	double* scratch = malloc((program->maxDepth + program->tempCount)
+			* BATCH_BLOCK * sizeof(double));
+	double* temps = scratch + program->maxDepth * BATCH_BLOCK;
+	const double** stack = malloc(program->maxDepth * sizeof(double*));
+	const KernelTable* kernels = kernelTable();
+	Status status = success;
+
+	if(scratch == NULL || stack == NULL) {
+		fprintf(stderr, "Allocation of batch stack failed.\n");
+		exit(1);
+	}
+
+	for(size_t base = 0; base < count; base += BATCH_BLOCK) {
+		int n = (count - base < BATCH_BLOCK) ? (int)(count - base) : BATCH_BLOCK;
+		unsigned char failed[BATCH_BLOCK];
+		int anyFailed = 0, top = 0;
+
+		for(int pc = 0; pc < program->codeSize; ++pc) {
+			const Instruction* instruction = &program->code[pc];
+			double* dst;
+
+			switch(instruction->op) {
+				case opConst:
+					dst = scratch + top * BATCH_BLOCK;
+					batchFill(dst, program->constants[instruction->arg], n);
+					stack[top++] = dst;
+					continue;
+				case opVar:
+					stack[top++] = columns[instruction->arg] + base;
+					continue;
+				case opLoad:
+					stack[top++] = temps + instruction->arg * BATCH_BLOCK;
+					continue;
+				case opStore:
+					dst = temps + instruction->arg * BATCH_BLOCK;
+					memcpy(dst, stack[top - 1], n * sizeof(double));
+					stack[top - 1] = dst;
+					continue;
+				default:
+					break;
+			}
+
+			// Unary operations.
+			dst = scratch + (top - 1) * BATCH_BLOCK;
+
+			switch(instruction->op) {
+				case opNeg:
+					batchNeg(dst, stack[top - 1], n);
+					stack[top - 1] = dst;
+					continue;
+				case opSqrt:
+					kernels->sqrt(dst, stack[top - 1], n);
+					stack[top - 1] = dst;
+					continue;
+				case opSin:
+					kernels->sin(dst, stack[top - 1], n);
+					stack[top - 1] = dst;
+					continue;
+				case opCos:
+					kernels->cos(dst, stack[top - 1], n);
+					stack[top - 1] = dst;
+					continue;
+				case opTan:
+					kernels->tan(dst, stack[top - 1], n);
+					stack[top - 1] = dst;
+					continue;
+				case opExp:
+					kernels->exp(dst, stack[top - 1], n);
+					stack[top - 1] = dst;
+					continue;
+				case opLog:
+					kernels->log(dst, stack[top - 1], n);
+					stack[top - 1] = dst;
+					continue;
+				case opPowi:
+					kernels->powi(dst, stack[top - 1], instruction->arg, n);
+					stack[top - 1] = dst;
+					continue;
+				default:
+					break;
+			}
+
+			// Binary operations.
+			const double* lOperand = stack[top - 2];
+			const double* rOperand = stack[top - 1];
+			dst = scratch + (top - 2) * BATCH_BLOCK;
+
+			switch(instruction->op) {
+				case opAdd:
+					kernels->add(dst, lOperand, rOperand, n);
+					break;
+				case opSub:
+					kernels->sub(dst, lOperand, rOperand, n);
+					break;
+				case opMul:
+					kernels->mul(dst, lOperand, rOperand, n);
+					break;
+				case opDiv:
+					// Only rows dividing by zero fail.
+					for(int i = 0; i < n; ++i) {
+						if(rOperand[i] == 0) {
+							if(!anyFailed) {
+								memset(failed, 0, sizeof(failed));
+								anyFailed = 1;
+							}
+
+							failed[i] = 1;
+						}
+					}
+
+					kernels->div(dst, lOperand, rOperand, n);
+					break;
+				case opPow:
+					kernels->pow(dst, lOperand, rOperand, n);
+					break;
+			}
+
+			--top;
+			stack[top - 1] = dst;
+		}
+
+		memcpy(results + base, stack[0], n * sizeof(double));
+
+		if(rowStatus != NULL) {
+			for(int i = 0; i < n; ++i) {
+				rowStatus[base + i] = success;
+			}
+		}
+
+		if(anyFailed) {
+			for(int i = 0; i < n; ++i) {
+				if(failed[i]) {
+					results[base + i] = NAN;
+
+					if(rowStatus != NULL) {
+						rowStatus[base + i] = divZero;
+					}
+				}
+			}
+
+			if(status == success) {
+				status = divZero;
+			}
+		}
+	}
+
+	free(scratch);
+	free(stack);
+	return status;
+}
+
+#endif
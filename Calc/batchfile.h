@@ -0,0 +1,343 @@
+#ifndef BATCHFILE_H
+#define BATCHFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "calc.h"
+#include "context.h"
+#include "../IO/writer.h"
+
+// Lines evaluated together, split between the workers. Bounds the results
+// held at once however long the input is.
+#define BATCH_LINES     65536
+
+// Room reserved in an output buffer for one formatted line.
+#define BATCH_LINE_TEXT 128
+
+// Outcome of one line of input.
+typedef struct {
+	double result;
+	Status status;
+	char empty;
+	char usesAns;
+} LineResult;
+
+// A worker and the block of lines it evaluates. Each has its own context,
+// so workers share nothing and run without locks.
+typedef struct {
+	CalcContext* context;
+
+	// Lines [first, last) of the current window, and where their results
+	// go.
+	const char* text;
+	const size_t* starts;
+	int first;
+	int last;
+	LineResult* results;
+
+	// Answer going into the first line of the block, then coming out of the
+	// last.
+	double ans;
+
+	char* output;
+	size_t outputSize;
+	size_t outputCapacity;
+} BatchWorker;
+
+typedef struct {
+	BatchWorker* workers;
+	pthread_t* threads;
+	int threadCount;
+
+	LineResult* results;
+
+	// Answer after the last line evaluated.
+	double ans;
+} BatchEvaluator;
+
+BatchEvaluator* batchEvaluatorCreate(int threadCount, size_t cacheLimit,
+		unsigned jitThreshold);
+void batchEvaluateLines(BatchEvaluator* evaluator, const char* text,
+		const size_t* starts, int count, Writer* out);
+void batchRunWorkers(BatchEvaluator* evaluator, void* (*work)(void*));
+void* batchEvaluateWorker(void* arg);
+void* batchFormatWorker(void* arg);
+void batchEvaluateLine(CalcContext* context, const char* line, size_t length,
+		LineResult* lineResult);
+void batchGetCacheStats(const BatchEvaluator* evaluator, CalcCacheStats* stats);
+void batchEnableStats(BatchEvaluator* evaluator, int enabled);
+void batchGetStats(const BatchEvaluator* evaluator, CalcStats* stats);
+void batchEvaluatorDestroy(BatchEvaluator* evaluator);
+
+
+// Function definitions:
+
+// Creates the workers, sharing cacheLimit bytes of cache equally, or none
+// for 0, compiling cached programs to native code after jitThreshold
+// evaluations.
+BatchEvaluator* batchEvaluatorCreate(int threadCount, size_t cacheLimit,
+		unsigned jitThreshold) {
+	BatchEvaluator* evaluator = malloc(sizeof(BatchEvaluator));
+
+	if(evaluator == NULL) {
+		fprintf(stderr, "Allocation of batch evaluator failed.\n");
+		exit(1);
+	}
+
+	evaluator->threadCount = threadCount;
+	evaluator->workers = calloc(threadCount, sizeof(BatchWorker));
+	evaluator->threads = malloc(threadCount * sizeof(pthread_t));
+	evaluator->results = malloc(BATCH_LINES * sizeof(LineResult));
+	evaluator->ans = 0.0;
+
+	if(evaluator->workers == NULL || evaluator->threads == NULL
+			|| evaluator->results == NULL) {
+		fprintf(stderr, "Allocation of batch evaluator failed.\n");
+		exit(1);
+	}
+
+	for(int i = 0; i < threadCount; ++i) {
+		evaluator->workers[i].context = calcContextCreate();
+		calcSetCacheLimit(evaluator->workers[i].context,
+				(cacheLimit > 0 && cacheLimit < (size_t)threadCount)
+				? 1 : cacheLimit / threadCount);
+		calcSetJitThreshold(evaluator->workers[i].context, jitThreshold);
+		evaluator->workers[i].results = evaluator->results;
+	}
+
+	return evaluator;
+}
+
+// Evaluates count lines of text, line i running from starts[i] to
+// starts[i + 1], and writes one line of output for each in input order.
+//
+// Each worker takes a contiguous block of lines. Only the first knows the
+// answer its block starts from, so the others start from 0 and their leading
+// lines that read ans are evaluated again once the real answer is known.
+// Later lines are unaffected, as the first line to produce an answer without
+// reading ans puts the worker back on the true sequence of answers.
+//
+// Variables have no such fixup, so a window assigning any is evaluated by
+// the first worker alone, and the others then take its variables.
+void batchEvaluateLines(BatchEvaluator* evaluator, const char* text,
+		const size_t* starts, int count, Writer* out) {
+	int threadCount = evaluator->threadCount;
+	int assigns = 0;
+
+	for(int line = 0; line < count && !assigns; ++line) {
+		size_t nameStart, nameLength, valueStart;
+
+		assigns = splitAssignment(text + starts[line],
+				starts[line + 1] - starts[line], &nameStart, &nameLength,
+				&valueStart);
+	}
+
+	for(int i = 0; i < threadCount; ++i) {
+		BatchWorker* worker = &evaluator->workers[i];
+		int workers = assigns ? 1 : threadCount;
+
+		worker->text = text;
+		worker->starts = starts;
+		worker->first = (i < workers) ? (int)((long long)count * i / workers) : count;
+		worker->last = (i < workers) ? (int)((long long)count * (i + 1) / workers) : count;
+		worker->ans = (i == 0) ? evaluator->ans : 0.0;
+	}
+
+	batchRunWorkers(evaluator, batchEvaluateWorker);
+
+	double ans = evaluator->workers[0].ans;
+
+	for(int i = 1; i < threadCount; ++i) {
+		BatchWorker* worker = &evaluator->workers[i];
+		int settled = 0;
+
+		for(int line = worker->first; line < worker->last && !settled; ++line) {
+			LineResult* lineResult = &evaluator->results[line];
+
+			if(lineResult->usesAns) {
+				calcSetAns(evaluator->workers[0].context, ans);
+				batchEvaluateLine(evaluator->workers[0].context,
+						text + starts[line], starts[line + 1] - starts[line],
+						lineResult);
+				ans = calcGetAns(evaluator->workers[0].context);
+			} else if(lineResult->status == success && !lineResult->empty) {
+				settled = 1;
+			}
+		}
+
+		if(settled) {
+			ans = worker->ans;
+		}
+	}
+
+	evaluator->ans = ans;
+
+	if(assigns) {
+		for(int i = 1; i < threadCount; ++i) {
+			contextSyncVariables(evaluator->workers[i].context,
+					evaluator->workers[0].context);
+		}
+	}
+
+	// Formatting costs about as much as evaluating, so it is split the same
+	// way. Only the writing is serial.
+	batchRunWorkers(evaluator, batchFormatWorker);
+
+	for(int i = 0; i < threadCount; ++i) {
+		writerWrite(out, evaluator->workers[i].output,
+				evaluator->workers[i].outputSize);
+	}
+}
+
+// Runs work on every worker, the first on the calling thread, and waits for
+// all of them.
+void batchRunWorkers(BatchEvaluator* evaluator, void* (*work)(void*)) {
+	for(int i = 1; i < evaluator->threadCount; ++i) {
+		if(pthread_create(&evaluator->threads[i], NULL, work,
+				&evaluator->workers[i]) != 0) {
+			fprintf(stderr, "Creation of worker thread failed.\n");
+			exit(1);
+		}
+	}
+
+	work(&evaluator->workers[0]);
+
+	for(int i = 1; i < evaluator->threadCount; ++i) {
+		pthread_join(evaluator->threads[i], NULL);
+	}
+}
+
+// Evaluates a worker's block of lines, carrying ans from line to line.
+void* batchEvaluateWorker(void* arg) {
+	BatchWorker* worker = arg;
+
+	calcSetAns(worker->context, worker->ans);
+
+	for(int line = worker->first; line < worker->last; ++line) {
+		batchEvaluateLine(worker->context, worker->text + worker->starts[line],
+				worker->starts[line + 1] - worker->starts[line],
+				&worker->results[line]);
+	}
+
+	worker->ans = calcGetAns(worker->context);
+	return NULL;
+}
+
+// Formats the results of a worker's block into its output buffer.
+void* batchFormatWorker(void* arg) {
+	BatchWorker* worker = arg;
+
+	worker->outputSize = 0;
+
+	for(int line = worker->first; line < worker->last; ++line) {
+		const LineResult* lineResult = &worker->results[line];
+
+		if(worker->outputCapacity - worker->outputSize < BATCH_LINE_TEXT) {
+			worker->outputCapacity = worker->outputCapacity
+					? 2 * worker->outputCapacity : 64 * BATCH_LINE_TEXT;
+			worker->output = realloc(worker->output, worker->outputCapacity);
+
+			if(worker->output == NULL) {
+				fprintf(stderr, "Allocation of batch output failed.\n");
+				exit(1);
+			}
+		}
+
+		char* text = worker->output + worker->outputSize;
+
+		if(lineResult->status != success) {
+			worker->outputSize += sprintf(text, "Error: %s\n",
+					calcStatusMessage(lineResult->status));
+		} else if(lineResult->empty) {
+			text[0] = '\n';
+			++(worker->outputSize);
+		} else {
+			worker->outputSize += sprintf(text, "%.17g\n", lineResult->result);
+		}
+	}
+
+	return NULL;
+}
+
+// Evaluates one line in a context, carrying its answer on.
+void batchEvaluateLine(CalcContext* context, const char* line, size_t length,
+		LineResult* lineResult) {
+	CalcResult result;
+
+	lineResult->status = calcEvaluate(context, line, length, &result);
+	lineResult->result = result.value;
+	lineResult->empty = result.empty;
+	lineResult->usesAns = result.usesAns;
+}
+
+// Sums the cache counters of every worker.
+void batchGetCacheStats(const BatchEvaluator* evaluator, CalcCacheStats* stats) {
+	memset(stats, 0, sizeof(CalcCacheStats));
+
+	for(int i = 0; i < evaluator->threadCount; ++i) {
+		CalcCacheStats workerStats;
+
+		calcGetCacheStats(evaluator->workers[i].context, &workerStats);
+		stats->hits += workerStats.hits;
+		stats->misses += workerStats.misses;
+		stats->evictions += workerStats.evictions;
+		stats->entries += workerStats.entries;
+		stats->bytes += workerStats.bytes;
+		stats->limit += workerStats.limit;
+	}
+}
+
+void batchEnableStats(BatchEvaluator* evaluator, int enabled) {
+	for(int i = 0; i < evaluator->threadCount; ++i) {
+		calcEnableStats(evaluator->workers[i].context, enabled);
+	}
+}
+
+// Sums the statistics of every worker. Times are summed too, so they are
+// thread time rather than elapsed time.
+void batchGetStats(const BatchEvaluator* evaluator, CalcStats* stats) {
+	memset(stats, 0, sizeof(CalcStats));
+
+	for(int i = 0; i < evaluator->threadCount; ++i) {
+		CalcStats workerStats;
+
+		calcGetStats(evaluator->workers[i].context, &workerStats);
+		stats->lexTime += workerStats.lexTime;
+		stats->compileTime += workerStats.compileTime;
+		stats->evalTime += workerStats.evalTime;
+		stats->lexed += workerStats.lexed;
+		stats->compiled += workerStats.compiled;
+		stats->evaluated += workerStats.evaluated;
+		stats->allocations += workerStats.allocations;
+		stats->eliminated += workerStats.eliminated;
+
+		if(workerStats.maxOperatorDepth > stats->maxOperatorDepth) {
+			stats->maxOperatorDepth = workerStats.maxOperatorDepth;
+		}
+
+		if(workerStats.maxEvalDepth > stats->maxEvalDepth) {
+			stats->maxEvalDepth = workerStats.maxEvalDepth;
+		}
+
+		for(int op = 0; op < CALC_OPS; ++op) {
+			stats->opCounts[op] += workerStats.opCounts[op];
+		}
+	}
+}
+
+void batchEvaluatorDestroy(BatchEvaluator* evaluator) {
+	for(int i = 0; i < evaluator->threadCount; ++i) {
+		calcContextDestroy(evaluator->workers[i].context);
+		free(evaluator->workers[i].output);
+	}
+
+	free(evaluator->workers);
+	free(evaluator->threads);
+	free(evaluator->results);
+	free(evaluator);
+}
+
+#endif
@@ -0,0 +1,1341 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "status.h"
+#include "../Memory/arena.h"
+
+// Limbs hold nine decimal digits each, so numbers read and print exactly.
+#define BIG_BASE        1000000000u
+#define BIG_DIGITS      9
+
+// Limbs worked to beyond those asked for, absorbing rounding errors.
+#define BIG_GUARD       2
+
+// Terms of a series summed between compactions of the arena.
+#define BIG_COMPACT     8
+
+// Operands at least this many limbs long are multiplied by Karatsuba's
+// method rather than the schoolbook one.
+#define KARATSUBA_LIMBS 32
+
+// Largest magnitude exp() is taken of, and largest power of BIG_BASE a
+// power may reach. Anything larger would overflow the exponent.
+#define BIG_EXP_LIMIT   1e9
+
+// Decimal floating point number of arbitrary precision, worth
+// sign * sum(limbs[i] * BIG_BASE^(exponent + i)). Limbs are least
+// significant first with no zero limb at either end, so zero has none. They
+// are taken from an arena and never changed once the number is made, so
+// numbers may share them, and a result may be written over an operand.
+//
+// Every operation takes the precision of its result in limbs, and rounds to
+// it.
+typedef struct {
+	uint32_t* limbs;
+	int size;
+	int exponent;
+	int sign;
+} BigNum;
+
+#define isBigZero(a) ((a)->size == 0)
+
+// Power of BIG_BASE just above the most significant limb.
+#define getBigTop(a) ((a)->exponent + (a)->size)
+
+void bigSetSmall(BigNum* r, uint32_t value, int sign, Arena* arena);
+void bigSetZero(BigNum* r);
+Status bigFromText(BigNum* r, const char* text, int length, int precision,
+		Arena* arena);
+Status bigFromDouble(BigNum* r, double x, int precision, Arena* arena);
+double bigToDouble(const BigNum* a, Arena* arena);
+size_t bigFormat(const BigNum* a, int digits, char* buffer, size_t size,
+		Arena* arena);
+void bigNormalise(BigNum* r, int precision);
+void bigTruncate(BigNum* a, int precision);
+void bigCopy(BigNum* r, const BigNum* a, int precision, Arena* arena);
+void bigNegate(BigNum* r, const BigNum* a);
+void bigCompact(Arena* arena, ArenaMark mark, BigNum** numbers, int count);
+uint32_t bigLimbAt(const BigNum* a, int position);
+void bigLeading(const BigNum* a, double* mantissa, int* exponent);
+int bigCompareAbs(const BigNum* a, const BigNum* b);
+int bigToInteger(const BigNum* a, long* value);
+void bigRoundInteger(BigNum* r, const BigNum* a, Arena* arena);
+void bigAddSigned(BigNum* r, const BigNum* a, const BigNum* b, int bSign,
+		int precision, Arena* arena);
+void bigAdd(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena);
+void bigSub(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena);
+uint32_t bigAddLimbs(uint32_t* r, int rSize, const uint32_t* a, int aSize);
+void bigSubLimbs(uint32_t* r, int rSize, const uint32_t* a, int aSize);
+void bigMulLimbs(uint32_t* r, const uint32_t* a, int aSize, const uint32_t* b,
+		int bSize, Arena* arena);
+void bigMul(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena);
+void bigMulSmall(BigNum* r, const BigNum* a, uint32_t m, int precision,
+		Arena* arena);
+void bigDivSmall(BigNum* r, const BigNum* a, uint32_t d, int precision,
+		Arena* arena);
+int bigNewtonSteps(int precision, int growth, int* steps);
+void bigReciprocal(BigNum* r, const BigNum* a, int precision, Arena* arena);
+Status bigDiv(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena);
+Status bigSqrt(BigNum* r, const BigNum* a, int precision, Arena* arena);
+Status bigPowi(BigNum* r, const BigNum* a, long exponent, int precision,
+		Arena* arena);
+int bigHalvings(int precision);
+Status bigExp(BigNum* r, const BigNum* x, int precision, Arena* arena);
+void bigLogReduced(BigNum* r, const BigNum* f, int precision, Arena* arena);
+Status bigLog(BigNum* r, const BigNum* x, int precision, Arena* arena);
+Status bigPow(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena);
+void bigAtanInverse(BigNum* r, uint32_t n, int precision, Arena* arena);
+void bigPi(BigNum* r, int precision, Arena* arena);
+void bigSinCos(BigNum* sine, BigNum* cosine, const BigNum* x,
+		const BigNum* pi, int precision, Arena* arena);
+
+
+// Function definitions:
+
+void bigSetSmall(BigNum* r, uint32_t value, int sign, Arena* arena) {
+	bigSetZero(r);
+
+	if(value == 0) {
+		return;
+	}
+
+	r->limbs = arenaAlloc(arena, 2 * sizeof(uint32_t));
+	r->limbs[0] = value % BIG_BASE;
+	r->limbs[1] = value / BIG_BASE;
+	r->size = 2;
+	r->sign = sign;
+	bigNormalise(r, 2);
+}
+
+void bigSetZero(BigNum* r) {
+	r->limbs = NULL;
+	r->size = 0;
+	r->exponent = 0;
+	r->sign = 1;
+}
+
+// Reads a decimal number: an optional sign, digits with at most one decimal
+// point, and an optional exponent. The text need not be terminated.
+// Returns success, or evalFail if the text is not a number.
+Status bigFromText(BigNum* r, const char* text, int length, int precision,
+		Arena* arena) {
+	char* digits = arenaAlloc(arena, length + BIG_DIGITS);
+	int count = 0, fraction = 0, point = 0, sign = 1, i = 0;
+	long exponent = 0;
+
+	if(i < length && (text[i] == '-' || text[i] == '+')) {
+		sign = (text[i++] == '-') ? -1 : 1;
+	}
+
+	for(; i < length && text[i] != 'e' && text[i] != 'E'; ++i) {
+		if(text[i] == '.' && !point) {
+			point = 1;
+		} else if(text[i] >= '0' && text[i] <= '9') {
+			// Leading zeros are dropped, though they still count
+			// towards the places after the point.
+			fraction += point;
+
+			if(count > 0 || text[i] != '0') {
+				digits[count++] = text[i];
+			}
+		} else {
+			return evalFail;
+		}
+	}
+
+	if(i < length) {
+		int exponentSign = 1, exponentDigits = 0;
+
+		if(++i < length && (text[i] == '-' || text[i] == '+')) {
+			exponentSign = (text[i++] == '-') ? -1 : 1;
+		}
+
+		for(; i < length && text[i] >= '0' && text[i] <= '9'; ++i) {
+			if(exponent < 1000000000L) {
+				exponent = 10 * exponent + (text[i] - '0');
+			}
+
+			++exponentDigits;
+		}
+
+		if(i < length || exponentDigits == 0 || exponent >= 1000000000L) {
+			return evalFail;
+		}
+
+		exponent *= exponentSign;
+	}
+
+	bigSetZero(r);
+
+	if(count == 0) {
+		return success;
+	}
+
+	// Digits past the precision cannot change the rounded result.
+	long power = exponent - fraction;
+
+	if(count > (precision + 1) * BIG_DIGITS) {
+		power += count - (precision + 1) * BIG_DIGITS;
+		count = (precision + 1) * BIG_DIGITS;
+	}
+
+	// Pad with zeros so the last digit ends a limb.
+	int pad = (int)(((power % BIG_DIGITS) + BIG_DIGITS) % BIG_DIGITS);
+
+	memset(digits + count, '0', pad);
+	count += pad;
+	power -= pad;
+
+	r->size = (count + BIG_DIGITS - 1) / BIG_DIGITS;
+	r->limbs = arenaAlloc(arena, r->size * sizeof(uint32_t));
+	r->exponent = (int)(power / BIG_DIGITS);
+	r->sign = sign;
+
+	for(int limb = 0; limb < r->size; ++limb) {
+		int end = count - limb * BIG_DIGITS;
+		int start = (end > BIG_DIGITS) ? end - BIG_DIGITS : 0;
+		uint32_t value = 0;
+
+		for(int digit = start; digit < end; ++digit) {
+			value = 10 * value + (digits[digit] - '0');
+		}
+
+		r->limbs[limb] = value;
+	}
+
+	bigNormalise(r, precision);
+	return success;
+}
+
+// Reads a double through 17 significant digits, which are enough to read
+// back as the same double.
+// Returns success, or outOfDomain for an infinity or NaN.
+Status bigFromDouble(BigNum* r, double x, int precision, Arena* arena) {
+	char buffer[32];
+
+	if(!isfinite(x)) {
+		return outOfDomain;
+	}
+
+	snprintf(buffer, sizeof(buffer), "%.17e", x);
+	return bigFromText(r, buffer, strlen(buffer), precision, arena);
+}
+
+// Returns the nearest double, or an infinity if there is none.
+double bigToDouble(const BigNum* a, Arena* arena) {
+	char buffer[64];
+
+	bigFormat(a, 17, buffer, sizeof(buffer), arena);
+	return strtod(buffer, NULL);
+}
+
+// Writes a number rounded to the given significant digits, as printf()'s %g
+// would: plainly unless the exponent is below -4 or at least digits, and
+// without trailing zeros. As many characters as fit are written, and the
+// text is always terminated.
+// Returns the length of the whole text, as snprintf() does.
+size_t bigFormat(const BigNum* a, int digits, char* buffer, size_t size,
+		Arena* arena) {
+	char* text = arenaAlloc(arena, a->size * BIG_DIGITS + digits + 48);
+	char* mantissa = arenaAlloc(arena, a->size * BIG_DIGITS + 1);
+	int length = 0, count = 0;
+
+	if(isBigZero(a)) {
+		text[length++] = '0';
+	} else {
+		count = sprintf(mantissa, "%u", a->limbs[a->size - 1]);
+
+		for(int i = a->size - 2; i >= 0; --i) {
+			count += sprintf(mantissa + count, "%09u", a->limbs[i]);
+		}
+
+		// Places before the decimal point.
+		long point = count + (long)a->exponent * BIG_DIGITS;
+
+		if(count > digits) {
+			int up = (mantissa[digits] >= '5');
+
+			count = digits;
+
+			for(int i = count - 1; up && i >= 0; --i) {
+				up = (mantissa[i] == '9');
+				mantissa[i] = up ? '0' : mantissa[i] + 1;
+			}
+
+			if(up) {
+				mantissa[0] = '1';
+				++point;
+			}
+		}
+
+		while(count > 1 && mantissa[count - 1] == '0') {
+			--count;
+		}
+
+		if(a->sign < 0) {
+			text[length++] = '-';
+		}
+
+		if(point - 1 < -4 || point - 1 >= digits) {
+			text[length++] = mantissa[0];
+
+			if(count > 1) {
+				text[length++] = '.';
+				memcpy(text + length, mantissa + 1, count - 1);
+				length += count - 1;
+			}
+
+			length += sprintf(text + length, "e%c%02ld",
+					(point - 1 < 0) ? '-' : '+', labs(point - 1));
+		} else if(point <= 0) {
+			text[length++] = '0';
+			text[length++] = '.';
+			memset(text + length, '0', -point);
+			length += -point;
+			memcpy(text + length, mantissa, count);
+			length += count;
+		} else if(point >= count) {
+			memcpy(text + length, mantissa, count);
+			length += count;
+			memset(text + length, '0', point - count);
+			length += point - count;
+		} else {
+			memcpy(text + length, mantissa, point);
+			length += point;
+			text[length++] = '.';
+			memcpy(text + length, mantissa + point, count - point);
+			length += count - point;
+		}
+	}
+
+	if(size > 0) {
+		size_t copied = ((size_t)length < size) ? (size_t)length : size - 1;
+
+		memcpy(buffer, text, copied);
+		buffer[copied] = '\0';
+	}
+
+	return length;
+}
+
+// Drops zero limbs from both ends, and rounds to precision limbs. Only
+// numbers whose limbs were just made may be normalised, as rounding changes
+// them in place.
+void bigNormalise(BigNum* r, int precision) {
+	while(r->size > 0 && r->limbs[r->size - 1] == 0) {
+		--(r->size);
+	}
+
+	if(r->size > precision) {
+		int drop = r->size - precision;
+		int up = (r->limbs[drop - 1] >= BIG_BASE / 2);
+
+		r->limbs += drop;
+		r->size = precision;
+		r->exponent += drop;
+
+		for(int i = 0; up && i < r->size; ++i) {
+			up = (++(r->limbs[i]) == BIG_BASE);
+
+			if(up) {
+				r->limbs[i] = 0;
+			}
+		}
+
+		// Every limb carried, leaving a power of the base.
+		if(up) {
+			r->limbs[0] = 1;
+			r->exponent += r->size;
+			r->size = 1;
+		}
+	}
+
+	while(r->size > 0 && r->limbs[0] == 0) {
+		++(r->limbs);
+		--(r->size);
+		++(r->exponent);
+	}
+
+	if(r->size == 0) {
+		bigSetZero(r);
+	}
+}
+
+// Cuts a number to its precision most significant limbs without rounding,
+// leaving the limbs themselves untouched.
+void bigTruncate(BigNum* a, int precision) {
+	if(a->size > precision) {
+		int drop = a->size - precision;
+
+		a->limbs += drop;
+		a->size = precision;
+		a->exponent += drop;
+	}
+
+	while(a->size > 0 && a->limbs[0] == 0) {
+		++(a->limbs);
+		--(a->size);
+		++(a->exponent);
+	}
+}
+
+// Rounds a copy of a to precision, sharing its limbs when they already fit.
+void bigCopy(BigNum* r, const BigNum* a, int precision, Arena* arena) {
+	BigNum copy = *a;
+
+	if(copy.size > precision) {
+		copy.limbs = arenaAlloc(arena, a->size * sizeof(uint32_t));
+		memcpy(copy.limbs, a->limbs, a->size * sizeof(uint32_t));
+		bigNormalise(&copy, precision);
+	}
+
+	*r = copy;
+}
+
+void bigNegate(BigNum* r, const BigNum* a) {
+	*r = *a;
+
+	if(!isBigZero(r)) {
+		r->sign = -r->sign;
+	}
+}
+
+// Gives back everything allocated since the mark but the limbs of the
+// numbers given, which are moved down to where the mark was. A long series
+// does this every few terms, so it only holds the memory of the numbers it
+// still needs.
+void bigCompact(Arena* arena, ArenaMark mark, BigNum** numbers, int count) {
+	size_t total = 0, offset = 0;
+
+	for(int i = 0; i < count; ++i) {
+		total += numbers[i]->size;
+	}
+
+	uint32_t* saved = malloc(total * sizeof(uint32_t) + 1);
+
+	if(saved == NULL) {
+		fprintf(stderr, "Allocation of number limbs failed.\n");
+		exit(1);
+	}
+
+	for(int i = 0; i < count; ++i) {
+		memcpy(saved + offset, numbers[i]->limbs,
+				numbers[i]->size * sizeof(uint32_t));
+		offset += numbers[i]->size;
+	}
+
+	arenaRelease(arena, mark);
+	offset = 0;
+
+	for(int i = 0; i < count; ++i) {
+		if(!isBigZero(numbers[i])) {
+			numbers[i]->limbs = arenaAlloc(arena,
+					numbers[i]->size * sizeof(uint32_t));
+			memcpy(numbers[i]->limbs, saved + offset,
+					numbers[i]->size * sizeof(uint32_t));
+			offset += numbers[i]->size;
+		}
+	}
+
+	free(saved);
+}
+
+// Returns the limb worth BIG_BASE^position, which may lie outside the limbs
+// stored.
+uint32_t bigLimbAt(const BigNum* a, int position) {
+	int i = position - a->exponent;
+
+	return (i >= 0 && i < a->size) ? a->limbs[i] : 0;
+}
+
+// Splits the magnitude of a non-zero number into a double holding its
+// leading limbs and the power of the base it is to be multiplied by.
+void bigLeading(const BigNum* a, double* mantissa, int* exponent) {
+	if(a->size == 1) {
+		*mantissa = a->limbs[0];
+		*exponent = a->exponent;
+	} else {
+		*mantissa = (double)a->limbs[a->size - 1] * BIG_BASE
+				+ a->limbs[a->size - 2];
+		*exponent = a->exponent + a->size - 2;
+	}
+}
+
+// Returns the sign of |a| - |b|.
+int bigCompareAbs(const BigNum* a, const BigNum* b) {
+	if(isBigZero(a) || isBigZero(b)) {
+		return !isBigZero(a) - !isBigZero(b);
+	}
+
+	if(getBigTop(a) != getBigTop(b)) {
+		return (getBigTop(a) > getBigTop(b)) ? 1 : -1;
+	}
+
+	int i = a->size - 1, j = b->size - 1;
+
+	for(; i >= 0 && j >= 0; --i, --j) {
+		if(a->limbs[i] != b->limbs[j]) {
+			return (a->limbs[i] > b->limbs[j]) ? 1 : -1;
+		}
+	}
+
+	// Neither ends in a zero limb, so whichever has limbs left is larger.
+	return (i >= 0) - (j >= 0);
+}
+
+// Returns 1 with the value if the number is an integer of magnitude below
+// 2^31, 0 otherwise.
+int bigToInteger(const BigNum* a, long* value) {
+	int64_t magnitude = 0;
+
+	if(isBigZero(a)) {
+		*value = 0;
+		return 1;
+	}
+
+	if(a->exponent < 0 || getBigTop(a) > 2) {
+		return 0;
+	}
+
+	for(int i = a->size - 1; i >= 0; --i) {
+		magnitude = magnitude * BIG_BASE + a->limbs[i];
+	}
+
+	for(int i = 0; i < a->exponent; ++i) {
+		magnitude *= BIG_BASE;
+	}
+
+	if(magnitude >= INT64_C(2147483648)) {
+		return 0;
+	}
+
+	*value = a->sign * (long)magnitude;
+	return 1;
+}
+
+// Rounds to the nearest integer, halves away from zero.
+void bigRoundInteger(BigNum* r, const BigNum* a, Arena* arena) {
+	if(isBigZero(a) || a->exponent >= 0) {
+		*r = *a;
+		return;
+	}
+
+	// Below a half.
+	if(getBigTop(a) < 0) {
+		bigSetZero(r);
+		return;
+	}
+
+	int count = getBigTop(a);
+	int sign = a->sign;
+	uint32_t* limbs = arenaAlloc(arena, (count + 1) * sizeof(uint32_t));
+	uint32_t up = (bigLimbAt(a, -1) >= BIG_BASE / 2);
+
+	for(int i = 0; i < count; ++i) {
+		limbs[i] = bigLimbAt(a, i);
+	}
+
+	limbs[count] = 0;
+	bigAddLimbs(limbs, count + 1, &up, 1);
+
+	r->limbs = limbs;
+	r->size = count + 1;
+	r->exponent = 0;
+	r->sign = sign;
+	bigNormalise(r, count + 1);
+}
+
+// Sets r to a + bSign * b. Limbs of either operand more than the precision
+// below the larger one cannot reach the result, and are left out.
+void bigAddSigned(BigNum* r, const BigNum* a, const BigNum* b, int bSign,
+		int precision, Arena* arena) {
+	if(isBigZero(b)) {
+		bigCopy(r, a, precision, arena);
+		return;
+	} else if(isBigZero(a)) {
+		BigNum negated;
+
+		bigCopy(&negated, b, precision, arena);
+		negated.sign *= bSign;
+		*r = negated;
+		return;
+	}
+
+	int top = (getBigTop(a) > getBigTop(b)) ? getBigTop(a) : getBigTop(b);
+	int low = (a->exponent < b->exponent) ? a->exponent : b->exponent;
+
+	if(top - low > precision + BIG_GUARD) {
+		low = top - precision - BIG_GUARD;
+	}
+
+	// Subtract the smaller magnitude from the larger.
+	int aLarger = (bigCompareAbs(a, b) >= 0);
+	int sameSign = (a->sign == b->sign * bSign);
+	int sign = aLarger ? a->sign : b->sign * bSign;
+	const BigNum* x = aLarger ? a : b;
+	const BigNum* y = aLarger ? b : a;
+	int size = top - low + 1;
+	uint32_t* limbs = arenaAlloc(arena, size * sizeof(uint32_t));
+	int64_t carry = 0;
+
+	for(int i = 0; i < size; ++i) {
+		int64_t limb = (int64_t)bigLimbAt(x, low + i) + carry;
+
+		limb += sameSign ? bigLimbAt(y, low + i) : -(int64_t)bigLimbAt(y, low + i);
+		carry = 0;
+
+		if(limb >= BIG_BASE) {
+			limb -= BIG_BASE;
+			carry = 1;
+		} else if(limb < 0) {
+			limb += BIG_BASE;
+			carry = -1;
+		}
+
+		limbs[i] = (uint32_t)limb;
+	}
+
+	r->limbs = limbs;
+	r->size = size;
+	r->exponent = low;
+	r->sign = sign;
+	bigNormalise(r, precision);
+}
+
+void bigAdd(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena) {
+	bigAddSigned(r, a, b, 1, precision, arena);
+}
+
+void bigSub(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena) {
+	bigAddSigned(r, a, b, -1, precision, arena);
+}
+
+// Adds aSize limbs into rSize limbs of r, which must be at least as many.
+// Returns the carry out of the top.
+uint32_t bigAddLimbs(uint32_t* r, int rSize, const uint32_t* a, int aSize) {
+	uint32_t carry = 0;
+	int i;
+
+	for(i = 0; i < aSize; ++i) {
+		uint32_t sum = r[i] + a[i] + carry;
+
+		carry = (sum >= BIG_BASE);
+		r[i] = carry ? sum - BIG_BASE : sum;
+	}
+
+	for(; carry && i < rSize; ++i) {
+		carry = (++(r[i]) == BIG_BASE);
+
+		if(carry) {
+			r[i] = 0;
+		}
+	}
+
+	return carry;
+}
+
+// Subtracts aSize limbs from rSize limbs of r, which must hold the larger
+// value.
+void bigSubLimbs(uint32_t* r, int rSize, const uint32_t* a, int aSize) {
+	uint32_t borrow = 0;
+	int i;
+
+	for(i = 0; i < aSize; ++i) {
+		uint32_t subtrahend = a[i] + borrow;
+
+		borrow = (r[i] < subtrahend);
+		r[i] = borrow ? r[i] + BIG_BASE - subtrahend : r[i] - subtrahend;
+	}
+
+	for(; borrow && i < rSize; ++i) {
+		borrow = (r[i] == 0);
+		r[i] = borrow ? BIG_BASE - 1 : r[i] - 1;
+	}
+}
+
+// Writes the aSize + bSize limbs of a * b to r. Long operands are split in
+// halves, a = a1 * BIG_BASE^m + a0 and likewise b, and multiplied with
+// three half size products rather than four:
+// a * b = z2 * BIG_BASE^2m + z1 * BIG_BASE^m + z0, with z0 = a0 * b0,
+// z2 = a1 * b1 and z1 = (a0 + a1)(b0 + b1) - z0 - z2. Scratch space comes
+// from the arena, and is given back before returning.
+void bigMulLimbs(uint32_t* r, const uint32_t* a, int aSize, const uint32_t* b,
+		int bSize, Arena* arena) {
+	if(aSize < bSize) {
+		const uint32_t* swap = a;
+		int swapSize = aSize;
+
+		a = b;
+		aSize = bSize;
+		b = swap;
+		bSize = swapSize;
+	}
+
+	if(bSize < KARATSUBA_LIMBS) {
+		memset(r, 0, (aSize + bSize) * sizeof(uint32_t));
+
+		for(int i = 0; i < aSize; ++i) {
+			uint64_t carry = 0;
+
+			if(a[i] == 0) {
+				continue;
+			}
+
+			for(int j = 0; j < bSize; ++j) {
+				uint64_t product = r[i + j] + (uint64_t)a[i] * b[j] + carry;
+
+				r[i + j] = product % BIG_BASE;
+				carry = product / BIG_BASE;
+			}
+
+			r[i + bSize] = (uint32_t)carry;
+		}
+
+		return;
+	}
+
+	int m = aSize / 2;
+	ArenaMark mark = arenaMark(arena);
+
+	// A short b is multiplied by each half of a in turn.
+	if(bSize <= m) {
+		uint32_t* high = arenaAlloc(arena, (aSize - m + bSize) * sizeof(uint32_t));
+
+		bigMulLimbs(r, a, m, b, bSize, arena);
+		memset(r + m + bSize, 0, (aSize - m) * sizeof(uint32_t));
+		bigMulLimbs(high, a + m, aSize - m, b, bSize, arena);
+		bigAddLimbs(r + m, aSize + bSize - m, high, aSize - m + bSize);
+		arenaRelease(arena, mark);
+		return;
+	}
+
+	// The sums may carry into one more limb than their longer half.
+	int bLong = (m > bSize - m) ? m : bSize - m;
+	int aSumSize = aSize - m + 1, bSumSize = bLong + 1;
+	uint32_t* aSum = arenaAlloc(arena, aSumSize * sizeof(uint32_t));
+	uint32_t* bSum = arenaAlloc(arena, bSumSize * sizeof(uint32_t));
+	uint32_t* middle = arenaAlloc(arena, (aSumSize + bSumSize) * sizeof(uint32_t));
+
+	memcpy(aSum, a + m, (aSize - m) * sizeof(uint32_t));
+	aSum[aSize - m] = bigAddLimbs(aSum, aSize - m, a, m);
+
+	if(m >= bSize - m) {
+		memcpy(bSum, b, m * sizeof(uint32_t));
+		bSum[m] = bigAddLimbs(bSum, m, b + m, bSize - m);
+	} else {
+		memcpy(bSum, b + m, (bSize - m) * sizeof(uint32_t));
+		bSum[bSize - m] = bigAddLimbs(bSum, bSize - m, b, m);
+	}
+
+	bigMulLimbs(r, a, m, b, m, arena);
+	bigMulLimbs(r + 2 * m, a + m, aSize - m, b + m, bSize - m, arena);
+	bigMulLimbs(middle, aSum, aSumSize, bSum, bSumSize, arena);
+	bigSubLimbs(middle, aSumSize + bSumSize, r, 2 * m);
+	bigSubLimbs(middle, aSumSize + bSumSize, r + 2 * m, aSize + bSize - 2 * m);
+
+	// z1 is below BIG_BASE^(aSize + bSize - m), so any limbs above that are
+	// zero.
+	int middleSize = aSumSize + bSumSize;
+
+	if(middleSize > aSize + bSize - m) {
+		middleSize = aSize + bSize - m;
+	}
+
+	bigAddLimbs(r + m, aSize + bSize - m, middle, middleSize);
+	arenaRelease(arena, mark);
+}
+
+void bigMul(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena) {
+	if(isBigZero(a) || isBigZero(b)) {
+		bigSetZero(r);
+		return;
+	}
+
+	BigNum x = *a, y = *b;
+
+	// Limbs below the precision of the result need not be multiplied.
+	bigTruncate(&x, precision + 1);
+	bigTruncate(&y, precision + 1);
+
+	uint32_t* limbs = arenaAlloc(arena, (x.size + y.size) * sizeof(uint32_t));
+
+	bigMulLimbs(limbs, x.limbs, x.size, y.limbs, y.size, arena);
+	r->limbs = limbs;
+	r->size = x.size + y.size;
+	r->exponent = x.exponent + y.exponent;
+	r->sign = x.sign * y.sign;
+	bigNormalise(r, precision);
+}
+
+void bigMulSmall(BigNum* r, const BigNum* a, uint32_t m, int precision,
+		Arena* arena) {
+	if(isBigZero(a) || m == 0) {
+		bigSetZero(r);
+		return;
+	}
+
+	uint32_t* limbs = arenaAlloc(arena, (a->size + 2) * sizeof(uint32_t));
+	uint64_t carry = 0;
+
+	for(int i = 0; i < a->size; ++i) {
+		uint64_t product = (uint64_t)a->limbs[i] * m + carry;
+
+		limbs[i] = product % BIG_BASE;
+		carry = product / BIG_BASE;
+	}
+
+	limbs[a->size] = carry % BIG_BASE;
+	limbs[a->size + 1] = (uint32_t)(carry / BIG_BASE);
+
+	int sign = a->sign;
+
+	r->exponent = a->exponent;
+	r->limbs = limbs;
+	r->size = a->size + 2;
+	r->sign = sign;
+	bigNormalise(r, precision);
+}
+
+// Divides by a small integer, one limb at a time from the top.
+void bigDivSmall(BigNum* r, const BigNum* a, uint32_t d, int precision,
+		Arena* arena) {
+	BigNum x = *a;
+
+	bigTruncate(&x, precision + 1);
+
+	if(isBigZero(&x)) {
+		bigSetZero(r);
+		return;
+	}
+
+	int size = precision + 1, shift = size - x.size;
+	uint32_t* limbs = arenaAlloc(arena, size * sizeof(uint32_t));
+	uint64_t remainder = 0;
+
+	for(int i = size - 1; i >= 0; --i) {
+		uint64_t current = remainder * BIG_BASE
+				+ ((i >= shift) ? x.limbs[i - shift] : 0);
+
+		limbs[i] = (uint32_t)(current / d);
+		remainder = current % d;
+	}
+
+	r->limbs = limbs;
+	r->size = size;
+	r->exponent = x.exponent - shift;
+	r->sign = x.sign;
+	bigNormalise(r, precision);
+}
+
+// Fills steps with the precisions of a Newton iteration reaching precision,
+// smallest first, each growth times the last. The first step starts from a
+// double, good to nearly two limbs.
+// Returns the number of steps.
+int bigNewtonSteps(int precision, int growth, int* steps) {
+	int count = 0;
+
+	for(int p = precision; p > 2; p = p / growth + 1) {
+		steps[count++] = p;
+	}
+
+	steps[count++] = 2;
+
+	for(int i = 0, j = count - 1; i < j; ++i, --j) {
+		int swap = steps[i];
+		steps[i] = steps[j];
+		steps[j] = swap;
+	}
+
+	return count;
+}
+
+// Sets r to 1 / a for a non-zero a by Newton's iteration
+// x = x + x(1 - ax), which doubles the correct digits each step, so each
+// step need only be worked to twice the precision of the last. The whole
+// costs a small multiple of one full precision multiplication.
+void bigReciprocal(BigNum* r, const BigNum* a, int precision, Arena* arena) {
+	BigNum x, one, error, correction;
+	int steps[64];
+	int count = bigNewtonSteps(precision + 1, 2, steps);
+	double mantissa;
+	int exponent;
+
+	bigLeading(a, &mantissa, &exponent);
+	bigFromDouble(&x, 1.0 / mantissa, 2, arena);
+	x.exponent -= exponent;
+	x.sign = a->sign;
+	bigSetSmall(&one, 1, 1, arena);
+
+	for(int i = 0; i < count; ++i) {
+		int p = steps[i];
+
+		bigMul(&error, a, &x, p, arena);
+		bigSub(&error, &one, &error, p, arena);
+		bigMul(&correction, &x, &error, p, arena);
+		bigAdd(&x, &x, &correction, p, arena);
+	}
+
+	bigCopy(r, &x, precision, arena);
+}
+
+// Divides by multiplying by the reciprocal, then corrects the quotient with
+// the remainder left by it.
+// Returns success, or divZero.
+Status bigDiv(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena) {
+	BigNum reciprocal, quotient, remainder;
+	int p = precision + 1;
+
+	if(isBigZero(b)) {
+		return divZero;
+	} else if(isBigZero(a)) {
+		bigSetZero(r);
+		return success;
+	}
+
+	bigReciprocal(&reciprocal, b, p, arena);
+	bigMul(&quotient, a, &reciprocal, p, arena);
+
+	// The product cancels with a to about p limbs, so it is kept whole.
+	bigMul(&remainder, b, &quotient, 2 * p + BIG_GUARD, arena);
+	bigSub(&remainder, a, &remainder, 2 * p + BIG_GUARD, arena);
+	bigMul(&remainder, &remainder, &reciprocal, p, arena);
+	bigAdd(&quotient, &quotient, &remainder, p, arena);
+
+	bigCopy(r, &quotient, precision, arena);
+	return success;
+}
+
+// Takes the square root by Newton's iteration for the inverse root,
+// y = y + y(1 - ay^2) / 2, which needs no division, at doubling precision,
+// then sqrt(a) = ay with one correction.
+// Returns success, or outOfDomain for a negative number.
+Status bigSqrt(BigNum* r, const BigNum* a, int precision, Arena* arena) {
+	BigNum y, one, error, root;
+	int steps[64];
+	int count = bigNewtonSteps(precision + 1, 2, steps);
+	int p = precision + 1;
+	double mantissa;
+	int exponent;
+
+	if(isBigZero(a)) {
+		bigSetZero(r);
+		return success;
+	} else if(a->sign < 0) {
+		return outOfDomain;
+	}
+
+	// Halving the exponent needs it even.
+	bigLeading(a, &mantissa, &exponent);
+
+	if(exponent % 2 != 0) {
+		mantissa *= BIG_BASE;
+		--exponent;
+	}
+
+	bigFromDouble(&y, 1.0 / sqrt(mantissa), 2, arena);
+	y.exponent -= exponent / 2;
+	bigSetSmall(&one, 1, 1, arena);
+
+	for(int i = 0; i < count; ++i) {
+		int q = steps[i];
+
+		bigMul(&error, &y, &y, q, arena);
+		bigMul(&error, a, &error, q, arena);
+		bigSub(&error, &one, &error, q, arena);
+		bigMul(&error, &y, &error, q, arena);
+		bigDivSmall(&error, &error, 2, q, arena);
+		bigAdd(&y, &y, &error, q, arena);
+	}
+
+	bigMul(&root, a, &y, p, arena);
+	bigMul(&error, &root, &root, 2 * p + BIG_GUARD, arena);
+	bigSub(&error, a, &error, 2 * p + BIG_GUARD, arena);
+	bigMul(&error, &error, &y, p, arena);
+	bigDivSmall(&error, &error, 2, p, arena);
+	bigAdd(&root, &root, &error, p, arena);
+
+	bigCopy(r, &root, precision, arena);
+	return success;
+}
+
+// Raises a to an integer power by repeated squaring, in the order of
+// applyPowi().
+// Returns success, divZero for a negative power of zero, or outOfDomain if
+// the result would overflow.
+Status bigPowi(BigNum* r, const BigNum* a, long exponent, int precision,
+		Arena* arena) {
+	unsigned long power = (exponent < 0) ? -(unsigned long)exponent
+			: (unsigned long)exponent;
+	int p = precision + 1;
+	BigNum base = *a, result;
+	double mantissa;
+	int top;
+
+	// The result's exponent must fit an int.
+	if(!isBigZero(a)) {
+		bigLeading(a, &mantissa, &top);
+
+		if(fabs((top + log(mantissa) / log(BIG_BASE)) * power) > BIG_EXP_LIMIT) {
+			return outOfDomain;
+		}
+	}
+
+	bigSetSmall(&result, 1, 1, arena);
+
+	while(power > 0) {
+		if(power & 1) {
+			bigMul(&result, &result, &base, p, arena);
+		}
+
+		power >>= 1;
+
+		if(power > 0) {
+			bigMul(&base, &base, &base, p, arena);
+		}
+	}
+
+	if(exponent < 0) {
+		BigNum one;
+
+		bigSetSmall(&one, 1, 1, arena);
+		return bigDiv(r, &one, &result, precision, arena);
+	}
+
+	bigCopy(r, &result, precision, arena);
+	return success;
+}
+
+// Returns how many times to halve an argument below one before summing a
+// Taylor series, so the series converges in about the square root of the
+// bits wanted, as many steps as undoing the halvings takes.
+int bigHalvings(int precision) {
+	int halvings = (int)sqrt(precision * 30.0) / 2;
+
+	return (halvings > 8) ? halvings : 8;
+}
+
+// Takes exp(x) as exp(x / 2^k)^(2^k), with k from bigHalvings() and the
+// magnitude of x, working to enough extra limbs to cover the k squarings.
+// Returns success, or outOfDomain if the result would overflow.
+Status bigExp(BigNum* r, const BigNum* x, int precision, Arena* arena) {
+	BigNum y, sum, term;
+	double mantissa;
+	int exponent;
+
+	if(isBigZero(x)) {
+		bigSetSmall(r, 1, 1, arena);
+		return success;
+	}
+
+	bigLeading(x, &mantissa, &exponent);
+
+	if(exponent > 1) {
+		return outOfDomain;
+	}
+
+	double magnitude = mantissa * pow(BIG_BASE, exponent);
+
+	if(magnitude > BIG_EXP_LIMIT) {
+		return outOfDomain;
+	}
+
+	int halvings = ((magnitude >= 1) ? ilogb(magnitude) + 1 : 0)
+			+ bigHalvings(precision);
+	int p = precision + BIG_GUARD + halvings / 29;
+
+	y = *x;
+
+	for(int left = halvings; left > 0; left -= 29) {
+		bigDivSmall(&y, &y, 1u << ((left < 29) ? left : 29), p, arena);
+	}
+
+	bigSetSmall(&sum, 1, 1, arena);
+	term = sum;
+
+	ArenaMark mark = arenaMark(arena);
+	BigNum* live[] = { &y, &sum, &term };
+
+	for(uint32_t i = 1; ; ++i) {
+		bigMul(&term, &term, &y, p, arena);
+		bigDivSmall(&term, &term, i, p, arena);
+
+		if(isBigZero(&term) || getBigTop(&term) < getBigTop(&sum) - p) {
+			break;
+		}
+
+		bigAdd(&sum, &sum, &term, p, arena);
+
+		if(i % BIG_COMPACT == 0) {
+			bigCompact(arena, mark, live, 3);
+		}
+	}
+
+	for(int i = 0; i < halvings; ++i) {
+		bigMul(&sum, &sum, &sum, p, arena);
+
+		if(i % BIG_COMPACT == 0) {
+			bigCompact(arena, mark, live + 1, 1);
+		}
+	}
+
+	bigCopy(r, &sum, precision, arena);
+	return success;
+}
+
+// Takes log(f) for a positive f below BIG_BASE by Newton's iteration on
+// exp(y) = f, y = y + 2(f - exp(y)) / (f + exp(y)), which triples the
+// correct digits each step. y is below 21, so each step works to one limb
+// more than the digits it is to get right, for the integer part, and the
+// first starts from every digit of a double.
+void bigLogReduced(BigNum* r, const BigNum* f, int precision, Arena* arena) {
+	BigNum y, power, difference, sum;
+	int steps[64];
+	int count = bigNewtonSteps(precision, 3, steps);
+	double mantissa;
+	int exponent;
+
+	bigLeading(f, &mantissa, &exponent);
+	bigFromDouble(&y, log(mantissa) + exponent * log(BIG_BASE), 3, arena);
+
+	for(int i = 0; i < count; ++i) {
+		int p = steps[i] + 1;
+
+		bigExp(&power, &y, p, arena);
+		bigSub(&difference, f, &power, p, arena);
+		bigAdd(&sum, f, &power, p, arena);
+		bigDiv(&difference, &difference, &sum, p, arena);
+		bigMulSmall(&difference, &difference, 2, p, arena);
+		bigAdd(&y, &y, &difference, p, arena);
+	}
+
+	bigCopy(r, &y, precision, arena);
+}
+
+// Takes log(x) as log(f) + 9e log(10), where x = f * BIG_BASE^e with f in
+// [1, BIG_BASE). Both logarithms are worked to BIG_GUARD more limbs, and as
+// many more again as 9e has, which multiplies the error of log(10). A
+// result near zero is worked to as many more limbs as it has leading zeros.
+// Returns success, or outOfDomain for x <= 0.
+Status bigLog(BigNum* r, const BigNum* x, int precision, Arena* arena) {
+	BigNum f, one, difference, result;
+	int e = getBigTop(x) - 1;
+	uint32_t scale = BIG_DIGITS * (uint32_t)abs(e);
+	int p = precision + BIG_GUARD + (scale > 0) + (scale >= BIG_BASE);
+
+	if(isBigZero(x) || x->sign < 0) {
+		return outOfDomain;
+	}
+
+	f = *x;
+	f.exponent -= e;
+	bigSetSmall(&one, 1, 1, arena);
+	bigSub(&difference, &f, &one, p, arena);
+
+	if(e == 0 && !isBigZero(&difference) && getBigTop(&difference) < 0) {
+		p -= getBigTop(&difference);
+	}
+
+	bigLogReduced(&result, &f, p, arena);
+
+	if(e != 0) {
+		BigNum ten, scaled;
+
+		bigSetSmall(&ten, 10, 1, arena);
+		bigLogReduced(&scaled, &ten, p, arena);
+		bigMulSmall(&scaled, &scaled, scale, p, arena);
+		bigAddSigned(&result, &result, &scaled, (e > 0) ? 1 : -1, p, arena);
+	}
+
+	bigCopy(r, &result, precision, arena);
+	return success;
+}
+
+// Raises a to the power b: exactly by bigPowi() when b is an integer, and as
+// exp(b log(a)) otherwise, with as many more limbs as the exponent has
+// before the point.
+// Returns the status of the power.
+Status bigPow(BigNum* r, const BigNum* a, const BigNum* b, int precision,
+		Arena* arena) {
+	BigNum logarithm, product;
+	long integer;
+	int p = precision + BIG_GUARD;
+
+	if(bigToInteger(b, &integer)) {
+		return bigPowi(r, a, integer, precision, arena);
+	} else if(isBigZero(a)) {
+		bigSetZero(r);
+		return (b->sign > 0) ? success : divZero;
+	} else if(a->sign < 0) {
+		return outOfDomain;
+	}
+
+	bigLog(&logarithm, a, p, arena);
+	bigMul(&product, b, &logarithm, p, arena);
+
+	if(getBigTop(&product) > 0) {
+		p += getBigTop(&product);
+		bigLog(&logarithm, a, p, arena);
+		bigMul(&product, b, &logarithm, p, arena);
+	}
+
+	return bigExp(r, &product, precision, arena);
+}
+
+// Sums the series of atan(1/n) = 1/n - 1/3n^3 + 1/5n^5 - ... using
+// divisions by small integers only.
+void bigAtanInverse(BigNum* r, uint32_t n, int precision, Arena* arena) {
+	BigNum power, term, sum;
+
+	bigSetSmall(&power, 1, 1, arena);
+	bigDivSmall(&power, &power, n, precision, arena);
+	sum = power;
+
+	ArenaMark mark = arenaMark(arena);
+	BigNum* live[] = { &power, &sum };
+
+	for(uint32_t k = 1; ; ++k) {
+		if(k % BIG_COMPACT == 0) {
+			bigCompact(arena, mark, live, 2);
+		}
+
+		bigDivSmall(&power, &power, n * n, precision, arena);
+
+		if(isBigZero(&power) || getBigTop(&power) < getBigTop(&sum) - precision) {
+			break;
+		}
+
+		bigDivSmall(&term, &power, 2 * k + 1, precision, arena);
+		bigAddSigned(&sum, &sum, &term, (k % 2) ? -1 : 1, precision, arena);
+	}
+
+	*r = sum;
+}
+
+// Machin's formula, pi = 16 atan(1/5) - 4 atan(1/239).
+void bigPi(BigNum* r, int precision, Arena* arena) {
+	BigNum first, second;
+	int p = precision + 1;
+
+	bigAtanInverse(&first, 5, p, arena);
+	bigAtanInverse(&second, 239, p, arena);
+	bigMulSmall(&first, &first, 16, p, arena);
+	bigMulSmall(&second, &second, 4, p, arena);
+	bigSub(&first, &first, &second, p, arena);
+	bigCopy(r, &first, precision, arena);
+}
+
+// Takes sin(x) and cos(x) together. x is reduced by the nearest multiple of
+// pi/2, which needs pi to as many more limbs as x has before the point, then
+// halved as by bigHalvings() for the Taylor series, and the halvings undone
+// with sin(2y) = 2 sin(y) cos(y) and cos(2y) = 1 - 2 sin(y)^2.
+void bigSinCos(BigNum* sine, BigNum* cosine, const BigNum* x,
+		const BigNum* pi, int precision, Arena* arena) {
+	BigNum halfPi, quarters, y, square, one, s, c, sTerm, cTerm, t;
+	int p = precision + BIG_GUARD + ((getBigTop(x) > 0) ? getBigTop(x) : 0);
+	int halvings = bigHalvings(precision);
+	int q = precision + BIG_GUARD + halvings / 29;
+
+	bigSetSmall(&one, 1, 1, arena);
+
+	if(isBigZero(x)) {
+		bigSetZero(sine);
+		*cosine = one;
+		return;
+	}
+
+	bigDivSmall(&halfPi, pi, 2, p, arena);
+	bigDiv(&quarters, x, &halfPi, p, arena);
+	bigRoundInteger(&quarters, &quarters, arena);
+	bigMul(&t, &quarters, &halfPi, p, arena);
+	bigSub(&y, x, &t, p, arena);
+
+	// BIG_BASE is a multiple of four, so only the units limb gives the
+	// quadrant.
+	int quadrant = (int)(bigLimbAt(&quarters, 0) % 4);
+
+	if(quarters.sign < 0) {
+		quadrant = (4 - quadrant) % 4;
+	}
+
+	for(int left = halvings; left > 0; left -= 29) {
+		bigDivSmall(&y, &y, 1u << ((left < 29) ? left : 29), q, arena);
+	}
+
+	bigMul(&square, &y, &y, q, arena);
+	s = sTerm = y;
+	c = cTerm = one;
+
+	ArenaMark mark = arenaMark(arena);
+	BigNum* live[] = { &square, &s, &c, &sTerm, &cTerm };
+
+	for(uint32_t i = 1; ; ++i) {
+		if(i % BIG_COMPACT == 0) {
+			bigCompact(arena, mark, live, 5);
+		}
+
+		bigMul(&sTerm, &sTerm, &square, q, arena);
+		bigDivSmall(&sTerm, &sTerm, (2 * i) * (2 * i + 1), q, arena);
+		bigNegate(&sTerm, &sTerm);
+		bigMul(&cTerm, &cTerm, &square, q, arena);
+		bigDivSmall(&cTerm, &cTerm, (2 * i - 1) * (2 * i), q, arena);
+		bigNegate(&cTerm, &cTerm);
+
+		if(isBigZero(&cTerm) || getBigTop(&cTerm) < -q) {
+			break;
+		}
+
+		bigAdd(&s, &s, &sTerm, q, arena);
+		bigAdd(&c, &c, &cTerm, q, arena);
+	}
+
+	for(int i = 0; i < halvings; ++i) {
+		if(i % BIG_COMPACT == 0) {
+			bigCompact(arena, mark, live + 1, 2);
+		}
+
+		bigMul(&t, &s, &s, q, arena);
+		bigMulSmall(&t, &t, 2, q, arena);
+		bigMul(&s, &s, &c, q, arena);
+		bigMulSmall(&s, &s, 2, q, arena);
+		bigSub(&c, &one, &t, q, arena);
+	}
+
+	switch(quadrant) {
+		case 1:
+			t = s;
+			s = c;
+			bigNegate(&c, &t);
+			break;
+		case 2:
+			bigNegate(&s, &s);
+			bigNegate(&c, &c);
+			break;
+		case 3:
+			t = s;
+			bigNegate(&s, &c);
+			c = t;
+			break;
+		default:
+			break;
+	}
+
+	bigCopy(sine, &s, precision, arena);
+	bigCopy(cosine, &c, precision, arena);
+}
+
+#endif
@@ -0,0 +1,325 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "status.h"
+#include "program.h"
+#include "lexer.h"
+#include "jit.h"
+#include "parallel.h"
+#include "../Memory/arena.h"
+
+// Initial number of hash buckets.
+#define CACHE_BUCKETS   64
+
+// A compiled expression, keyed by its token stream. Whitespace never makes
+// it into the tokens, so expressions differing only in spacing share one
+// entry.
+typedef struct _CacheEntry {
+	// Neighbours in recency order, and the next entry in the same bucket.
+	struct _CacheEntry* newer;
+	struct _CacheEntry* older;
+	struct _CacheEntry* chain;
+
+	uint64_t hash;
+	unsigned char* key;
+	size_t keyLength;
+	size_t bytes;
+
+	// The program, and its native code once compiled, charged to bytes,
+	// and its split across threads once planned.
+	Program* program;
+	JitState jit;
+	ParallelState parallel;
+
+	// Programs that read no variable always give the same result, which is
+	// kept alongside them.
+	int constant;
+	Status status;
+	double result;
+} CacheEntry;
+
+// Least recently used cache of compiled programs, bounded by the memory its
+// entries take.
+typedef struct {
+	CacheEntry** buckets;
+	int bucketCount;
+	int entryCount;
+
+	CacheEntry* newest;
+	CacheEntry* oldest;
+
+	size_t bytes;
+	size_t limit;
+
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+
+	// Heap allocations for entries and buckets.
+	size_t allocations;
+} ProgramCache;
+
+ProgramCache* cacheCreate(size_t limit);
+unsigned char* cacheKey(const TokenArray* tokenArray, Arena* arena,
+		size_t* keyLength);
+uint64_t cacheHash(const unsigned char* key, size_t keyLength);
+CacheEntry* cacheFind(ProgramCache* cache, const unsigned char* key,
+		size_t keyLength, uint64_t hash);
+CacheEntry* cacheInsert(ProgramCache* cache, const unsigned char* key,
+		size_t keyLength, uint64_t hash, const Program* program);
+void cacheChargeJit(ProgramCache* cache, CacheEntry* entry);
+void cacheUnlink(ProgramCache* cache, CacheEntry* entry);
+void cacheEvict(ProgramCache* cache, size_t limit);
+void cacheDestroy(ProgramCache* cache);
+
+
+// Function definitions:
+
+ProgramCache* cacheCreate(size_t limit) {
+	ProgramCache* cache = calloc(1, sizeof(ProgramCache));
+
+	if(cache == NULL) {
+		fprintf(stderr, "Allocation of cache failed.\n");
+		exit(1);
+	}
+
+	cache->bucketCount = CACHE_BUCKETS;
+	cache->buckets = calloc(cache->bucketCount, sizeof(CacheEntry*));
+	cache->limit = limit;
+
+	if(cache->buckets == NULL) {
+		fprintf(stderr, "Allocation of cache failed.\n");
+		exit(1);
+	}
+
+	return cache;
+}
+
+// Packs what each token means, leaving out where it was in the input, into
+// a key taken from the arena.
+// Returns the key.
+unsigned char* cacheKey(const TokenArray* tokenArray, Arena* arena,
+		size_t* keyLength) {
+	const size_t tokenBytes = 1 + sizeof(int) + sizeof(double);
+	unsigned char* key = arenaAlloc(arena, tokenArray->size * tokenBytes + 1);
+	size_t length = 0;
+
+	for(int i = 0; i < tokenArray->size; ++i) {
+		const Token* token = &tokenArray->tokens[i];
+
+		key[length++] = (unsigned char)token->kind;
+
+		switch(token->kind) {
+			case number:
+			case constant:
+				memcpy(key + length, &token->value, sizeof(double));
+				length += sizeof(double);
+				break;
+			case operator:
+			case function:
+			case variable:
+				memcpy(key + length, &token->code, sizeof(int));
+				length += sizeof(int);
+				break;
+			default:
+				break;
+		}
+	}
+
+	*keyLength = length;
+	return key;
+}
+
+// FNV-1a hash of a key.
+uint64_t cacheHash(const unsigned char* key, size_t keyLength) {
+	uint64_t hash = 14695981039346656037u;
+
+	for(size_t i = 0; i < keyLength; ++i) {
+		hash = (hash ^ key[i]) * 1099511628211u;
+	}
+
+	return hash;
+}
+
+// Looks up a key, making a found entry the most recently used.
+// Returns the entry, or NULL on a miss.
+CacheEntry* cacheFind(ProgramCache* cache, const unsigned char* key,
+		size_t keyLength, uint64_t hash) {
+	CacheEntry* entry = cache->buckets[hash & (cache->bucketCount - 1)];
+
+	// Keys are compared in full, so a hash collision is never a hit.
+	while(entry != NULL && (entry->hash != hash || entry->keyLength != keyLength
+			|| memcmp(entry->key, key, keyLength) != 0)) {
+		entry = entry->chain;
+	}
+
+	if(entry == NULL) {
+		++(cache->misses);
+		return NULL;
+	}
+
+	++(cache->hits);
+
+	if(entry != cache->newest) {
+		cacheUnlink(cache, entry);
+
+		entry->older = cache->newest;
+		entry->newer = NULL;
+		cache->newest->newer = entry;
+		cache->newest = entry;
+	}
+
+	return entry;
+}
+
+// Adds a copy of a program under a key not already present, evicting the
+// least recently used entries to stay within the limit.
+// Returns the entry, or NULL if the program alone exceeds the limit.
+CacheEntry* cacheInsert(ProgramCache* cache, const unsigned char* key,
+		size_t keyLength, uint64_t hash, const Program* program) {
+	size_t bytes = sizeof(CacheEntry) + keyLength + sizeof(Program)
+			+ program->codeSize * sizeof(Instruction)
+			+ program->constSize * sizeof(double);
+
+	if(bytes > cache->limit) {
+		return NULL;
+	}
+
+	cacheEvict(cache, cache->limit - bytes);
+
+	// Keep the chains short as the cache fills.
+	if(cache->entryCount >= cache->bucketCount) {
+		int bucketCount = 2 * cache->bucketCount;
+		CacheEntry** buckets = calloc(bucketCount, sizeof(CacheEntry*));
+
+		if(buckets == NULL) {
+			fprintf(stderr, "Allocation of cache failed.\n");
+			exit(1);
+		}
+
+		for(CacheEntry* moved = cache->oldest; moved != NULL; moved = moved->newer) {
+			CacheEntry** bucket = &buckets[moved->hash & (bucketCount - 1)];
+
+			moved->chain = *bucket;
+			*bucket = moved;
+		}
+
+		free(cache->buckets);
+		cache->buckets = buckets;
+		cache->bucketCount = bucketCount;
+		++(cache->allocations);
+	}
+
+	CacheEntry* entry = malloc(sizeof(CacheEntry) + keyLength);
+
+	if(entry == NULL) {
+		fprintf(stderr, "Allocation of cache entry failed.\n");
+		exit(1);
+	}
+
+	entry->hash = hash;
+	entry->key = (unsigned char*)(entry + 1);
+	entry->keyLength = keyLength;
+	entry->bytes = bytes;
+	entry->program = programCopy(program);
+	// The entry, and the program with its two buffers.
+	cache->allocations += 4;
+	entry->jit.code = NULL;
+	entry->jit.runs = 0;
+	entry->parallel.plan = NULL;
+	entry->parallel.planned = 0;
+	entry->constant = 0;
+	entry->status = success;
+	entry->result = 0.0;
+	memcpy(entry->key, key, keyLength);
+
+	CacheEntry** bucket = &cache->buckets[hash & (cache->bucketCount - 1)];
+	entry->chain = *bucket;
+	*bucket = entry;
+
+	entry->older = cache->newest;
+	entry->newer = NULL;
+
+	if(cache->newest != NULL) {
+		cache->newest->newer = entry;
+	} else {
+		cache->oldest = entry;
+	}
+
+	cache->newest = entry;
+	cache->bytes += bytes;
+	++(cache->entryCount);
+
+	return entry;
+}
+
+// Charges the most recently used entry for the native code its program has
+// just been compiled to, evicting older entries to stay within the limit.
+// Code that does not fit even alone with its entry is freed, leaving the
+// program interpreted.
+void cacheChargeJit(ProgramCache* cache, CacheEntry* entry) {
+	size_t bytes = sizeof(JitCode) + entry->jit.code->size;
+
+	if(entry->bytes + bytes > cache->limit) {
+		jitFree(entry->jit.code);
+		entry->jit.code = NULL;
+		return;
+	}
+
+	entry->bytes += bytes;
+	cache->bytes += bytes;
+	cacheEvict(cache, cache->limit);
+}
+
+// Takes an entry out of the recency list.
+void cacheUnlink(ProgramCache* cache, CacheEntry* entry) {
+	if(entry->newer != NULL) {
+		entry->newer->older = entry->older;
+	} else {
+		cache->newest = entry->older;
+	}
+
+	if(entry->older != NULL) {
+		entry->older->newer = entry->newer;
+	} else {
+		cache->oldest = entry->newer;
+	}
+}
+
+// Frees least recently used entries until the cache takes at most limit
+// bytes.
+void cacheEvict(ProgramCache* cache, size_t limit) {
+	while(cache->bytes > limit && cache->oldest != NULL) {
+		CacheEntry* entry = cache->oldest;
+		CacheEntry** link = &cache->buckets[entry->hash & (cache->bucketCount - 1)];
+
+		while(*link != entry) {
+			link = &(*link)->chain;
+		}
+
+		*link = entry->chain;
+		cacheUnlink(cache, entry);
+
+		cache->bytes -= entry->bytes;
+		--(cache->entryCount);
+		++(cache->evictions);
+
+		programDestroy(entry->program);
+		jitFree(entry->jit.code);
+		parallelStateReset(&entry->parallel);
+		free(entry);
+	}
+}
+
+void cacheDestroy(ProgramCache* cache) {
+	cacheEvict(cache, 0);
+	free(cache->buckets);
+	free(cache);
+}
+
+#endif
@@ -0,0 +1,6 @@
+// Translation unit of libcalc. The engine is written as header modules;
+// this file gathers them so the library is built from one unit, with only
+// the functions of calc.h left visible.
+
+#include "context.h"
+#include "store.h"
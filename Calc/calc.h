@@ -0,0 +1,151 @@
+#ifndef CALC_H
+#define CALC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "status.h"
+
+// Public interface of libcalc. A context holds everything an evaluation
+// touches, so separate contexts can be used from separate threads without
+// locking. Nothing is printed; failures are reported by status.
+
+#if defined(__GNUC__)
+#define CALC_API __attribute__((visibility("default")))
+#else
+#define CALC_API
+#endif
+
+// Previous answers kept by a context.
+#define CALC_HISTORY    64
+
+// Operations counted by CalcStats, named by calcOpName().
+#define CALC_OPS        17
+
+typedef struct _CalcContext CalcContext;
+
+// An expression compiled once to be run against many variable bindings.
+typedef struct _CalcProgram CalcProgram;
+
+// Compiled expressions mapped from a file, run in place.
+typedef struct _CalcStore CalcStore;
+
+// Counters of a context's program cache.
+typedef struct {
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+	size_t entries;
+	size_t bytes;
+	size_t limit;
+} CalcCacheStats;
+
+// Counters of the work done by a context while its statistics are on.
+typedef struct {
+	// Nanoseconds spent lexing, compiling and evaluating, and how many times
+	// each was done. Compiling covers parsing, optimising and emitting.
+	uint64_t lexTime;
+	uint64_t compileTime;
+	uint64_t evalTime;
+	size_t lexed;
+	size_t compiled;
+	size_t evaluated;
+
+	// Heap allocations by the context's arena, program and cache.
+	size_t allocations;
+
+	// Deepest the operator stack got while parsing, and the evaluation stack
+	// while evaluating.
+	int maxOperatorDepth;
+	int maxEvalDepth;
+
+	// Operations left out of compiled expressions because an equal
+	// subexpression was already computed.
+	size_t eliminated;
+
+	// Operations and functions run, indexed as named by calcOpName().
+	size_t opCounts[CALC_OPS];
+} CalcStats;
+
+// Outcome of an evaluation besides its status.
+typedef struct {
+	double value;
+
+	// The value to every digit asked for by calcSetPrecision(), or NULL when
+	// working in doubles. Owned by the context, and valid until its next
+	// evaluation.
+	const char* text;
+
+	// The expression was blank. Neither value nor ans is set.
+	int empty;
+
+	// The value depends on the previous answer.
+	int usesAns;
+
+	// Operations left out of the compiled expression because an equal
+	// subexpression is evaluated once and reused.
+	int eliminated;
+
+	// Offset and length of the offending token on unknownToken.
+	int errorOffset;
+	int errorLength;
+} CalcResult;
+
+// A range of values, lo to hi inclusive. Empty when both are NaN.
+typedef struct {
+	double lo;
+	double hi;
+} CalcInterval;
+
+CALC_API CalcContext* calcContextCreate(void);
+CALC_API void calcContextDestroy(CalcContext* context);
+CALC_API Status calcEvaluate(CalcContext* context, const char* expression,
+		size_t length, CalcResult* result);
+CALC_API int calcDefineVariable(CalcContext* context, const char* name,
+		double value);
+CALC_API int calcVariableSlot(const CalcContext* context, const char* name);
+CALC_API int calcVariableCount(const CalcContext* context);
+CALC_API void calcSetVariable(CalcContext* context, int slot, double value);
+CALC_API double calcGetVariable(const CalcContext* context, int slot);
+CALC_API Status calcCompile(CalcContext* context, const char* expression,
+		size_t length, CalcProgram** program, CalcResult* result);
+CALC_API Status calcRun(CalcContext* context, CalcProgram* program,
+		const double* slots, double* result);
+CALC_API Status calcDerivative(CalcContext* context,
+		const CalcProgram* program, const double* slots,
+		const double* direction, double* value, double* derivative);
+CALC_API Status calcGradient(CalcContext* context, const CalcProgram* program,
+		const double* slots, double* value, double* gradient);
+CALC_API Status calcBound(CalcContext* context, const CalcProgram* program,
+		const CalcInterval* slots, CalcInterval* result);
+CALC_API Status calcRunBatch(const CalcProgram* program,
+		const double* const* columns, size_t count, double* results,
+		Status* rowStatus);
+CALC_API void calcProgramDestroy(CalcProgram* program);
+CALC_API int calcStoreWrite(CalcContext* context, const char* path,
+		const char* const* expressions, const size_t* lengths, size_t count,
+		size_t* failed);
+CALC_API int calcStoreOpen(CalcContext* context, const char* path,
+		CalcStore** store);
+CALC_API size_t calcStoreSize(const CalcStore* store);
+CALC_API long calcStoreFind(const CalcStore* store, const char* expression,
+		size_t length);
+CALC_API Status calcStoreGet(CalcStore* store, size_t index,
+		CalcProgram** program, const char** expression, CalcResult* result);
+CALC_API void calcStoreClose(CalcStore* store);
+CALC_API void calcSetJitThreshold(CalcContext* context, unsigned threshold);
+CALC_API void calcSetThreads(CalcContext* context, int count);
+CALC_API double calcGetAns(const CalcContext* context);
+CALC_API void calcSetAns(CalcContext* context, double value);
+CALC_API void calcSetPrecision(CalcContext* context, int digits);
+CALC_API int calcHistory(const CalcContext* context, int back, double* value);
+CALC_API void calcSetCacheLimit(CalcContext* context, size_t limit);
+CALC_API void calcGetCacheStats(const CalcContext* context,
+		CalcCacheStats* stats);
+CALC_API void calcEnableStats(CalcContext* context, int enabled);
+CALC_API void calcGetStats(const CalcContext* context, CalcStats* stats);
+CALC_API void calcResetStats(CalcContext* context);
+CALC_API const char* calcOpName(int op);
+CALC_API const char* calcStatusMessage(Status status);
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <stdio.h>
+#include <math.h>
+
+#include "program.h"
+#include "names.h"
+
+int programEmitC(const Program* program, const NameTable* names,
+		const char* source, FILE* out);
+void emitCConstant(double value, FILE* out);
+void emitCPowi(int slot, int exponent, FILE* out);
+
+
+// Function definitions:
+
+// Writes a program as a standalone C function, double f(const double* vars),
+// taking variables by slot. The code is generated from the compiled program
+// rather than the text, so it parses, folds and orders operations exactly as
+// the interpreter does, one statement per instruction with stack slot i held
+// in s<i>. A division by zero returns NAN, as a failed row does in --map.
+// Returns 0 on success, -1 if the output could not be written.
+int programEmitC(const Program* program, const NameTable* names,
+		const char* source, FILE* out) {
+	fprintf(out, "/*\n * Generated by calculator --emit-c from: %s\n *\n",
+			source);
+
+	// Name the variables read, in slot order.
+	for(int slot = 0; slot < names->size; ++slot) {
+		for(int i = 0; i < names->capacity && programUsesSlot(program, slot); ++i) {
+			const NameEntry* entry = &names->entries[i];
+
+			if(entry->name != NULL && entry->kind == variableName
+					&& entry->code == slot) {
+				fprintf(out, " * vars[%d] is %s.\n", slot, entry->name);
+			}
+		}
+	}
+
+	fprintf(out, " *\n * Compile with -ffp-contract=off to give the same results as"
+			" the\n * calculator bit for bit.\n */\n\n"
+			"#include <math.h>\n\n"
+			"double f(const double* vars) {\n");
+
+	for(int i = 0; i < program->maxDepth; ++i) {
+		fprintf(out, "%ss%d", (i == 0) ? "\tdouble " : ", ", i);
+	}
+
+	fprintf(out, ";\n");
+
+	for(int i = 0; i < program->tempCount; ++i) {
+		fprintf(out, "%st%d", (i == 0) ? "\tdouble " : ", ", i);
+	}
+
+	fprintf(out, "%s\n", (program->tempCount > 0) ? ";\n" : "");
+
+	if(programIsConstant(program)) {
+		fprintf(out, "\t(void)vars;\n");
+	}
+
+	int top = -1;
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+		int arg = instruction->arg;
+
+		switch(instruction->op) {
+			case opConst:
+				fprintf(out, "\ts%d = ", ++top);
+				emitCConstant(program->constants[arg], out);
+				fprintf(out, ";\n");
+				break;
+			case opVar:
+				fprintf(out, "\ts%d = vars[%d];\n", ++top, arg);
+				break;
+			case opLoad:
+				fprintf(out, "\ts%d = t%d;\n", ++top, arg);
+				break;
+			case opStore:
+				fprintf(out, "\tt%d = s%d;\n", arg, top);
+				break;
+			case opNeg:
+				fprintf(out, "\ts%d = -s%d;\n", top, top);
+				break;
+			case opSqrt:
+				fprintf(out, "\ts%d = sqrt(s%d);\n", top, top);
+				break;
+			case opSin:
+				fprintf(out, "\ts%d = sin(s%d);\n", top, top);
+				break;
+			case opCos:
+				fprintf(out, "\ts%d = cos(s%d);\n", top, top);
+				break;
+			case opTan:
+				fprintf(out, "\ts%d = tan(s%d);\n", top, top);
+				break;
+			case opExp:
+				fprintf(out, "\ts%d = exp(s%d);\n", top, top);
+				break;
+			case opLog:
+				fprintf(out, "\ts%d = log(s%d);\n", top, top);
+				break;
+			case opPowi:
+				emitCPowi(top, arg, out);
+				break;
+			case opPow:
+				fprintf(out, "\ts%d = pow(s%d, s%d);\n", top - 1, top - 1, top);
+				--top;
+				break;
+			case opDiv:
+				fprintf(out, "\n\tif(s%d == 0) {\n\t\treturn NAN;\n\t}\n\n", top);
+				// Fall through.
+			default:
+				fprintf(out, "\ts%d = s%d %c s%d;\n", top - 1, top - 1,
+						"+-*/"[instruction->op - opAdd], top);
+				--top;
+				break;
+		}
+	}
+
+	fprintf(out, "\n\treturn s0;\n}\n");
+	return ferror(out) ? -1 : 0;
+}
+
+// Writes a constant so it reads back as exactly the same double.
+void emitCConstant(double value, FILE* out) {
+	if(isnan(value)) {
+		fprintf(out, "NAN");
+	} else if(isinf(value)) {
+		fprintf(out, (value < 0) ? "-INFINITY" : "INFINITY");
+	} else {
+		fprintf(out, "%a", value);
+	}
+}
+
+// Writes the multiplications of applyPowi() for one exponent, in the same
+// order, raising stack slot s<slot> in place.
+void emitCPowi(int slot, int exponent, FILE* out) {
+	unsigned power = (exponent < 0) ? -(unsigned)exponent : (unsigned)exponent;
+
+	if(power == 0) {
+		fprintf(out, "\ts%d = 1.0;\n", slot);
+		return;
+	}
+
+	fprintf(out, "\n\t{\n\t\tdouble base = s%d, result = 1.0;\n\n", slot);
+
+	while(power > 0) {
+		if(power & 1) {
+			fprintf(out, "\t\tresult *= base;\n");
+		}
+
+		power >>= 1;
+
+		if(power > 0) {
+			fprintf(out, "\t\tbase *= base;\n");
+		}
+	}
+
+	fprintf(out, "\t\ts%d = %sresult;\n\t}\n\n", slot,
+			(exponent < 0) ? "1.0 / " : "");
+}
+
+#endif
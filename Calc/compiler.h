@@ -0,0 +1,275 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdlib.h>
+
+#include "status.h"
+#include "program.h"
+#include "lexer.h"
+#include "names.h"
+#include "tree.h"
+#include "optimise.h"
+#include "cse.h"
+#include "../Memory/arena.h"
+#include "../Lists/Stacks/arraystack.h"
+
+// Initial capacity of the operator stack.
+#define OPSTACK_SIZE    8
+
+// Marks a left bracket on the operator stack, next to the operator codes.
+#define LBRACKET_CODE   0xff
+
+typedef enum {
+	left,
+	right
+} AssocType;
+
+Status compileExpression(const char* input, size_t length,
+		const NameTable* names, Program* program, Arena* arena,
+		TokenArray* tokenArray);
+Status compileTokens(const TokenArray* tokenArray, Program* program,
+		Arena* arena);
+Status shuntingYard(const TokenArray* tokenArray, Arena* arena, Node** root,
+		int* operatorDepth);
+int getPriority(OpCode operator1, OpCode operator2);
+AssocType getAssoc(OpCode operator);
+
+
+// Function definitions:
+
+// Compiles an infix expression of the given length into a postfix program.
+// Nothing is printed, so the tokens are handed back for the caller to report
+// where lexing failed.
+// Returns the status of the compilation.
+Status compileExpression(const char* input, size_t length,
+		const NameTable* names, Program* program, Arena* arena,
+		TokenArray* tokenArray) {
+	Status status = lexExpression(input, length, names, arena, tokenArray);
+
+	programReset(program);
+
+	if(status != success) {
+		return status;
+	}
+
+	return compileTokens(tokenArray, program, arena);
+}
+
+// Parses the tokens into a tree, optimises it, shares its repeated
+// subexpressions and emits it as a postfix program.
+// Returns the status of the compilation.
+Status compileTokens(const TokenArray* tokenArray, Program* program,
+		Arena* arena) {
+	Node* root;
+	int operatorDepth;
+	Status status = shuntingYard(tokenArray, arena, &root, &operatorDepth);
+
+	programReset(program);
+	program->operatorDepth = operatorDepth;
+
+	if(status == success && root != NULL) {
+		optimiseTree(root, arena);
+		program->cseEliminated = eliminateCommon(root, arena);
+		treeEmit(root, program, arena);
+	}
+
+	return status;
+}
+
+// Implements the shunting yard algorithm to convert the tokens into an
+// expression tree. Where the classic algorithm outputs an operator, a node
+// is made of it and its operands from the node stack. Both stacks live in
+// the arena, as does the tree.
+// root is NULL for an empty expression, and operatorDepth is set to the
+// deepest the operator stack got.
+// Returns the status of the conversion.
+Status shuntingYard(const TokenArray* tokenArray, Arena* arena, Node** root,
+		int* operatorDepth) {
+	OpStack opStack;
+	NodeStack nodes;
+	Status status = success;
+	int exprPos, expectOperand = 1;
+
+	opStackInit(&opStack, arena, OPSTACK_SIZE);
+	nodeStackInit(&nodes, arena, OPSTACK_SIZE);
+	*root = NULL;
+	*operatorDepth = 0;
+
+	for(exprPos = 0; exprPos < tokenArray->size && status == success; ++exprPos) {
+		const Token* token = &tokenArray->tokens[exprPos];
+
+		switch(token->kind) {
+			case number:
+			case constant:
+				nodeStackPush(&nodes, nodeCreate(arena, opConst, 0, token->value));
+				expectOperand = 0;
+				break;
+
+			case variable:
+				nodeStackPush(&nodes, nodeCreate(arena, opVar, token->code, 0));
+				expectOperand = 0;
+				break;
+
+			case operator:
+				// An operator with no left operand is a sign. Plus is
+				// assumed, minus becomes a negation, and any other is an
+				// error.
+				if(expectOperand) {
+					if(token->code == opSub) {
+						opStackPush(&opStack, opNeg);
+					} else if(token->code != opAdd) {
+						status = evalFail;
+					}
+
+					break;
+				}
+
+				// While there is an operator on the opStack with greater
+				// precedence, or equal precedence and left associativity.
+				while(getArrayStackSize(&opStack) > 0
+						&& opStackPeek(&opStack) != LBRACKET_CODE) {
+					int priority = getPriority(token->code, opStackPeek(&opStack));
+
+					if(priority > 0
+							|| (priority == 0 && getAssoc(token->code) == right)) {
+						break;
+					}
+
+					if(treePush(&nodes, arena, opStackPop(&opStack), 0, 0) != 0) {
+						status = evalFail;
+						break;
+					}
+				}
+
+				opStackPush(&opStack, token->code);
+				expectOperand = 1;
+				break;
+
+			case lbracket:
+				opStackPush(&opStack, LBRACKET_CODE);
+				expectOperand = 1;
+				break;
+
+			case function:
+				opStackPush(&opStack, token->code);
+				expectOperand = 1;
+				break;
+
+			case rbracket: {
+				int code = -1;
+
+				while(getArrayStackSize(&opStack) > 0) {
+					code = opStackPop(&opStack);
+
+					if(code == LBRACKET_CODE) {
+						break;
+					}
+
+					if(treePush(&nodes, arena, code, 0, 0) != 0) {
+						status = evalFail;
+						break;
+					}
+				}
+
+				if(code != LBRACKET_CODE) {
+					status = evalFail;
+				}
+
+				expectOperand = 0;
+				break;
+			}
+
+			default:
+				status = evalFail;
+				break;
+		}
+
+		// A token pushes at most one operator, after any it pops.
+		if(getArrayStackSize(&opStack) > *operatorDepth) {
+			*operatorDepth = getArrayStackSize(&opStack);
+		}
+	}
+
+	while(getArrayStackSize(&opStack) > 0 && status == success) {
+		int code = opStackPop(&opStack);
+
+		if(code == LBRACKET_CODE) {
+			status = unpairedBracket;
+		} else if(treePush(&nodes, arena, code, 0, 0) != 0) {
+			status = evalFail;
+		}
+	}
+
+	// A well formed expression leaves exactly one tree on the stack.
+	if(status == success && exprPos != 0) {
+		if(getArrayStackSize(&nodes) != 1) {
+			status = evalFail;
+		} else {
+			*root = nodeStackPop(&nodes);
+		}
+	}
+
+	return status;
+}
+
+// Get the priority of operator1 relative to operator2.
+// A negation binds tighter than the other operators except the power, and a
+// function binds tightest of all.
+int getPriority(OpCode operator1, OpCode operator2) {
+	int priority1, priority2;
+
+	switch(operator1) {
+		case opAdd:
+		case opSub:
+			priority1 = 1;
+			break;
+		case opMul:
+		case opDiv:
+			priority1 = 2;
+			break;
+		case opNeg:
+			priority1 = 3;
+			break;
+		case opPow:
+			priority1 = 4;
+			break;
+		default:
+			priority1 = 5;
+			break;
+	}
+
+	switch(operator2) {
+		case opAdd:
+		case opSub:
+			priority2 = 1;
+			break;
+		case opMul:
+		case opDiv:
+			priority2 = 2;
+			break;
+		case opNeg:
+			priority2 = 3;
+			break;
+		case opPow:
+			priority2 = 4;
+			break;
+		default:
+			priority2 = 5;
+			break;
+	}
+
+	return priority1 - priority2;
+}
+
+// Returns the associativity of a given operator.
+AssocType getAssoc(OpCode operator) {
+	switch(operator) {
+		case opPow:
+		case opNeg:
+			return right;
+		default:
+			return left;
+	}
+}
+
+#endif
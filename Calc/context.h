@@ -0,0 +1,913 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calc.h"
+#include "status.h"
+#include "program.h"
+#include "names.h"
+#include "lexer.h"
+#include "compiler.h"
+#include "cache.h"
+#include "batch.h"
+#include "jit.h"
+#include "stats.h"
+#include "numeric.h"
+#include "parallel.h"
+#include "gradient.h"
+#include "interval.h"
+#include "../Memory/arena.h"
+
+// Initial size of a context's scratch arena chunks.
+#define CONTEXT_ARENA   4096
+
+struct _CalcContext {
+	NameTable* names;
+	Program* program;
+
+	// Compiled programs by token stream, or NULL when caching is off.
+	ProgramCache* cache;
+
+	// Evaluations of a cached or compiled program before it is compiled to
+	// native code, or 0 never to.
+	unsigned jitThreshold;
+
+	// Threads sharing the evaluation of a costly program, or NULL to
+	// evaluate on the calling thread alone.
+	ParallelPool* pool;
+
+	// Significant digits calcEvaluate() works to on the arbitrary precision
+	// backend, or 0 to work in doubles. Results are also written as text,
+	// and ans kept as text to every digit the backend holds, or NULL once a
+	// double answer replaces it.
+	int precision;
+	char* text;
+	size_t textCapacity;
+	char* preciseAns;
+
+	// Counters, only kept while statsEnabled is set, and the allocations
+	// made before they were last reset.
+	int statsEnabled;
+	CalcStats stats;
+	size_t allocationBase;
+
+	// Scratch memory for one evaluation, reset rather than freed after it.
+	Arena* arena;
+
+	// Variable binding, indexed by slot. ans is in ANS_SLOT, and named
+	// variables follow in the order they were defined.
+	double* vars;
+	int varCount;
+	int varCapacity;
+
+	// Ring of previous answers. historyEnd is where the next one goes.
+	double history[CALC_HISTORY];
+	int historySize;
+	int historyEnd;
+};
+
+struct _CalcProgram {
+	Program* program;
+	JitState jit;
+	ParallelState parallel;
+};
+
+int splitAssignment(const char* expression, size_t length, size_t* nameStart,
+		size_t* nameLength, size_t* valueStart);
+int contextDefine(CalcContext* context, const char* name, size_t length,
+		double value);
+void contextSyncVariables(CalcContext* context, const CalcContext* source);
+size_t contextAllocations(const CalcContext* context);
+void contextCountCompile(CalcContext* context, const Program* program,
+		uint64_t* clock);
+void contextCountEval(CalcContext* context, const Program* program,
+		uint64_t* clock);
+Status contextRun(CalcContext* context, const Program* program,
+		JitState* jit, ParallelState* parallel, const double* vars,
+		double* result);
+Status contextCompile(CalcContext* context, const char* expression,
+		size_t length, CalcResult* result);
+Status contextEvaluatePrecise(CalcContext* context,
+		const TokenArray* tokenArray, CalcResult* result, uint64_t* clock);
+size_t contextFormat(Numeric* numeric, const void* value, int digits,
+		char** text, size_t* capacity);
+
+
+// Function definitions:
+
+CalcContext* calcContextCreate(void) {
+	CalcContext* context = malloc(sizeof(CalcContext));
+
+	if(context == NULL) {
+		fprintf(stderr, "Allocation of context failed.\n");
+		exit(1);
+	}
+
+	context->names = nameTableCreate();
+	context->program = programCreate();
+	context->cache = NULL;
+	context->jitThreshold = JIT_THRESHOLD;
+	context->pool = NULL;
+	context->precision = 0;
+	context->text = NULL;
+	context->textCapacity = 0;
+	context->preciseAns = NULL;
+	context->statsEnabled = 0;
+	context->arena = arenaCreate(CONTEXT_ARENA);
+	context->varCount = ANS_SLOT + 1;
+	context->varCapacity = 8;
+	context->vars = calloc(context->varCapacity, sizeof(double));
+	context->historySize = 0;
+	context->historyEnd = 0;
+
+	if(context->vars == NULL) {
+		fprintf(stderr, "Allocation of context failed.\n");
+		exit(1);
+	}
+
+	calcResetStats(context);
+
+	return context;
+}
+
+void calcContextDestroy(CalcContext* context) {
+	nameTableDestroy(context->names);
+	programDestroy(context->program);
+	arenaDestroy(context->arena);
+
+	if(context->cache != NULL) {
+		cacheDestroy(context->cache);
+	}
+
+	if(context->pool != NULL) {
+		parallelPoolDestroy(context->pool);
+	}
+
+	free(context->vars);
+	free(context->text);
+	free(context->preciseAns);
+	free(context);
+}
+
+// Compiles and evaluates length bytes of expression, stopping early at a
+// newline. "name = expression" assigns the value to a variable, defining it
+// if new. With the cache on, a repeated expression skips compilation, and
+// one reading no variables skips evaluation too. With a precision set the
+// expression is evaluated on the arbitrary precision backend instead, and
+// the result also given as text. A successful evaluation becomes the new
+// answer.
+// Returns the status of the evaluation.
+Status calcEvaluate(CalcContext* context, const char* expression,
+		size_t length, CalcResult* result) {
+	TokenArray tokenArray;
+	const Program* program = context->program;
+	CacheEntry* entry = NULL;
+	size_t nameStart = 0, nameLength = 0, valueStart = 0;
+	int assignment = splitAssignment(expression, length, &nameStart,
+			&nameLength, &valueStart);
+	const char* name = expression + nameStart;
+	uint64_t clock = context->statsEnabled ? statsNow() : 0;
+	Status status;
+
+	result->value = 0.0;
+	result->text = NULL;
+	result->usesAns = 0;
+	result->eliminated = 0;
+
+	if(assignment) {
+		const NameEntry* named = nameTableFind(context->names, name, nameLength);
+
+		// Only variables can be assigned, and ans only by evaluating.
+		if(named != NULL && (named->kind != variableName
+				|| named->code == ANS_SLOT)) {
+			result->empty = 0;
+			result->errorOffset = nameStart;
+			result->errorLength = nameLength;
+			return invalidAssignment;
+		}
+	}
+
+	// The name is not lexed, as the assignment may be defining it.
+	status = lexExpression(expression + valueStart, length - valueStart,
+			context->names, context->arena, &tokenArray);
+
+	if(context->statsEnabled) {
+		context->stats.lexTime += statsLap(&clock);
+		++(context->stats.lexed);
+	}
+
+	result->errorOffset = (tokenArray.errorOffset >= 0)
+			? tokenArray.errorOffset + (int)valueStart : -1;
+	result->errorLength = tokenArray.errorLength;
+	result->empty = (status == success && tokenArray.size == 0);
+
+	// An assignment needs a value.
+	if(assignment && result->empty) {
+		result->empty = 0;
+		status = evalFail;
+	}
+
+	if(status == success && !result->empty && context->precision > 0) {
+		status = contextEvaluatePrecise(context, &tokenArray, result, &clock);
+	} else if(status == success && !result->empty) {
+		size_t keyLength = 0;
+		unsigned char* key = NULL;
+		uint64_t hash = 0;
+
+		if(context->cache != NULL) {
+			key = cacheKey(&tokenArray, context->arena, &keyLength);
+			hash = cacheHash(key, keyLength);
+			entry = cacheFind(context->cache, key, keyLength, hash);
+		}
+
+		if(entry == NULL) {
+			status = compileTokens(&tokenArray, context->program, context->arena);
+
+			if(context->statsEnabled) {
+				contextCountCompile(context, context->program, &clock);
+			}
+
+			// Only programs that compiled are kept.
+			if(status == success && context->cache != NULL) {
+				entry = cacheInsert(context->cache, key, keyLength, hash,
+						context->program);
+			}
+		}
+
+		if(entry != NULL) {
+			program = entry->program;
+		}
+	}
+
+	if(status == success && !result->empty && context->precision == 0) {
+		result->usesAns = programUsesSlot(program, ANS_SLOT);
+		result->eliminated = program->cseEliminated;
+
+		if(entry != NULL && entry->constant) {
+			status = entry->status;
+			result->value = entry->result;
+		} else {
+			int native = (entry != NULL && entry->jit.code != NULL);
+
+			status = contextRun(context, program,
+					(entry != NULL) ? &entry->jit : NULL,
+					(entry != NULL) ? &entry->parallel : NULL, context->vars,
+					&result->value);
+
+			if(entry != NULL && !native && entry->jit.code != NULL) {
+				cacheChargeJit(context->cache, entry);
+			}
+
+			if(entry != NULL && programIsConstant(program)) {
+				entry->constant = 1;
+				entry->status = status;
+				entry->result = result->value;
+			}
+
+			if(context->statsEnabled) {
+				contextCountEval(context, program, &clock);
+			}
+		}
+	}
+
+	arenaReset(context->arena);
+
+	if(status == success && !result->empty) {
+		if(assignment) {
+			contextDefine(context, name, nameLength, result->value);
+		}
+
+		if(result->text == NULL) {
+			free(context->preciseAns);
+			context->preciseAns = NULL;
+		}
+
+		context->vars[ANS_SLOT] = result->value;
+		context->history[context->historyEnd] = result->value;
+		context->historyEnd = (context->historyEnd + 1) % CALC_HISTORY;
+
+		if(context->historySize < CALC_HISTORY) {
+			++(context->historySize);
+		}
+	}
+
+	return status;
+}
+
+// Recognises "name = expression", with optional whitespace around the
+// name. A lone "=" cannot start a valid expression, so nothing else is
+// mistaken for an assignment.
+// Returns 1 with the offsets of the name and the expression for an
+// assignment, 0 otherwise.
+int splitAssignment(const char* expression, size_t length, size_t* nameStart,
+		size_t* nameLength, size_t* valueStart) {
+	size_t i = 0;
+
+	while(i < length && charType(expression[i]) == whitespace) {
+		++i;
+	}
+
+	if(i == length || !isIdentifierStart(expression[i])) {
+		return 0;
+	}
+
+	*nameStart = i;
+
+	while(i < length && isIdentifierChar(expression[i])) {
+		++i;
+	}
+
+	*nameLength = i - *nameStart;
+
+	while(i < length && charType(expression[i]) == whitespace) {
+		++i;
+	}
+
+	if(i == length || expression[i] != '=') {
+		return 0;
+	}
+
+	*valueStart = i + 1;
+	return 1;
+}
+
+// Sets a variable, giving it the next free slot if it is new. The caller
+// makes sure the name is not a constant or function.
+// Returns the slot.
+int contextDefine(CalcContext* context, const char* name, size_t length,
+		double value) {
+	const NameEntry* entry = nameTableFind(context->names, name, length);
+	int slot;
+
+	if(entry != NULL) {
+		slot = entry->code;
+	} else {
+		if(context->varCount == context->varCapacity) {
+			context->varCapacity *= 2;
+			context->vars = realloc(context->vars,
+					context->varCapacity * sizeof(double));
+
+			if(context->vars == NULL) {
+				fprintf(stderr, "Allocation of variables failed.\n");
+				exit(1);
+			}
+		}
+
+		slot = (context->varCount)++;
+		nameTableAdd(context->names, name, length, variableName, slot, 0);
+	}
+
+	context->vars[slot] = value;
+	return slot;
+}
+
+// Gives a context the variables of another, in the same slots. The context
+// must not have defined a variable the source does not have.
+void contextSyncVariables(CalcContext* context, const CalcContext* source) {
+	const NameTable* names = source->names;
+
+	for(int i = 0; i < names->capacity; ++i) {
+		const NameEntry* entry = &names->entries[i];
+
+		if(entry->name != NULL && entry->kind == variableName
+				&& nameTableFind(context->names, entry->name, entry->length) == NULL) {
+			while(context->varCapacity < entry->code + 1) {
+				context->varCapacity *= 2;
+				context->vars = realloc(context->vars,
+						context->varCapacity * sizeof(double));
+
+				if(context->vars == NULL) {
+					fprintf(stderr, "Allocation of variables failed.\n");
+					exit(1);
+				}
+			}
+
+			nameTableAdd(context->names, entry->name, entry->length,
+					variableName, entry->code, 0);
+		}
+	}
+
+	context->varCount = source->varCount;
+	memcpy(context->vars, source->vars, source->varCount * sizeof(double));
+}
+
+// Returns the heap allocations made by the context's arena, program and
+// cache so far.
+size_t contextAllocations(const CalcContext* context) {
+	return context->arena->allocations + context->program->allocations
+			+ ((context->cache != NULL) ? context->cache->allocations : 0);
+}
+
+// Counts a compilation finishing now.
+void contextCountCompile(CalcContext* context, const Program* program,
+		uint64_t* clock) {
+	context->stats.compileTime += statsLap(clock);
+	++(context->stats.compiled);
+	context->stats.eliminated += program->cseEliminated;
+
+	if(program->operatorDepth > context->stats.maxOperatorDepth) {
+		context->stats.maxOperatorDepth = program->operatorDepth;
+	}
+}
+
+// Counts an evaluation of a program finishing now.
+void contextCountEval(CalcContext* context, const Program* program,
+		uint64_t* clock) {
+	context->stats.evalTime += statsLap(clock);
+	++(context->stats.evaluated);
+	statsCountProgram(&context->stats, program);
+}
+
+// Evaluates a program, across the context's threads if it is costly enough
+// to be worth splitting, and otherwise as native code once run often enough
+// if it has a JitState, or by the interpreter. All give the same result.
+// A program with a ParallelState is planned once, and one without each time.
+// Returns the status of the evaluation.
+Status contextRun(CalcContext* context, const Program* program,
+		JitState* jit, ParallelState* parallel, const double* vars,
+		double* result) {
+	if(context->pool != NULL && parallel != NULL) {
+		const ParallelPlan* plan = parallelStatePlan(parallel, program,
+				context->arena);
+
+		if(plan != NULL) {
+			return parallelEval(context->pool, program, plan, vars,
+					context->arena, result);
+		}
+	} else if(context->pool != NULL) {
+		ParallelPlan* plan = parallelPlan(program, context->arena);
+
+		if(plan != NULL) {
+			Status status = parallelEval(context->pool, program, plan, vars,
+					context->arena, result);
+
+			parallelPlanDestroy(plan);
+			return status;
+		}
+	}
+
+	return (jit != NULL)
+			? jitEval(program, jit, context->jitThreshold, vars, context->arena,
+					result)
+			: programEval(program, vars, context->arena, result);
+}
+
+// Parses the tokens into a tree and evaluates it on the arbitrary precision
+// backend, reading ans at full precision if the last answer was precise.
+// Variables other than ans are doubles. The result is written to
+// context->text to the digits asked for, and kept as the precise answer to
+// every digit held.
+// Returns the status of the evaluation.
+Status contextEvaluatePrecise(CalcContext* context,
+		const TokenArray* tokenArray, CalcResult* result, uint64_t* clock) {
+	Numeric numeric;
+	BigNum ans, value;
+	Node* root;
+	int operatorDepth;
+	Status status = shuntingYard(tokenArray, context->arena, &root,
+			&operatorDepth);
+
+	if(context->statsEnabled) {
+		context->stats.compileTime += statsLap(clock);
+		++(context->stats.compiled);
+
+		if(operatorDepth > context->stats.maxOperatorDepth) {
+			context->stats.maxOperatorDepth = operatorDepth;
+		}
+	}
+
+	if(status != success) {
+		return status;
+	}
+
+	for(int i = 0; i < tokenArray->size; ++i) {
+		if(tokenArray->tokens[i].kind == variable
+				&& tokenArray->tokens[i].code == ANS_SLOT) {
+			result->usesAns = 1;
+		}
+	}
+
+	numericInit(&numeric, &bigNumeric, context->arena, context->precision);
+
+	int haveAns = (context->preciseAns != NULL && numeric.type->fromText(
+			&numeric, &ans, context->preciseAns, strlen(context->preciseAns))
+			== success);
+
+	status = numericEval(&numeric, tokenArray, root, context->vars,
+			haveAns ? &ans : NULL, &value);
+
+	if(status == success) {
+		size_t capacity = 0;
+
+		result->value = numeric.type->toDouble(&numeric, &value);
+		contextFormat(&numeric, &value, context->precision, &context->text,
+				&context->textCapacity);
+		result->text = context->text;
+
+		free(context->preciseAns);
+		context->preciseAns = NULL;
+		contextFormat(&numeric, &value,
+				numeric.type->workingDigits(&numeric),
+				&context->preciseAns, &capacity);
+	}
+
+	if(context->statsEnabled) {
+		context->stats.evalTime += statsLap(clock);
+		++(context->stats.evaluated);
+	}
+
+	return status;
+}
+
+// Formats a value into a heap buffer, growing it to fit.
+// Returns the length of the text.
+size_t contextFormat(Numeric* numeric, const void* value, int digits,
+		char** text, size_t* capacity) {
+	size_t length = numeric->type->format(numeric, value, digits, *text,
+			*capacity);
+
+	if(length >= *capacity) {
+		*capacity = length + 1;
+		*text = realloc(*text, *capacity);
+
+		if(*text == NULL) {
+			fprintf(stderr, "Allocation of result text failed.\n");
+			exit(1);
+		}
+
+		numeric->type->format(numeric, value, digits, *text, *capacity);
+	}
+
+	return length;
+}
+
+// Defines a variable, or sets it if already defined.
+// Returns its slot, or -1 if the name is not an identifier or names a
+// constant, a function or ans.
+int calcDefineVariable(CalcContext* context, const char* name, double value) {
+	size_t length = strlen(name);
+	const NameEntry* entry = nameTableFind(context->names, name, length);
+
+	if(length == 0 || !isIdentifierStart(name[0])) {
+		return -1;
+	}
+
+	for(size_t i = 1; i < length; ++i) {
+		if(!isIdentifierChar(name[i])) {
+			return -1;
+		}
+	}
+
+	if(entry != NULL && (entry->kind != variableName || entry->code == ANS_SLOT)) {
+		return -1;
+	}
+
+	return contextDefine(context, name, length, value);
+}
+
+// Returns the slot of a variable, ans included, or -1 if the name is not a
+// variable.
+int calcVariableSlot(const CalcContext* context, const char* name) {
+	const NameEntry* entry = nameTableFind(context->names, name, strlen(name));
+
+	return (entry != NULL && entry->kind == variableName) ? entry->code : -1;
+}
+
+// Returns the number of slots, which a binding passed to calcRun() or
+// calcRunBatch() must cover.
+int calcVariableCount(const CalcContext* context) {
+	return context->varCount;
+}
+
+void calcSetVariable(CalcContext* context, int slot, double value) {
+	context->vars[slot] = value;
+}
+
+double calcGetVariable(const CalcContext* context, int slot) {
+	return context->vars[slot];
+}
+
+// Compiles an expression for calcRun() and calcRunBatch(). Variables are
+// resolved to slots now, so defining more later does not affect it.
+// Returns the status of the compilation, with *program NULL on failure.
+Status calcCompile(CalcContext* context, const char* expression,
+		size_t length, CalcProgram** program, CalcResult* result) {
+	Status status = contextCompile(context, expression, length, result);
+
+	*program = NULL;
+
+	if(status == success) {
+		*program = malloc(sizeof(CalcProgram));
+
+		if(*program == NULL) {
+			fprintf(stderr, "Allocation of program failed.\n");
+			exit(1);
+		}
+
+		(*program)->program = programCopy(context->program);
+		(*program)->jit.code = NULL;
+		(*program)->jit.runs = 0;
+		(*program)->parallel.plan = NULL;
+		(*program)->parallel.planned = 0;
+	}
+
+	return status;
+}
+
+// Compiles an expression into context->program, filling in result as
+// calcCompile() does. A blank expression fails.
+// Returns the status of the compilation.
+Status contextCompile(CalcContext* context, const char* expression,
+		size_t length, CalcResult* result) {
+	TokenArray tokenArray;
+	uint64_t clock = context->statsEnabled ? statsNow() : 0;
+	Status status = lexExpression(expression, length, context->names,
+			context->arena, &tokenArray);
+
+	if(context->statsEnabled) {
+		context->stats.lexTime += statsLap(&clock);
+		++(context->stats.lexed);
+	}
+
+	programReset(context->program);
+
+	if(status == success) {
+		status = compileTokens(&tokenArray, context->program, context->arena);
+
+		if(context->statsEnabled) {
+			contextCountCompile(context, context->program, &clock);
+		}
+	}
+
+	arenaReset(context->arena);
+
+	result->value = 0.0;
+	result->text = NULL;
+	result->errorOffset = tokenArray.errorOffset;
+	result->errorLength = tokenArray.errorLength;
+	result->empty = (status == success && isProgramEmpty(context->program));
+	result->usesAns = (status == success
+			&& programUsesSlot(context->program, ANS_SLOT));
+	result->eliminated = context->program->cseEliminated;
+
+	if(status == success && result->empty) {
+		status = evalFail;
+	}
+
+	return status;
+}
+
+// Runs a compiled program against slots, a value for every slot, or the
+// context's own variables if slots is NULL. Only the arithmetic is done;
+// ans is left alone. A program run often enough is compiled to native code,
+// so it must not be run by two threads at once.
+// Returns the status of the evaluation.
+Status calcRun(CalcContext* context, CalcProgram* program,
+		const double* slots, double* result) {
+	uint64_t clock = context->statsEnabled ? statsNow() : 0;
+	Status status = contextRun(context, program->program, &program->jit,
+			&program->parallel, (slots != NULL) ? slots : context->vars,
+			result);
+
+	if(context->statsEnabled) {
+		contextCountEval(context, program->program, &clock);
+	}
+
+	arenaReset(context->arena);
+	return status;
+}
+
+// Runs a compiled program against slots, or the context's variables if
+// slots is NULL, as calcRun() does, and its derivative along direction, a
+// tangent for every slot, by forward differentiation.
+// Returns the status of the evaluation.
+Status calcDerivative(CalcContext* context, const CalcProgram* program,
+		const double* slots, const double* direction, double* value,
+		double* derivative) {
+	uint64_t clock = context->statsEnabled ? statsNow() : 0;
+	Dual result;
+	Status status = dualEval(program->program,
+			(slots != NULL) ? slots : context->vars, direction, context->arena,
+			&result);
+
+	if(status == success) {
+		*value = result.value;
+		*derivative = result.tangent;
+	}
+
+	if(context->statsEnabled) {
+		contextCountEval(context, program->program, &clock);
+	}
+
+	arenaReset(context->arena);
+	return status;
+}
+
+// Runs a compiled program against slots, or the context's variables if
+// slots is NULL, and fills gradient with its partial derivative by every
+// slot, calcVariableCount() of them, in one reverse differentiation.
+// Returns the status of the evaluation.
+Status calcGradient(CalcContext* context, const CalcProgram* program,
+		const double* slots, double* value, double* gradient) {
+	uint64_t clock = context->statsEnabled ? statsNow() : 0;
+	Status status = gradientEval(program->program,
+			(slots != NULL) ? slots : context->vars, calcVariableCount(context),
+			context->arena, value, gradient);
+
+	if(context->statsEnabled) {
+		contextCountEval(context, program->program, &clock);
+	}
+
+	arenaReset(context->arena);
+	return status;
+}
+
+// Bounds a compiled program over slots, a range for every slot, or the
+// context's variables as single points if slots is NULL. result holds every
+// value the program takes over them, rounded outward.
+// Returns the status of the evaluation, divZero only for a divisor that is
+// exactly 0 throughout.
+Status calcBound(CalcContext* context, const CalcProgram* program,
+		const CalcInterval* slots, CalcInterval* result) {
+	uint64_t clock = context->statsEnabled ? statsNow() : 0;
+
+	if(slots == NULL) {
+		int slotCount = calcVariableCount(context);
+		CalcInterval* points = arenaAlloc(context->arena,
+				slotCount * sizeof(CalcInterval));
+
+		for(int slot = 0; slot < slotCount; ++slot) {
+			points[slot].lo = context->vars[slot];
+			points[slot].hi = context->vars[slot];
+		}
+
+		slots = points;
+	}
+
+	Status status = intervalEval(program->program, slots, context->arena,
+			result);
+
+	if(context->statsEnabled) {
+		contextCountEval(context, program->program, &clock);
+	}
+
+	arenaReset(context->arena);
+	return status;
+}
+
+// Runs a compiled program over count rows, a block at a time. columns[slot]
+// holds the values of a slot for every row, and may be NULL for slots the
+// program does not read. rowStatus may be NULL.
+// Returns success, or the status of the first failed row.
+Status calcRunBatch(const CalcProgram* program, const double* const* columns,
+		size_t count, double* results, Status* rowStatus) {
+	return programEvalBatch(program->program, columns, count, results,
+			rowStatus);
+}
+
+void calcProgramDestroy(CalcProgram* program) {
+	programDestroy(program->program);
+	jitFree(program->jit.code);
+	parallelStateReset(&program->parallel);
+	free(program);
+}
+
+// Sets how many evaluations of a cached or compiled program it takes to
+// compile it to native code, 0 for never. Native code gives the same results
+// as the interpreter.
+void calcSetJitThreshold(CalcContext* context, unsigned threshold) {
+	context->jitThreshold = threshold;
+}
+
+// Shares the evaluation of costly programs between count threads, the
+// caller's included, or evaluates on the caller's thread alone for 1.
+// Subexpressions are only handed out when large enough to repay it, and
+// the result is exactly that of evaluating on one thread.
+void calcSetThreads(CalcContext* context, int count) {
+	if(context->pool != NULL) {
+		parallelPoolDestroy(context->pool);
+		context->pool = NULL;
+	}
+
+	if(count > 1) {
+		context->pool = parallelPoolCreate(count);
+	}
+}
+
+double calcGetAns(const CalcContext* context) {
+	return context->vars[ANS_SLOT];
+}
+
+// Sets the answer the next expression sees, without adding it to the
+// history.
+void calcSetAns(CalcContext* context, double value) {
+	context->vars[ANS_SLOT] = value;
+	free(context->preciseAns);
+	context->preciseAns = NULL;
+}
+
+// Sets the significant digits calcEvaluate() works to, above those of a
+// double, or 0 to go back to doubles. Results are rounded to the digits,
+// and worked out with a few more.
+void calcSetPrecision(CalcContext* context, int digits) {
+	context->precision = (digits > 0) ? digits : 0;
+}
+
+// Looks up a previous answer, back = 0 being the latest.
+// Returns 0 on success, -1 if fewer answers are kept.
+int calcHistory(const CalcContext* context, int back, double* value) {
+	if(back < 0 || back >= context->historySize) {
+		return -1;
+	}
+
+	*value = context->history[(context->historyEnd - 1 - back + CALC_HISTORY)
+			% CALC_HISTORY];
+	return 0;
+}
+
+// Caches compiled programs in up to limit bytes, evicting the least recently
+// used as needed. A limit of 0 turns the cache off and frees it.
+void calcSetCacheLimit(CalcContext* context, size_t limit) {
+	if(limit == 0) {
+		if(context->cache != NULL) {
+			// Keep the cache's allocations counted once it is gone. The
+			// arithmetic is modular, so the base may wrap.
+			context->allocationBase -= context->cache->allocations;
+			cacheDestroy(context->cache);
+			context->cache = NULL;
+		}
+	} else if(context->cache == NULL) {
+		context->cache = cacheCreate(limit);
+	} else {
+		context->cache->limit = limit;
+		cacheEvict(context->cache, limit);
+	}
+}
+
+void calcGetCacheStats(const CalcContext* context, CalcCacheStats* stats) {
+	const ProgramCache* cache = context->cache;
+
+	memset(stats, 0, sizeof(CalcCacheStats));
+
+	if(cache != NULL) {
+		stats->hits = cache->hits;
+		stats->misses = cache->misses;
+		stats->evictions = cache->evictions;
+		stats->entries = cache->entryCount;
+		stats->bytes = cache->bytes;
+		stats->limit = cache->limit;
+	}
+}
+
+// Turns the statistics on or off. They cost two clock reads per phase, and
+// nothing while off.
+void calcEnableStats(CalcContext* context, int enabled) {
+	context->statsEnabled = enabled;
+}
+
+void calcGetStats(const CalcContext* context, CalcStats* stats) {
+	*stats = context->stats;
+	stats->allocations = contextAllocations(context) - context->allocationBase;
+}
+
+void calcResetStats(CalcContext* context) {
+	memset(&context->stats, 0, sizeof(CalcStats));
+	context->allocationBase = contextAllocations(context);
+}
+
+// Returns the name of an operation counted in CalcStats, or NULL if op is out
+// of range.
+const char* calcOpName(int op) {
+	return (op >= 0 && op < CALC_OPS) ? opNames[op] : NULL;
+}
+
+// Returns the message describing a status, or NULL for success.
+const char* calcStatusMessage(Status status) {
+	switch(status) {
+		case divZero:
+			return "Division by zero.";
+		case evalFail:
+			return "Failed to evaluate expression.";
+		case unknownToken:
+			return "Unrecognised token.";
+		case unpairedBracket:
+			return "Unpaired brackets.";
+		case noDigit:
+			return "operands must contain at least one digit.";
+		case noOperator:
+			return "expressions must contain at least one operator.";
+		case extraDecimalSep:
+			return "Extra decimal point.";
+		case invalidAssignment:
+			return "Only variables can be assigned.";
+		case outOfDomain:
+			return "Result is not a finite real number.";
+		default:
+			return NULL;
+	}
+}
+
+#endif
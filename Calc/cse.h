@@ -0,0 +1,113 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "program.h"
+#include "tree.h"
+#include "../Memory/arena.h"
+
+// Common subexpression elimination by hash consing. Walking the tree
+// operands first, each node is looked up among the distinct nodes seen so
+// far by its operation, argument, value and the nodes its operands were
+// merged into. An equal node found means the whole subtree is a repeat, and
+// users are pointed at the first copy instead.
+
+int eliminateCommon(Node* root, Arena* arena);
+uint64_t nodeHash(const Node* node);
+int nodeEqual(const Node* a, const Node* b);
+
+
+// Function definitions:
+
+// Turns the tree into a DAG with one node per distinct subexpression, and
+// counts the users of every node for treeEmit().
+// Returns the number of operations removed.
+int eliminateCommon(Node* root, Arena* arena) {
+	int count, eliminated = 0;
+	Node** order = treePostorder(root, arena, &count);
+	int capacity = 16;
+
+	// At most half full.
+	while(capacity < 2 * count) {
+		capacity *= 2;
+	}
+
+	Node** table = arenaAlloc(arena, capacity * sizeof(Node*));
+	memset(table, 0, capacity * sizeof(Node*));
+
+	for(int i = 0; i < count; ++i) {
+		Node* node = order[i];
+
+		if(node->left != NULL && node->left->merged != NULL) {
+			node->left = node->left->merged;
+		}
+
+		if(node->right != NULL && node->right->merged != NULL) {
+			node->right = node->right->merged;
+		}
+
+		uint32_t slot = nodeHash(node) & (capacity - 1);
+
+		while(table[slot] != NULL && !nodeEqual(table[slot], node)) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+
+		if(table[slot] == NULL) {
+			table[slot] = node;
+			continue;
+		}
+
+		node->merged = table[slot];
+
+		// A repeated leaf is as cheap to reload as a temporary.
+		if(node->left != NULL) {
+			++eliminated;
+		}
+	}
+
+	// Operands are counted once per distinct user.
+	for(int i = 0; i < count; ++i) {
+		Node* node = order[i];
+
+		if(node->merged == NULL) {
+			if(node->left != NULL) {
+				++(node->left->uses);
+			}
+
+			if(node->right != NULL) {
+				++(node->right->uses);
+			}
+		}
+	}
+
+	++(root->uses);
+
+	return eliminated;
+}
+
+uint64_t nodeHash(const Node* node) {
+	uint64_t words[5] = { (uint64_t)node->op, (uint64_t)(uint32_t)node->arg,
+			0, (uint64_t)(uintptr_t)node->left, (uint64_t)(uintptr_t)node->right };
+	uint64_t hash = 14695981039346656037u;
+
+	memcpy(&words[2], &node->value, sizeof(double));
+
+	for(int i = 0; i < 5; ++i) {
+		hash = (hash ^ words[i]) * 1099511628211u;
+		hash ^= hash >> 29;
+	}
+
+	return hash;
+}
+
+// Compares two nodes whose operands are already merged. Constants are
+// compared by bits, so 0 and -0 stay apart.
+int nodeEqual(const Node* a, const Node* b) {
+	return a->op == b->op && a->arg == b->arg && a->left == b->left
+			&& a->right == b->right
+			&& memcmp(&a->value, &b->value, sizeof(double)) == 0;
+}
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include <math.h>
+
+#include "status.h"
+#include "program.h"
+#include "../Memory/arena.h"
+
+// Automatic differentiation of compiled programs. Values are computed by
+// the same operations in the same order as programEval(), so they match it
+// exactly, and derivatives by the chain rule, one instruction at a time.
+//
+// Forward mode carries a tangent beside every value: the derivative along
+// one direction through the variables, for about twice the cost of a plain
+// run. Reverse mode records every value on a tape, then walks it backwards
+// from the result, accumulating the adjoint of each instruction into its
+// operands; the whole gradient costs a few plain runs, however many
+// variables there are. A temporary loaded by several users is one node of
+// the tape, so it gathers the adjoints of all of them.
+
+// A value and its derivative along a direction.
+typedef struct {
+	double value;
+	double tangent;
+} Dual;
+
+Status dualEval(const Program* program, const double* vars,
+		const double* direction, Arena* arena, Dual* result);
+Status gradientEval(const Program* program, const double* vars,
+		int slotCount, Arena* arena, double* value, double* gradient);
+void operationPartials(OpCode op, double lOperand, double rOperand,
+		double value, double* lPartial, double* rPartial);
+double functionDerivative(OpCode op, double operand, double value);
+double powiDerivative(double base, int exponent);
+
+
+// Function definitions:
+
+// Runs the program on dual numbers, the tangent of each variable being its
+// component of direction, indexed by slot.
+// Returns the status of the evaluation.
+Status dualEval(const Program* program, const double* vars,
+		const double* direction, Arena* arena, Dual* result) {
+	Dual* stack = arenaAlloc(arena, program->maxDepth * sizeof(Dual));
+	Dual* temps = arenaAlloc(arena, program->tempCount * sizeof(Dual));
+	int depth = 0;
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+		int top = depth - 1;
+		double lPartial, rPartial, value;
+
+		switch(instruction->op) {
+			case opConst:
+				stack[depth].value = program->constants[instruction->arg];
+				stack[depth++].tangent = 0;
+				break;
+			case opVar:
+				stack[depth].value = vars[instruction->arg];
+				stack[depth++].tangent = direction[instruction->arg];
+				break;
+			case opNeg:
+				stack[top].value = -stack[top].value;
+				stack[top].tangent = -stack[top].tangent;
+				break;
+			case opSqrt:
+			case opSin:
+			case opCos:
+			case opTan:
+			case opExp:
+			case opLog:
+				value = applyFunction(instruction->op, stack[top].value);
+
+				// A constant operand stays constant, even where the
+				// derivative is infinite, as sqrt's is at 0.
+				if(stack[top].tangent != 0) {
+					stack[top].tangent *= functionDerivative(instruction->op,
+							stack[top].value, value);
+				}
+
+				stack[top].value = value;
+				break;
+			case opPowi:
+				value = applyPowi(stack[top].value, instruction->arg);
+
+				if(stack[top].tangent != 0) {
+					stack[top].tangent *= powiDerivative(stack[top].value,
+							instruction->arg);
+				}
+
+				stack[top].value = value;
+				break;
+			case opStore:
+				temps[instruction->arg] = stack[top];
+				break;
+			case opLoad:
+				stack[depth++] = temps[instruction->arg];
+				break;
+			case opDiv:
+				if(stack[top].value == 0) {
+					return divZero;
+				}
+				// Fall through.
+			default: {
+				Dual* left = &stack[top - 1];
+				const Dual* right = &stack[top];
+
+				value = applyOperation(instruction->op, left->value,
+						right->value);
+				operationPartials(instruction->op, left->value, right->value,
+						value, &lPartial, &rPartial);
+				left->tangent = ((left->tangent != 0) ? lPartial * left->tangent : 0)
+						+ ((right->tangent != 0) ? rPartial * right->tangent : 0);
+				left->value = value;
+				--depth;
+				break;
+			}
+		}
+	}
+
+	if(depth != 1) {
+		return evalFail;
+	}
+
+	*result = stack[0];
+	return success;
+}
+
+// Runs the program, recording each instruction's value and operands, then
+// sweeps back from the result. Every slot below slotCount gets its partial
+// derivative in gradient, 0 for those the program does not read.
+// Returns the status of the evaluation.
+Status gradientEval(const Program* program, const double* vars,
+		int slotCount, Arena* arena, double* value, double* gradient) {
+	int size = program->codeSize;
+	// Node of the tape for each instruction, by its index. A store is the
+	// node of the value it stores, and a load pushes that node again.
+	double* values = arenaAlloc(arena, size * sizeof(double));
+	double* adjoints = arenaAlloc(arena, size * sizeof(double));
+	int* lefts = arenaAlloc(arena, size * sizeof(int));
+	int* rights = arenaAlloc(arena, size * sizeof(int));
+	int* stack = arenaAlloc(arena, program->maxDepth * sizeof(int));
+	int* temps = arenaAlloc(arena, program->tempCount * sizeof(int));
+	int depth = 0;
+
+	for(int pc = 0; pc < size; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+		OpCode op = instruction->op;
+
+		adjoints[pc] = 0;
+
+		switch(op) {
+			case opConst:
+				values[pc] = program->constants[instruction->arg];
+				stack[depth++] = pc;
+				break;
+			case opVar:
+				values[pc] = vars[instruction->arg];
+				stack[depth++] = pc;
+				break;
+			case opStore:
+				temps[instruction->arg] = stack[depth - 1];
+				break;
+			case opLoad:
+				stack[depth++] = temps[instruction->arg];
+				break;
+			case opNeg:
+			case opSqrt:
+			case opSin:
+			case opCos:
+			case opTan:
+			case opExp:
+			case opLog:
+			case opPowi:
+				lefts[pc] = stack[depth - 1];
+				values[pc] = (op == opNeg) ? -values[lefts[pc]]
+						: (op == opPowi)
+						? applyPowi(values[lefts[pc]], instruction->arg)
+						: applyFunction(op, values[lefts[pc]]);
+				stack[depth - 1] = pc;
+				break;
+			default:
+				rights[pc] = stack[--depth];
+				lefts[pc] = stack[depth - 1];
+
+				if(op == opDiv && values[rights[pc]] == 0) {
+					return divZero;
+				}
+
+				values[pc] = applyOperation(op, values[lefts[pc]],
+						values[rights[pc]]);
+				stack[depth - 1] = pc;
+				break;
+		}
+	}
+
+	if(depth != 1) {
+		return evalFail;
+	}
+
+	for(int slot = 0; slot < slotCount; ++slot) {
+		gradient[slot] = 0;
+	}
+
+	adjoints[stack[0]] = 1;
+
+	// Users come after what they use, so every adjoint is complete by the
+	// time the sweep reaches it. Those still 0 lead nowhere and are skipped,
+	// as constants are in forward mode.
+	for(int pc = size - 1; pc >= 0; --pc) {
+		const Instruction* instruction = &program->code[pc];
+		double adjoint = adjoints[pc], lPartial, rPartial;
+
+		if(adjoint == 0) {
+			continue;
+		}
+
+		switch(instruction->op) {
+			case opConst:
+			case opStore:
+			case opLoad:
+				break;
+			case opVar:
+				if(instruction->arg < slotCount) {
+					gradient[instruction->arg] += adjoint;
+				}
+
+				break;
+			case opNeg:
+				adjoints[lefts[pc]] -= adjoint;
+				break;
+			case opSqrt:
+			case opSin:
+			case opCos:
+			case opTan:
+			case opExp:
+			case opLog:
+				adjoints[lefts[pc]] += adjoint * functionDerivative(
+						instruction->op, values[lefts[pc]], values[pc]);
+				break;
+			case opPowi:
+				adjoints[lefts[pc]] += adjoint
+						* powiDerivative(values[lefts[pc]], instruction->arg);
+				break;
+			default:
+				operationPartials(instruction->op, values[lefts[pc]],
+						values[rights[pc]], values[pc], &lPartial, &rPartial);
+				adjoints[lefts[pc]] += adjoint * lPartial;
+				adjoints[rights[pc]] += adjoint * rPartial;
+				break;
+		}
+	}
+
+	*value = values[stack[0]];
+	return success;
+}
+
+// Gives the partial derivatives of a binary operation, whose result is
+// value, by each of its operands. A power's by its exponent is taken as 0
+// where its value is, as it is in the limit for a base of +0.
+void operationPartials(OpCode op, double lOperand, double rOperand,
+		double value, double* lPartial, double* rPartial) {
+	switch(op) {
+		case opAdd:
+			*lPartial = 1;
+			*rPartial = 1;
+			break;
+		case opSub:
+			*lPartial = 1;
+			*rPartial = -1;
+			break;
+		case opMul:
+			*lPartial = rOperand;
+			*rPartial = lOperand;
+			break;
+		case opDiv:
+			*lPartial = 1 / rOperand;
+			*rPartial = -value / rOperand;
+			break;
+		case opPow:
+			*lPartial = rOperand * pow(lOperand, rOperand - 1);
+			*rPartial = (value == 0) ? 0 : value * log(lOperand);
+			break;
+		default:
+			*lPartial = NAN;
+			*rPartial = NAN;
+			break;
+	}
+}
+
+// Gives the derivative of a single argument function at operand, where it
+// takes value.
+double functionDerivative(OpCode op, double operand, double value) {
+	switch(op) {
+		case opSqrt:
+			return 0.5 / value;
+		case opSin:
+			return cos(operand);
+		case opCos:
+			return -sin(operand);
+		case opTan:
+			return 1 + value * value;
+		case opExp:
+			return value;
+		case opLog:
+			return 1 / operand;
+		default:
+			return NAN;
+	}
+}
+
+// Gives the derivative of base raised to an integer power.
+double powiDerivative(double base, int exponent) {
+	return (exponent == 0) ? 0 : exponent * applyPowi(base, exponent - 1);
+}
+
+#endif
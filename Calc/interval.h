@@ -0,0 +1,510 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <math.h>
+
+#include "calc.h"
+#include "status.h"
+#include "program.h"
+#include "../Memory/arena.h"
+
+// Interval evaluation of compiled programs. Every value is a range
+// [lo, hi] holding every value the expression takes as its variables range
+// over theirs, constants taken as exact. Bounds are rounded outward without
+// switching the rounding mode, which the compiler is free to ignore: the
+// results of +, -, *, / and sqrt(), rounded correctly by IEEE 754, are
+// stepped an ulp outward only where the exact error of the rounding, found
+// by fma() or two-sum, says they fell inside, and those of the maths
+// library by INTERVAL_ULPS regardless.
+//
+// A range outside a function's domain is empty, both bounds NaN, as the
+// plain evaluator gives NaN; a range partly outside is cut to the part
+// inside. Dividing by a range containing 0 gives the hull of the quotients
+// over the rest of it, which is the whole line when 0 is strictly inside.
+// Only a divisor of exactly [0, 0] is division by zero.
+
+// Ulps the bounds of a maths library result are widened by, covering its
+// error.
+#define INTERVAL_ULPS   2
+
+// Largest magnitude at which sin(), cos() and tan() have their turning
+// points and poles located, beyond which they are bounded by their range.
+#define INTERVAL_PERIODIC       1e15
+
+// Least magnitude of a product or quotient whose rounding error fma()
+// finds exactly, 2^-969, clear of the subnormals.
+#define INTERVAL_TINY   0x1p-969
+
+#define INTERVAL_PI     3.1415926535897932384
+
+Status intervalEval(const Program* program, const CalcInterval* vars,
+		Arena* arena, CalcInterval* result);
+CalcInterval intervalOperation(OpCode op, CalcInterval lOperand,
+		CalcInterval rOperand);
+CalcInterval intervalFunction(OpCode op, CalcInterval operand);
+CalcInterval intervalPown(CalcInterval base, double exponent);
+CalcInterval intervalPow(CalcInterval base, CalcInterval exponent);
+CalcInterval intervalDivide(CalcInterval lOperand, CalcInterval rOperand);
+CalcInterval intervalPeriodic(OpCode op, CalcInterval operand);
+int intervalHits(CalcInterval range, double phase, double period);
+CalcInterval intervalMake(double lo, double hi, int ulps);
+double intervalDown(double x, int ulps);
+double intervalUp(double x, int ulps);
+double intervalAdd(double a, double b, int up);
+double intervalMul(double a, double b, int up);
+double intervalDiv(double a, double b, int up);
+double intervalSqrt(double x, int up);
+double intervalRound(double x, double error, int up);
+
+#define intervalIsEmpty(x) (isnan((x).lo) || isnan((x).hi))
+
+
+// Function definitions:
+
+// Runs the program over a range for every variable, indexed by slot.
+// Returns the status of the evaluation: divZero only for a divisor of
+// exactly [0, 0].
+Status intervalEval(const Program* program, const CalcInterval* vars,
+		Arena* arena, CalcInterval* result) {
+	CalcInterval* stack = arenaAlloc(arena,
+			program->maxDepth * sizeof(CalcInterval));
+	CalcInterval* temps = arenaAlloc(arena,
+			program->tempCount * sizeof(CalcInterval));
+	int depth = 0;
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+		int top = depth - 1;
+
+		switch(instruction->op) {
+			case opConst:
+				stack[depth].lo = program->constants[instruction->arg];
+				stack[depth++].hi = program->constants[instruction->arg];
+				break;
+			case opVar:
+				stack[depth++] = vars[instruction->arg];
+				break;
+			case opNeg:
+			case opSqrt:
+			case opSin:
+			case opCos:
+			case opTan:
+			case opExp:
+			case opLog:
+				stack[top] = intervalFunction(instruction->op, stack[top]);
+				break;
+			case opPowi:
+				stack[top] = intervalPown(stack[top], instruction->arg);
+				break;
+			case opStore:
+				temps[instruction->arg] = stack[top];
+				break;
+			case opLoad:
+				stack[depth++] = temps[instruction->arg];
+				break;
+			case opDiv:
+				if(stack[top].lo == 0 && stack[top].hi == 0) {
+					return divZero;
+				}
+				// Fall through.
+			default:
+				stack[top - 1] = intervalOperation(instruction->op,
+						stack[top - 1], stack[top]);
+				--depth;
+				break;
+		}
+	}
+
+	if(depth != 1) {
+		return evalFail;
+	}
+
+	*result = stack[0];
+	return success;
+}
+
+// Applies the operations of applyOperation() to ranges.
+CalcInterval intervalOperation(OpCode op, CalcInterval lOperand,
+		CalcInterval rOperand) {
+	CalcInterval empty = { NAN, NAN };
+
+	// Powers see empty operands themselves, as pow() does NaN.
+	if(op == opPow) {
+		return intervalPow(lOperand, rOperand);
+	} else if(intervalIsEmpty(lOperand) || intervalIsEmpty(rOperand)) {
+		return empty;
+	}
+
+	switch(op) {
+		case opAdd: {
+			CalcInterval sum = { intervalAdd(lOperand.lo, rOperand.lo, 0),
+					intervalAdd(lOperand.hi, rOperand.hi, 1) };
+
+			return sum;
+		}
+		case opSub: {
+			CalcInterval difference = {
+					intervalAdd(lOperand.lo, -rOperand.hi, 0),
+					intervalAdd(lOperand.hi, -rOperand.lo, 1) };
+
+			return difference;
+		}
+		case opMul: {
+			// Taken as 0 when either factor is, infinite or not, as the
+			// product of a range holding 0 with an unbounded one is.
+			double lo = fmin(fmin(intervalMul(lOperand.lo, rOperand.lo, 0),
+					intervalMul(lOperand.lo, rOperand.hi, 0)),
+					fmin(intervalMul(lOperand.hi, rOperand.lo, 0),
+					intervalMul(lOperand.hi, rOperand.hi, 0)));
+			double hi = fmax(fmax(intervalMul(lOperand.lo, rOperand.lo, 1),
+					intervalMul(lOperand.lo, rOperand.hi, 1)),
+					fmax(intervalMul(lOperand.hi, rOperand.lo, 1),
+					intervalMul(lOperand.hi, rOperand.hi, 1)));
+			CalcInterval product = { lo, hi };
+
+			return product;
+		}
+		case opDiv:
+			return intervalDivide(lOperand, rOperand);
+		default:
+			return empty;
+	}
+}
+
+// Applies negation and the functions of applyFunction() to a range.
+CalcInterval intervalFunction(OpCode op, CalcInterval operand) {
+	CalcInterval empty = { NAN, NAN };
+	CalcInterval result;
+
+	if(intervalIsEmpty(operand)) {
+		return empty;
+	}
+
+	switch(op) {
+		case opNeg:
+			result.lo = -operand.hi;
+			result.hi = -operand.lo;
+			return result;
+		case opSqrt:
+			if(operand.hi < 0) {
+				return empty;
+			}
+
+			result.lo = intervalSqrt(fmax(operand.lo, 0), 0);
+			result.hi = intervalSqrt(operand.hi, 1);
+			return result;
+		case opExp:
+			result = intervalMake(exp(operand.lo), exp(operand.hi),
+					INTERVAL_ULPS);
+			// Widening must not take a bound across 1, nor below 0.
+			result.lo = fmax(result.lo, (operand.lo >= 0) ? 1 : 0);
+			result.hi = (operand.hi <= 0) ? fmin(result.hi, 1) : result.hi;
+			return result;
+		case opLog:
+			if(operand.hi < 0) {
+				return empty;
+			}
+
+			result = intervalMake(log(fmax(operand.lo, 0)), log(operand.hi),
+					INTERVAL_ULPS);
+			// Nor across 0, where the range is clear of 1.
+			result.lo = (operand.lo >= 1) ? fmax(result.lo, 0) : result.lo;
+			result.hi = (operand.hi <= 1) ? fmin(result.hi, 0) : result.hi;
+			return result;
+		case opSin:
+		case opCos:
+		case opTan:
+			return intervalPeriodic(op, operand);
+		default:
+			return empty;
+	}
+}
+
+// Raises a range to an integer power, as applyPowi() does and as pow() does
+// for a negative base. Odd powers are increasing; even ones fall to their
+// least at 0.
+CalcInterval intervalPown(CalcInterval base, double exponent) {
+	CalcInterval one = { 1, 1 };
+	double power = fabs(exponent);
+	CalcInterval result;
+
+	if(intervalIsEmpty(base) || exponent == 0) {
+		// x^0 is 1 for every x, NaN included.
+		return (exponent == 0) ? one : base;
+	}
+
+	if(power == 1) {
+		result = base;
+	} else if(fmod(power, 2) == 1 || base.lo >= 0) {
+		result = intervalMake(pow(base.lo, power), pow(base.hi, power),
+				INTERVAL_ULPS);
+	} else if(base.hi <= 0) {
+		result = intervalMake(pow(base.hi, power), pow(base.lo, power),
+				INTERVAL_ULPS);
+	} else {
+		result = intervalMake(0, pow(fmax(-base.lo, base.hi), power),
+				INTERVAL_ULPS);
+	}
+
+	// Widening must not take a bound across 0: even powers are never
+	// negative, and odd ones have the sign of the base.
+	if(fmod(power, 2) == 0 || base.lo >= 0) {
+		result.lo = fmax(result.lo, 0);
+	} else if(base.hi <= 0) {
+		result.hi = fmin(result.hi, 0);
+	}
+
+	if(exponent > 0) {
+		return result;
+	}
+
+	// A negative power is the reciprocal of the positive one, infinite at a
+	// base of 0 rather than a division by zero. Widened, the positive power
+	// is never exactly [0, 0].
+	return intervalDivide(one, result);
+}
+
+// Raises a range to a range of powers. As pow() gives 1 for 1^NaN, a base
+// of exactly 1 gives 1 even for an empty exponent. A constant integer
+// exponent is taken by intervalPown(). Otherwise, over the part of the base
+// at or above 0, x^y moves one way in each of x and y, so is bounded by its
+// values at the corners; the part below 0 only has values at integer
+// exponents.
+CalcInterval intervalPow(CalcInterval base, CalcInterval exponent) {
+	CalcInterval empty = { NAN, NAN };
+	CalcInterval one = { 1, 1 };
+	CalcInterval result = empty;
+	double first = ceil(exponent.lo), last = floor(exponent.hi);
+
+	if(base.lo == 1 && base.hi == 1) {
+		return one;
+	} else if(intervalIsEmpty(exponent)) {
+		return empty;
+	} else if(exponent.lo == exponent.hi && isfinite(exponent.lo)
+			&& exponent.lo == first) {
+		return intervalPown(base, exponent.lo);
+	} else if(intervalIsEmpty(base)) {
+		return empty;
+	}
+
+	if(base.hi >= 0) {
+		double lo = fmax(base.lo, 0);
+
+		result = intervalMake(
+				fmin(fmin(pow(lo, exponent.lo), pow(lo, exponent.hi)),
+				fmin(pow(base.hi, exponent.lo), pow(base.hi, exponent.hi))),
+				fmax(fmax(pow(lo, exponent.lo), pow(lo, exponent.hi)),
+				fmax(pow(base.hi, exponent.lo), pow(base.hi, exponent.hi))),
+				INTERVAL_ULPS);
+		result.lo = fmax(result.lo, 0);
+	}
+
+	if(base.lo < 0 && first <= last) {
+		// The powers of a negative base at two or more integers take both
+		// signs, and are largest at the first or the last of them.
+		CalcInterval negative = { base.lo, fmin(base.hi, 0) };
+		CalcInterval part = { -INFINITY, INFINITY };
+
+		if(first == last) {
+			part = intervalPown(negative, first);
+		} else if(isfinite(first) && isfinite(last)) {
+			CalcInterval low = intervalPown(negative, first);
+			CalcInterval high = intervalPown(negative, last);
+
+			part.hi = fmax(fmax(fabs(low.lo), fabs(low.hi)),
+					fmax(fabs(high.lo), fabs(high.hi)));
+			part.lo = -part.hi;
+		}
+
+		// fmin() and fmax() pass over the NaN of an empty result.
+		result.lo = fmin(result.lo, part.lo);
+		result.hi = fmax(result.hi, part.hi);
+	}
+
+	return result;
+}
+
+// Divides two ranges, the divisor not exactly [0, 0]. A divisor with 0 at
+// one end gives quotients running off to infinity on one side; one with 0
+// strictly inside gives them on both, and so does a dividend holding 0
+// unless it is only 0.
+CalcInterval intervalDivide(CalcInterval lOperand, CalcInterval rOperand) {
+	CalcInterval entire = { -INFINITY, INFINITY };
+	CalcInterval result;
+
+	if(rOperand.lo > 0 || rOperand.hi < 0) {
+		// Quotients of infinities are NaN, and fmin() and fmax() pass over
+		// them to the bounds the other corners give.
+		result.lo = fmin(fmin(intervalDiv(lOperand.lo, rOperand.lo, 0),
+				intervalDiv(lOperand.lo, rOperand.hi, 0)),
+				fmin(intervalDiv(lOperand.hi, rOperand.lo, 0),
+				intervalDiv(lOperand.hi, rOperand.hi, 0)));
+		result.hi = fmax(fmax(intervalDiv(lOperand.lo, rOperand.lo, 1),
+				intervalDiv(lOperand.lo, rOperand.hi, 1)),
+				fmax(intervalDiv(lOperand.hi, rOperand.lo, 1),
+				intervalDiv(lOperand.hi, rOperand.hi, 1)));
+		return result;
+	}
+
+	if(lOperand.lo == 0 && lOperand.hi == 0) {
+		return lOperand;
+	} else if((lOperand.lo <= 0 && lOperand.hi >= 0)
+			|| (rOperand.lo < 0 && rOperand.hi > 0)) {
+		return entire;
+	}
+
+	if(lOperand.hi < 0) {
+		if(rOperand.hi == 0) {
+			result.lo = intervalDiv(lOperand.hi, rOperand.lo, 0);
+			result.hi = INFINITY;
+		} else {
+			result.lo = -INFINITY;
+			result.hi = intervalDiv(lOperand.hi, rOperand.hi, 1);
+		}
+	} else {
+		if(rOperand.hi == 0) {
+			result.lo = -INFINITY;
+			result.hi = intervalDiv(lOperand.lo, rOperand.lo, 1);
+		} else {
+			result.lo = intervalDiv(lOperand.lo, rOperand.hi, 0);
+			result.hi = INFINITY;
+		}
+	}
+
+	return result;
+}
+
+// Bounds sin(), cos() or tan() over a range: by their values at its ends,
+// widened to 1 or -1 wherever a peak or trough of sin() or cos() falls
+// inside, or to the whole line where a pole of tan() does.
+CalcInterval intervalPeriodic(OpCode op, CalcInterval operand) {
+	CalcInterval unit = { -1, 1 };
+	CalcInterval entire = { -INFINITY, INFINITY };
+	CalcInterval result;
+	int wide = (operand.hi - operand.lo >= 2 * INTERVAL_PI
+			|| fmax(-operand.lo, operand.hi) > INTERVAL_PERIODIC);
+
+	if(op == opTan) {
+		if(wide || intervalHits(operand, INTERVAL_PI / 2, INTERVAL_PI)) {
+			return entire;
+		}
+
+		return intervalMake(tan(operand.lo), tan(operand.hi), INTERVAL_ULPS);
+	}
+
+	if(wide) {
+		return unit;
+	}
+
+	double lo = applyFunction(op, operand.lo);
+	double hi = applyFunction(op, operand.hi);
+	// Peaks of sin() are a quarter turn on from those of cos().
+	double peak = (op == opSin) ? INTERVAL_PI / 2 : 0;
+
+	result = intervalMake(fmin(lo, hi), fmax(lo, hi), INTERVAL_ULPS);
+	result.lo = intervalHits(operand, peak + INTERVAL_PI, 2 * INTERVAL_PI)
+			? -1 : fmax(result.lo, -1);
+	result.hi = intervalHits(operand, peak, 2 * INTERVAL_PI)
+			? 1 : fmin(result.hi, 1);
+	return result;
+}
+
+// Returns whether phase + k period falls in the range for some integer k.
+// Near misses count too, so that the error in finding k, which grows with
+// it, can only widen the bounds.
+int intervalHits(CalcInterval range, double phase, double period) {
+	double first = (range.lo - phase) / period;
+	double last = (range.hi - phase) / period;
+	double slack = (fabs(first) + fabs(last) + 1) * 1e-15;
+
+	return floor(last + slack) >= ceil(first - slack);
+}
+
+// Returns [lo, hi], each widened by ulps.
+CalcInterval intervalMake(double lo, double hi, int ulps) {
+	CalcInterval result = { intervalDown(lo, ulps), intervalUp(hi, ulps) };
+
+	return result;
+}
+
+// Steps x down by ulps. -INFINITY and NaN stay as they are.
+double intervalDown(double x, int ulps) {
+	for(int i = 0; i < ulps; ++i) {
+		x = nextafter(x, -INFINITY);
+	}
+
+	return x;
+}
+
+// Steps x up by ulps, as intervalDown() steps it down.
+double intervalUp(double x, int ulps) {
+	for(int i = 0; i < ulps; ++i) {
+		x = nextafter(x, INFINITY);
+	}
+
+	return x;
+}
+
+// Adds two bounds, rounding up or down. The error of the rounded sum is
+// found exactly by Knuth's two-sum.
+double intervalAdd(double a, double b, int up) {
+	double sum = a + b;
+	double bPart = sum - a;
+	double error = (a - (sum - bPart)) + (b - bPart);
+
+	return intervalRound(sum, isfinite(sum) ? error : NAN, up);
+}
+
+// Multiplies two bounds, rounding up or down, with 0 times anything 0.
+// fma() gives the error of the rounded product exactly.
+double intervalMul(double a, double b, int up) {
+	if(a == 0 || b == 0) {
+		return 0;
+	}
+
+	double product = a * b;
+
+	return intervalRound(product, (isfinite(product)
+			&& fabs(product) >= INTERVAL_TINY) ? fma(a, b, -product) : NAN, up);
+}
+
+// Divides two bounds, the divisor not 0, rounding up or down. The quotient
+// is short of the exact one by the remainder, found by fma(), over the
+// divisor.
+double intervalDiv(double a, double b, int up) {
+	if(a == 0) {
+		return 0;
+	}
+
+	double quotient = a / b;
+	double remainder = (isfinite(quotient) && fabs(quotient) >= INTERVAL_TINY
+			&& fabs(a) >= INTERVAL_TINY) ? fma(-quotient, b, a) : NAN;
+
+	return intervalRound(quotient, (b > 0) ? remainder : -remainder, up);
+}
+
+// Takes the square root of a bound, rounding up or down. The root is short
+// of the exact one where its square, by fma(), is short of x.
+double intervalSqrt(double x, int up) {
+	double root = sqrt(x);
+
+	if(x == 0) {
+		return root;
+	}
+
+	return intervalRound(root, (isfinite(root) && x >= INTERVAL_TINY)
+			? fma(-root, root, x) : NAN, up);
+}
+
+// Rounds a result up or down, given a number with the sign of the exact
+// result less it, or NaN where that is not known. A result that is exact
+// stays as it is.
+double intervalRound(double x, double error, int up) {
+	if(up) {
+		return (error > 0 || isnan(error)) ? nextafter(x, INFINITY) : x;
+	}
+
+	return (error < 0 || isnan(error)) ? nextafter(x, -INFINITY) : x;
+}
+
+#endif
@@ -0,0 +1,420 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "status.h"
+#include "program.h"
+#include "../Memory/arena.h"
+
+// Native code is only generated for x86-64, using the System V calling
+// convention.
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X86 1
+#else
+#define JIT_X86 0
+#endif
+
+// Evaluations of a program before it is compiled to native code.
+#define JIT_THRESHOLD   256
+
+// Most bytes of machine code one instruction of the bytecode other than
+// opPowi becomes, and the prologue and epilogue each. opPowi's grow with its
+// exponent, see jitPowiBytes().
+#define JIT_OP_BYTES    128
+
+// Entry point of a compiled program. frame holds the evaluation stack
+// followed by the temporaries.
+typedef Status (*JitFunction)(const double* vars, const double* constants,
+		double* frame, double* result);
+
+// A program compiled to native code, in pages of its own.
+typedef struct {
+	JitFunction run;
+	unsigned char* memory;
+	size_t size;
+} JitCode;
+
+// Native code of a program evaluated many times, compiled once the program
+// has been evaluated threshold times.
+typedef struct {
+	JitCode* code;
+	unsigned runs;
+} JitState;
+
+// Machine code being written.
+typedef struct {
+	unsigned char* code;
+	size_t size;
+} JitBuffer;
+
+JitCode* jitCompile(const Program* program);
+Status jitRun(const JitCode* code, const Program* program, const double* vars,
+		Arena* arena, double* result);
+Status jitEval(const Program* program, JitState* state, unsigned threshold,
+		const double* vars, Arena* arena, double* result);
+void jitFree(JitCode* code);
+void jitStateReset(JitState* state);
+void jitByte(JitBuffer* buffer, unsigned byte);
+void jitBytes(JitBuffer* buffer, const char* bytes, size_t length);
+void jitImmediate(JitBuffer* buffer, uint64_t value, int size);
+void jitMemory(JitBuffer* buffer, unsigned prefix, unsigned opcode, int xmm,
+		int base, int32_t disp);
+void jitLoadDouble(JitBuffer* buffer, int xmm, double value);
+void jitCall(JitBuffer* buffer, uintptr_t function);
+void jitReturn(JitBuffer* buffer);
+void jitPowi(JitBuffer* buffer, int exponent);
+size_t jitPowiBytes(int exponent);
+
+
+// Function definitions:
+
+#if JIT_X86
+
+// Registers, as numbered in the instruction encoding.
+enum {
+	regBX = 3,
+	regR12 = 12,
+	regR13 = 13,
+	regR14 = 14
+};
+
+// Scalar double moves of SSE2, prefixed by F2 0F.
+enum {
+	sseLoad = 0x10,
+	sseStore = 0x11
+};
+
+// Compiles a program to native code. The evaluation stack is kept in a frame
+// of memory, except for its top, which stays in xmm0, so most operations
+// work on a register. Each operation is the same IEEE operation or libm call
+// as in programEval(), so both give the same results.
+// Returns the code, or NULL if the program cannot be compiled.
+JitCode* jitCompile(const Program* program) {
+	if(isProgramEmpty(program) || program->depth != 1) {
+		return NULL;
+	}
+
+	long pageSize = sysconf(_SC_PAGESIZE);
+	size_t size = 2 * (size_t)JIT_OP_BYTES;
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		size += (program->code[pc].op == opPowi)
+				? jitPowiBytes(program->code[pc].arg) : JIT_OP_BYTES;
+	}
+
+	size = (size + pageSize - 1) / pageSize * pageSize;
+
+	// Anonymous mappings are not POSIX, but private mappings of /dev/zero
+	// are the same thing.
+	int fd = open("/dev/zero", O_RDWR);
+
+	if(fd < 0) {
+		return NULL;
+	}
+
+	unsigned char* memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if(memory == MAP_FAILED) {
+		return NULL;
+	}
+
+	JitBuffer buffer = { memory, 0 };
+	int depth = 0;
+
+	// Keep the arguments in callee saved registers, so they survive calls
+	// into libm, and align the stack for those calls.
+	jitBytes(&buffer, "\x53\x41\x54\x41\x55\x41\x56\x48\x83\xec\x08", 11);
+	jitBytes(&buffer, "\x48\x89\xfb\x49\x89\xf4\x49\x89\xd5\x49\x89\xce", 12);
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+		int arg = instruction->arg;
+		int left = 8 * (depth - 2);
+
+		switch(instruction->op) {
+			case opConst:
+			case opVar:
+			case opLoad:
+				if(depth > 0) {
+					jitMemory(&buffer, 0xf2, sseStore, 0, regR13, 8 * (depth - 1));
+				}
+
+				if(instruction->op == opConst) {
+					jitMemory(&buffer, 0xf2, sseLoad, 0, regR12, 8 * arg);
+				} else if(instruction->op == opVar) {
+					jitMemory(&buffer, 0xf2, sseLoad, 0, regBX, 8 * arg);
+				} else {
+					jitMemory(&buffer, 0xf2, sseLoad, 0, regR13,
+							8 * (program->maxDepth + arg));
+				}
+
+				++depth;
+				break;
+			case opStore:
+				jitMemory(&buffer, 0xf2, sseStore, 0, regR13,
+						8 * (program->maxDepth + arg));
+				break;
+			case opNeg:
+				// Flip the sign bit, as -x does.
+				jitByte(&buffer, 0x48);
+				jitByte(&buffer, 0xb8);
+				jitImmediate(&buffer, UINT64_C(0x8000000000000000), 8);
+				jitBytes(&buffer, "\x66\x48\x0f\x6e\xc8\x66\x0f\x57\xc1", 9);
+				break;
+			case opSqrt:
+				jitBytes(&buffer, "\xf2\x0f\x51\xc0", 4);
+				break;
+			case opSin:
+				jitCall(&buffer, (uintptr_t)sin);
+				break;
+			case opCos:
+				jitCall(&buffer, (uintptr_t)cos);
+				break;
+			case opTan:
+				jitCall(&buffer, (uintptr_t)tan);
+				break;
+			case opExp:
+				jitCall(&buffer, (uintptr_t)exp);
+				break;
+			case opLog:
+				jitCall(&buffer, (uintptr_t)log);
+				break;
+			case opPowi:
+				jitPowi(&buffer, arg);
+				break;
+			case opPow:
+				// pow(left, xmm0), with the operands moved into place.
+				jitBytes(&buffer, "\x66\x0f\x28\xc8", 4);
+				jitMemory(&buffer, 0xf2, sseLoad, 0, regR13, left);
+				jitCall(&buffer, (uintptr_t)pow);
+				--depth;
+				break;
+			case opDiv:
+				// Return divZero if xmm0 compares equal to 0. A NaN is
+				// unordered and so does not.
+				jitBytes(&buffer, "\x66\x0f\x57\xc9\x66\x0f\x2e\xc1", 8);
+				jitBytes(&buffer, "\x7a\x13\x75\x11", 4);
+				jitByte(&buffer, 0xb8);
+				jitImmediate(&buffer, divZero, 4);
+				jitReturn(&buffer);
+				// Fall through.
+			default:
+				// xmm0 = left op xmm0, keeping the operand order.
+				jitMemory(&buffer, 0xf2, sseLoad, 1, regR13, left);
+
+				switch(instruction->op) {
+					case opAdd:
+						jitBytes(&buffer, "\xf2\x0f\x58\xc8", 4);
+						break;
+					case opSub:
+						jitBytes(&buffer, "\xf2\x0f\x5c\xc8", 4);
+						break;
+					case opMul:
+						jitBytes(&buffer, "\xf2\x0f\x59\xc8", 4);
+						break;
+					case opDiv:
+						jitBytes(&buffer, "\xf2\x0f\x5e\xc8", 4);
+						break;
+				}
+
+				jitBytes(&buffer, "\x66\x0f\x28\xc1", 4);
+				--depth;
+				break;
+		}
+	}
+
+	// Store the result and return success.
+	jitMemory(&buffer, 0xf2, sseStore, 0, regR14, 0);
+	jitBytes(&buffer, "\x31\xc0", 2);
+	jitReturn(&buffer);
+
+	// The pages are never writable and executable at once.
+	if(mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(memory, size);
+		return NULL;
+	}
+
+	JitCode* code = malloc(sizeof(JitCode));
+
+	if(code == NULL) {
+		fprintf(stderr, "Allocation of native code failed.\n");
+		exit(1);
+	}
+
+	// ISO C has no conversion from a data pointer to a function pointer, so
+	// the address is copied instead.
+	memcpy(&code->run, &memory, sizeof(code->run));
+	code->memory = memory;
+	code->size = size;
+	return code;
+}
+
+void jitFree(JitCode* code) {
+	if(code != NULL) {
+		munmap(code->memory, code->size);
+		free(code);
+	}
+}
+
+void jitByte(JitBuffer* buffer, unsigned byte) {
+	buffer->code[buffer->size++] = (unsigned char)byte;
+}
+
+void jitBytes(JitBuffer* buffer, const char* bytes, size_t length) {
+	memcpy(buffer->code + buffer->size, bytes, length);
+	buffer->size += length;
+}
+
+// Appends a little endian immediate of size bytes.
+void jitImmediate(JitBuffer* buffer, uint64_t value, int size) {
+	for(int i = 0; i < size; ++i) {
+		jitByte(buffer, (value >> (8 * i)) & 0xff);
+	}
+}
+
+// Appends an SSE instruction between xmm and [base + disp].
+void jitMemory(JitBuffer* buffer, unsigned prefix, unsigned opcode, int xmm,
+		int base, int32_t disp) {
+	jitByte(buffer, prefix);
+
+	if(xmm >= 8 || base >= 8) {
+		jitByte(buffer, 0x40 | ((xmm >= 8) << 2) | (base >= 8));
+	}
+
+	jitByte(buffer, 0x0f);
+	jitByte(buffer, opcode);
+	jitByte(buffer, 0x80 | ((xmm & 7) << 3) | (base & 7));
+
+	// rsp and r12 as a base need an index byte.
+	if((base & 7) == 4) {
+		jitByte(buffer, 0x24);
+	}
+
+	jitImmediate(buffer, (uint32_t)disp, 4);
+}
+
+// Sets xmm to a constant, through rax.
+void jitLoadDouble(JitBuffer* buffer, int xmm, double value) {
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	jitBytes(buffer, "\x48\xb8", 2);
+	jitImmediate(buffer, bits, 8);
+	jitBytes(buffer, "\x66\x48\x0f\x6e", 4);
+	jitByte(buffer, 0xc0 | (xmm << 3));
+}
+
+// Calls a function taking and returning doubles in xmm0 and xmm1.
+void jitCall(JitBuffer* buffer, uintptr_t function) {
+	jitBytes(buffer, "\x48\xb8", 2);
+	jitImmediate(buffer, function, 8);
+	jitBytes(buffer, "\xff\xd0", 2);
+}
+
+// Restores the callee saved registers and returns eax.
+void jitReturn(JitBuffer* buffer) {
+	jitBytes(buffer, "\x48\x83\xc4\x08\x41\x5e\x41\x5d\x41\x5c\x5b\xc3", 12);
+}
+
+// Raises xmm0 to an integer power, unrolling applyPowi() so the same
+// multiplications happen in the same order.
+void jitPowi(JitBuffer* buffer, int exponent) {
+	unsigned power = (exponent < 0) ? -(unsigned)exponent : (unsigned)exponent;
+
+	// xmm1 holds the result and xmm0 the base.
+	jitLoadDouble(buffer, 1, 1.0);
+
+	while(power > 0) {
+		if(power & 1) {
+			jitBytes(buffer, "\xf2\x0f\x59\xc8", 4);
+		}
+
+		power >>= 1;
+
+		if(power > 0) {
+			jitBytes(buffer, "\xf2\x0f\x59\xc0", 4);
+		}
+	}
+
+	if(exponent < 0) {
+		jitLoadDouble(buffer, 0, 1.0);
+		jitBytes(buffer, "\xf2\x0f\x5e\xc1", 4);
+	} else {
+		jitBytes(buffer, "\x66\x0f\x28\xc1", 4);
+	}
+}
+
+// Returns the most bytes jitPowi() writes for an exponent: two constant
+// loads of 15 bytes, a final move or division of 4, and up to two
+// multiplications of 4 for each bit of the exponent.
+size_t jitPowiBytes(int exponent) {
+	unsigned power = (exponent < 0) ? -(unsigned)exponent : (unsigned)exponent;
+	size_t bytes = 2 * 15 + 4;
+
+	while(power > 0) {
+		bytes += 2 * 4;
+		power >>= 1;
+	}
+
+	return bytes;
+}
+
+#else
+
+JitCode* jitCompile(const Program* program) {
+	(void)program;
+	return NULL;
+}
+
+void jitFree(JitCode* code) {
+	(void)code;
+}
+
+#endif
+
+// Runs native code of a program, with its frame taken from the arena.
+// Returns the status of the evaluation.
+Status jitRun(const JitCode* code, const Program* program, const double* vars,
+		Arena* arena, double* result) {
+	double* frame = arenaAlloc(arena, (program->maxDepth + program->tempCount)
+			* sizeof(double));
+
+	return code->run(vars, program->constants, frame, result);
+}
+
+// Evaluates a program, counting the evaluation towards compiling it to native
+// code. A threshold of 0 never compiles. Compilation is tried once, and the
+// program is interpreted as before if it fails.
+// Returns the status of the evaluation.
+Status jitEval(const Program* program, JitState* state, unsigned threshold,
+		const double* vars, Arena* arena, double* result) {
+	if(state->code == NULL && threshold > 0 && state->runs < threshold
+			&& ++(state->runs) == threshold) {
+		state->code = jitCompile(program);
+	}
+
+	if(state->code != NULL) {
+		return jitRun(state->code, program, vars, arena, result);
+	}
+
+	return programEval(program, vars, arena, result);
+}
+
+void jitStateReset(JitState* state) {
+	jitFree(state->code);
+	state->code = NULL;
+	state->runs = 0;
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "program.h"
+
+// Explicit vector kernels need GCC vector extensions on x86-64.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+// Largest |x| the vector sin, cos and tan reduce themselves.
+#define TRIG_LIMIT      0x1p19
+
+// Array-at-a-time versions of applyOperation() and applyFunction(). The
+// scalar kernels are plain loops over the block and give the same results
+// as libm. The destination may alias the first operand.
+
+typedef void (*UnaryKernel)(double* dst, const double* a, int n);
+typedef void (*BinaryKernel)(double* dst, const double* a, const double* b, int n);
+typedef void (*PowiKernel)(double* dst, const double* a, int exponent, int n);
+
+// One implementation of every kernel, for one instruction set.
+typedef struct {
+	const char* name;
+
+	BinaryKernel add;
+	BinaryKernel sub;
+	BinaryKernel mul;
+	BinaryKernel div;
+	BinaryKernel pow;
+	PowiKernel powi;
+	UnaryKernel sqrt;
+	UnaryKernel sin;
+	UnaryKernel cos;
+	UnaryKernel tan;
+	UnaryKernel exp;
+	UnaryKernel log;
+} KernelTable;
+
+const KernelTable* kernelTable(void);
+const KernelTable* kernelTableByName(const char* name);
+
+void batchFill(double* dst, double value, int n);
+void batchNeg(double* dst, const double* a, int n);
+void batchAdd(double* dst, const double* a, const double* b, int n);
+void batchSub(double* dst, const double* a, const double* b, int n);
+void batchMul(double* dst, const double* a, const double* b, int n);
+void batchDiv(double* dst, const double* a, const double* b, int n);
+void batchPow(double* dst, const double* a, const double* b, int n);
+void batchPowi(double* dst, const double* a, int exponent, int n);
+void batchSqrt(double* dst, const double* a, int n);
+void batchSin(double* dst, const double* a, int n);
+void batchCos(double* dst, const double* a, int n);
+void batchTan(double* dst, const double* a, int n);
+void batchExp(double* dst, const double* a, int n);
+void batchLog(double* dst, const double* a, int n);
+
+
+// Function definitions:
+
+void batchFill(double* dst, double value, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = value;
+	}
+}
+
+void batchNeg(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = -a[i];
+	}
+}
+
+void batchAdd(double* dst, const double* a, const double* b, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = a[i] + b[i];
+	}
+}
+
+void batchSub(double* dst, const double* a, const double* b, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = a[i] - b[i];
+	}
+}
+
+void batchMul(double* dst, const double* a, const double* b, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = a[i] * b[i];
+	}
+}
+
+void batchDiv(double* dst, const double* a, const double* b, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = a[i] / b[i];
+	}
+}
+
+void batchPow(double* dst, const double* a, const double* b, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = pow(a[i], b[i]);
+	}
+}
+
+void batchPowi(double* dst, const double* a, int exponent, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = applyPowi(a[i], exponent);
+	}
+}
+
+void batchSqrt(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = sqrt(a[i]);
+	}
+}
+
+void batchSin(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = sin(a[i]);
+	}
+}
+
+void batchCos(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = cos(a[i]);
+	}
+}
+
+void batchTan(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = tan(a[i]);
+	}
+}
+
+void batchExp(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = exp(a[i]);
+	}
+}
+
+void batchLog(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; ++i) {
+		dst[i] = log(a[i]);
+	}
+}
+
+// Vector kernels, see simd.h. exp and log have no vector version and use
+// the scalar kernels in every table.
+#if SIMD_X86
+
+#define SIMD_SUFFIX Sse2
+#define SIMD_WIDTH 2
+#define SIMD_TARGET __attribute__((target("sse2")))
+#define SIMD_SQRT(v) ((VEC)_mm_sqrt_pd((__m128d)(v)))
+#include "simd.h"
+#undef SIMD_SUFFIX
+#undef SIMD_WIDTH
+#undef SIMD_TARGET
+#undef SIMD_SQRT
+
+#define SIMD_SUFFIX Avx2
+#define SIMD_WIDTH 4
+#define SIMD_TARGET __attribute__((target("avx2")))
+#define SIMD_SQRT(v) ((VEC)_mm256_sqrt_pd((__m256d)(v)))
+#include "simd.h"
+#undef SIMD_SUFFIX
+#undef SIMD_WIDTH
+#undef SIMD_TARGET
+#undef SIMD_SQRT
+
+#endif
+
+const KernelTable scalarKernels = {
+	"scalar", batchAdd, batchSub, batchMul, batchDiv, batchPow, batchPowi,
+	batchSqrt, batchSin, batchCos, batchTan, batchExp, batchLog
+};
+
+#if SIMD_X86
+const KernelTable sse2Kernels = {
+	"sse2", batchAddSse2, batchSubSse2, batchMulSse2, batchDivSse2,
+	batchPowSse2, batchPowiSse2, batchSqrtSse2, batchSinSse2, batchCosSse2, batchTanSse2,
+	batchExp, batchLog
+};
+
+const KernelTable avx2Kernels = {
+	"avx2", batchAddAvx2, batchSubAvx2, batchMulAvx2, batchDivAvx2,
+	batchPowAvx2, batchPowiAvx2, batchSqrtAvx2, batchSinAvx2, batchCosAvx2, batchTanAvx2,
+	batchExp, batchLog
+};
+#endif
+
+// Returns the kernels for the given instruction set, or NULL if this CPU or
+// build cannot run them.
+const KernelTable* kernelTableByName(const char* name) {
+	if(strcmp(name, "scalar") == 0) {
+		return &scalarKernels;
+	}
+
+#if SIMD_X86
+	if(strcmp(name, "sse2") == 0) {
+		return &sse2Kernels;
+	} else if(strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		return &avx2Kernels;
+	}
+#endif
+
+	return NULL;
+}
+
+// Returns the widest kernels this CPU supports. CALC_KERNELS in the
+// environment can force scalar, sse2 or avx2.
+const KernelTable* kernelTable(void) {
+	const char* forced = getenv("CALC_KERNELS");
+
+	if(forced != NULL && kernelTableByName(forced) != NULL) {
+		return kernelTableByName(forced);
+	}
+
+#if SIMD_X86
+	if(__builtin_cpu_supports("avx2")) {
+		return &avx2Kernels;
+	}
+
+	return &sse2Kernels;
+#else
+	return &scalarKernels;
+#endif
+}
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "status.h"
+#include "program.h"
+#include "names.h"
+#include "../Memory/arena.h"
+
+typedef enum {
+	unknown,
+	digit,
+	decimalSep,
+	operator,
+	lbracket,
+	rbracket,
+	constant,
+	function,
+	whitespace,
+	EOL,
+	number,
+	variable
+} TokenType;
+
+// A token refers back into the input by offset and length, so nothing is
+// copied. Numbers and constants carry their value; constants also carry
+// their ConstantCode, operators and functions their OpCode, and variables
+// their slot, in code.
+typedef struct {
+	TokenType kind;
+	int code;
+	int offset;
+	int length;
+	double value;
+} Token;
+
+// Tokens of one expression, terminated by an EOL token.
+typedef struct {
+	const char* input;
+	Token* tokens;
+	int size;
+
+	// Offset and length of the offending token when lexing fails.
+	int errorOffset;
+	int errorLength;
+} TokenArray;
+
+Status lexExpression(const char* input, size_t length, const NameTable* names,
+		Arena* arena, TokenArray* tokenArray);
+double parseNumber(const char* text, int length, Arena* arena);
+TokenType charType(char character);
+int operatorCode(char operator);
+
+
+// Function definitions:
+
+// Splits length bytes of input into tokens, stopping early at a newline.
+// Identifiers are resolved through the name table. The token array is taken
+// from the arena in one piece, sized for the worst case of one token per
+// character.
+// Returns the status of the split.
+Status lexExpression(const char* input, size_t length, const NameTable* names,
+		Arena* arena, TokenArray* tokenArray) {
+	Token* tokens = arenaAlloc(arena, (length + 1) * sizeof(Token));
+	int lbracketCount = 0, rbracketCount = 0, operandCount = 0, opCount = 0;
+	int exprPos = 0;
+	size_t i = 0;
+
+	tokenArray->input = input;
+	tokenArray->tokens = tokens;
+	tokenArray->size = 0;
+	tokenArray->errorOffset = -1;
+	tokenArray->errorLength = 0;
+
+	while(i < length && charType(input[i]) != EOL) {
+		char character = input[i];
+		TokenType tokenGroup = charType(character);
+		Token* token = &tokens[exprPos];
+
+		// Ignore spaces, and tabs.
+		if(tokenGroup == whitespace) {
+			++i;
+			continue;
+		}
+
+		token->offset = i;
+		token->code = -1;
+		token->value = 0;
+
+		// Is the character a positive (+) or negative (-) sign.
+		int isSign = 0;
+
+		if(tokenGroup == operator && (character == '+' || character == '-')
+				&& i + 1 < length && charType(input[i + 1]) == digit) {
+			if(i == 0 || charType(input[i - 1]) == lbracket
+					|| charType(input[i - 1]) == operator) {
+				isSign = 1;
+			}
+		}
+
+		if(tokenGroup == digit || tokenGroup == decimalSep || isSign) {
+			int digitCount = 0, sepCount = 0;
+			size_t numEnd = i;
+
+			// The positive sign is assumed, the negative one is kept.
+			if(character == '+') {
+				token->offset = ++i;
+				numEnd = i;
+			} else if(character == '-') {
+				++numEnd;
+			}
+
+			// Find the end of the number, tracking digits and decimal
+			// points.
+			while(numEnd < length && (charType(input[numEnd]) == digit
+					|| charType(input[numEnd]) == decimalSep)) {
+				(charType(input[numEnd]) == digit) ? ++digitCount : ++sepCount;
+				++numEnd;
+			}
+
+			if(sepCount > 1) {
+				return extraDecimalSep;
+			} else if(digitCount == 0) {
+				return noDigit;
+			}
+
+			token->kind = number;
+			token->length = numEnd - i;
+			token->value = parseNumber(input + i, token->length, arena);
+			++operandCount;
+			i = numEnd;
+
+		// Handle brackets and operators.
+		} else if(tokenGroup == lbracket || tokenGroup == rbracket
+				|| tokenGroup == operator) {
+			if(tokenGroup == lbracket) {
+				++lbracketCount;
+			} else if(tokenGroup == rbracket) {
+				++rbracketCount;
+			} else {
+				token->code = operatorCode(character);
+				++opCount;
+			}
+
+			token->kind = tokenGroup;
+			token->length = 1;
+			++i;
+
+		// Identifiers are matched whole, so a name is never mistaken for
+		// a prefix of a longer one.
+		} else if(isIdentifierStart(character)) {
+			size_t nameEnd = i + 1;
+
+			while(nameEnd < length && isIdentifierChar(input[nameEnd])) {
+				++nameEnd;
+			}
+
+			const NameEntry* entry = nameTableFind(names, input + i, nameEnd - i);
+
+			if(entry == NULL) {
+				tokenArray->errorOffset = i;
+				tokenArray->errorLength = nameEnd - i;
+				return unknownToken;
+			}
+
+			switch(entry->kind) {
+				case constantName:
+					token->kind = constant;
+					token->code = entry->code;
+					token->value = entry->value;
+					++operandCount;
+					break;
+				case variableName:
+					token->kind = variable;
+					token->code = entry->code;
+					++operandCount;
+					break;
+				case functionName:
+					token->kind = function;
+					token->code = entry->code;
+					++opCount;
+					break;
+			}
+
+			token->length = nameEnd - i;
+			i = nameEnd;
+
+		} else {
+			tokenArray->errorOffset = i;
+			tokenArray->errorLength = 1;
+			return unknownToken;
+		}
+
+		++exprPos;
+	}
+
+	tokens[exprPos].kind = EOL;
+	tokens[exprPos].offset = i;
+	tokens[exprPos].length = 0;
+	tokenArray->size = exprPos;
+
+	if(lbracketCount != rbracketCount) {
+		return unpairedBracket;
+	} else if(operandCount == 0 && exprPos != 0) {
+		return noDigit;
+	} else if(opCount == 0 && exprPos > 1) {
+		return noOperator;
+	}
+
+	return success;
+}
+
+// Converts the text of a number token. Short numbers are copied to the
+// stack to terminate them, as the input need not be.
+double parseNumber(const char* text, int length, Arena* arena) {
+	char buffer[64];
+	char* copy = (length < (int)sizeof(buffer)) ? buffer : arenaAlloc(arena, length + 1);
+
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+
+	return strtod(copy, NULL);
+}
+
+// Returns the classification of a single character.
+TokenType charType(char character) {
+	switch(character) {
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			return digit;
+		case '.':
+			return decimalSep;
+		case '+':
+		case '-':
+		case '*':
+		case '/':
+		case '^':
+			return operator;
+		case '(':
+			return lbracket;
+		case ')':
+			return rbracket;
+		case ' ':
+		case '\t':
+		case '\r':
+			return whitespace;
+		case '\n':
+		case '\0':
+			return EOL;
+		default:
+			return unknown;
+	}
+}
+
+// Returns the operation for an operator character.
+int operatorCode(char operator) {
+	switch(operator) {
+		case '+':
+			return opAdd;
+		case '-':
+			return opSub;
+		case '*':
+			return opMul;
+		case '/':
+			return opDiv;
+		case '^':
+			return opPow;
+		default:
+			return -1;
+	}
+}
+
+#endif
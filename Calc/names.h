@@ -0,0 +1,215 @@
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "program.h"
+
+#define E               2.7182818284590452354
+#define PI              3.1415926535897932384
+
+// Codes of the built-in constants, for backends that work them out to more
+// digits than a double holds.
+typedef enum {
+	constPi,
+	constE
+} ConstantCode;
+
+// Kinds of named things an identifier can resolve to.
+typedef enum {
+	constantName,
+	functionName,
+	variableName
+} NameKind;
+
+// A named constant, function or variable. Constants carry their
+// ConstantCode, functions their OpCode and variables their slot in code.
+typedef struct {
+	char* name;
+	int length;
+	NameKind kind;
+	int code;
+	double value;
+} NameEntry;
+
+// Open addressing hash table of identifiers. A lookup hashes the identifier
+// once and probes an expected constant number of slots however many names
+// are registered.
+typedef struct {
+	NameEntry* entries;
+	int capacity;
+	int size;
+} NameTable;
+
+typedef struct {
+	const char* name;
+	NameKind kind;
+	int code;
+	double value;
+} BuiltinName;
+
+const BuiltinName builtinNames[] = {
+	{ "pi", constantName, constPi, PI },
+	{ "e", constantName, constE, E },
+	{ "ans", variableName, ANS_SLOT, 0 },
+	{ "sqrt", functionName, opSqrt, 0 },
+	{ "sin", functionName, opSin, 0 },
+	{ "cos", functionName, opCos, 0 },
+	{ "tan", functionName, opTan, 0 },
+	{ "exp", functionName, opExp, 0 },
+	{ "log", functionName, opLog, 0 }
+};
+
+#define isIdentifierStart(c) (((c) >= 'a' && (c) <= 'z') \
+		|| ((c) >= 'A' && (c) <= 'Z') || (c) == '_')
+#define isIdentifierChar(c) (isIdentifierStart(c) || ((c) >= '0' && (c) <= '9'))
+
+NameTable* nameTableCreate(void);
+uint32_t nameHash(const char* name, int length);
+int nameTableAdd(NameTable* table, const char* name, int length, NameKind kind,
+		int code, double value);
+const NameEntry* nameTableFind(const NameTable* table, const char* name,
+		int length);
+void nameTableDestroy(NameTable* table);
+
+
+// Function definitions:
+
+// Creates a table holding the built-in constants and functions.
+NameTable* nameTableCreate(void) {
+	NameTable* table = malloc(sizeof(NameTable));
+
+	if(table == NULL) {
+		fprintf(stderr, "Allocation of name table failed.\n");
+		exit(1);
+	}
+
+	table->capacity = 32;
+	table->size = 0;
+	table->entries = calloc(table->capacity, sizeof(NameEntry));
+
+	if(table->entries == NULL) {
+		fprintf(stderr, "Allocation of name table failed.\n");
+		exit(1);
+	}
+
+	for(size_t i = 0; i < sizeof(builtinNames) / sizeof(BuiltinName); ++i) {
+		nameTableAdd(table, builtinNames[i].name, strlen(builtinNames[i].name),
+				builtinNames[i].kind, builtinNames[i].code,
+				builtinNames[i].value);
+	}
+
+	return table;
+}
+
+// FNV-1a hash of an identifier.
+uint32_t nameHash(const char* name, int length) {
+	uint32_t hash = 2166136261u;
+
+	for(int i = 0; i < length; ++i) {
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+// Adds a name to the table, replacing any entry of the same name.
+// Returns 0 on success.
+int nameTableAdd(NameTable* table, const char* name, int length, NameKind kind,
+		int code, double value) {
+	// Keep the table at most half full so probe sequences stay short.
+	if(2 * (table->size + 1) > table->capacity) {
+		NameEntry* oldEntries = table->entries;
+		int oldCapacity = table->capacity;
+
+		table->capacity *= 2;
+		table->entries = calloc(table->capacity, sizeof(NameEntry));
+
+		if(table->entries == NULL) {
+			fprintf(stderr, "Allocation of name table failed.\n");
+			exit(1);
+		}
+
+		for(int i = 0; i < oldCapacity; ++i) {
+			if(oldEntries[i].name != NULL) {
+				uint32_t slot = nameHash(oldEntries[i].name, oldEntries[i].length);
+
+				slot &= table->capacity - 1;
+
+				while(table->entries[slot].name != NULL) {
+					slot = (slot + 1) & (table->capacity - 1);
+				}
+
+				table->entries[slot] = oldEntries[i];
+			}
+		}
+
+		free(oldEntries);
+	}
+
+	uint32_t slot = nameHash(name, length) & (table->capacity - 1);
+
+	while(table->entries[slot].name != NULL) {
+		NameEntry* entry = &table->entries[slot];
+
+		if(entry->length == length && memcmp(entry->name, name, length) == 0) {
+			entry->kind = kind;
+			entry->code = code;
+			entry->value = value;
+			return 0;
+		}
+
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+
+	NameEntry* entry = &table->entries[slot];
+	entry->name = malloc(length + 1);
+
+	if(entry->name == NULL) {
+		fprintf(stderr, "Allocation of name failed.\n");
+		exit(1);
+	}
+
+	memcpy(entry->name, name, length);
+	entry->name[length] = '\0';
+	entry->length = length;
+	entry->kind = kind;
+	entry->code = code;
+	entry->value = value;
+	++(table->size);
+
+	return 0;
+}
+
+// Looks up an identifier of the given length, which need not be terminated.
+// Returns the entry, or NULL if the name is unknown.
+const NameEntry* nameTableFind(const NameTable* table, const char* name,
+		int length) {
+	uint32_t slot = nameHash(name, length) & (table->capacity - 1);
+
+	while(table->entries[slot].name != NULL) {
+		const NameEntry* entry = &table->entries[slot];
+
+		if(entry->length == length && memcmp(entry->name, name, length) == 0) {
+			return entry;
+		}
+
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+
+	return NULL;
+}
+
+void nameTableDestroy(NameTable* table) {
+	for(int i = 0; i < table->capacity; ++i) {
+		free(table->entries[i].name);
+	}
+
+	free(table->entries);
+	free(table);
+}
+
+#endif
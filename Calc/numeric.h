@@ -0,0 +1,297 @@
+#ifndef NUMERIC_H
+#define NUMERIC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "status.h"
+#include "program.h"
+#include "names.h"
+#include "lexer.h"
+#include "tree.h"
+#include "bignum.h"
+#include "../Memory/arena.h"
+#include "../Lists/Stacks/arraystack.h"
+
+typedef struct _Numeric Numeric;
+
+// Operations of a numeric backend. The evaluator treats values as size
+// opaque bytes, and leaves everything else to the backend: numbers are read
+// from their text rather than the double the lexer made of them, and
+// constants by their ConstantCode.
+typedef struct {
+	const char* name;
+	size_t size;
+
+	void (*init)(Numeric* numeric);
+	Status (*fromText)(Numeric* numeric, void* value, const char* text,
+			int length);
+	Status (*fromDouble)(Numeric* numeric, void* value, double x);
+	void (*constant)(Numeric* numeric, void* value, int code);
+
+	// Applies an operation or function, OpCode op with instruction argument
+	// arg, to left and right, which is NULL for one operand. The result may
+	// be written over left.
+	Status (*apply)(Numeric* numeric, OpCode op, int arg, void* result,
+			const void* left, const void* right);
+
+	double (*toDouble)(Numeric* numeric, const void* value);
+
+	// Writes a value to the given significant digits, as snprintf() does.
+	size_t (*format)(Numeric* numeric, const void* value, int digits,
+			char* buffer, size_t size);
+
+	// Returns the significant digits the backend holds, beyond those asked
+	// for, so a value formatted to them reads back unchanged.
+	int (*workingDigits)(const Numeric* numeric);
+} NumericType;
+
+// A backend in use: its operations, the arena its values and their state
+// come from, and the significant digits it works to.
+struct _Numeric {
+	const NumericType* type;
+	Arena* arena;
+	int digits;
+	void* state;
+};
+
+// State of the arbitrary precision backend: its precision in limbs, and pi
+// and e once worked out, to the limbs given.
+typedef struct {
+	int precision;
+	BigNum pi;
+	int piPrecision;
+	BigNum e;
+} BigState;
+
+void numericInit(Numeric* numeric, const NumericType* type, Arena* arena,
+		int digits);
+Status numericEval(Numeric* numeric, const TokenArray* tokenArray,
+		const Node* root, const double* vars, const void* ans, void* result);
+void bigInit(Numeric* numeric);
+Status bigNumericFromText(Numeric* numeric, void* value, const char* text,
+		int length);
+Status bigNumericFromDouble(Numeric* numeric, void* value, double x);
+void bigConstant(Numeric* numeric, void* value, int code);
+const BigNum* bigNumericPi(Numeric* numeric, int precision);
+Status bigApply(Numeric* numeric, OpCode op, int arg, void* result,
+		const void* left, const void* right);
+double bigNumericToDouble(Numeric* numeric, const void* value);
+size_t bigNumericFormat(Numeric* numeric, const void* value, int digits,
+		char* buffer, size_t size);
+int bigWorkingDigits(const Numeric* numeric);
+
+// Decimal arithmetic to any number of digits.
+const NumericType bigNumeric = {
+	"big", sizeof(BigNum), bigInit, bigNumericFromText, bigNumericFromDouble,
+	bigConstant, bigApply, bigNumericToDouble, bigNumericFormat,
+	bigWorkingDigits
+};
+
+
+// Function definitions:
+
+void numericInit(Numeric* numeric, const NumericType* type, Arena* arena,
+		int digits) {
+	numeric->type = type;
+	numeric->arena = arena;
+	numeric->digits = digits;
+	numeric->state = NULL;
+	type->init(numeric);
+}
+
+// Evaluates a tree straight from the parser on a backend, with the values
+// on a stack of the backend's size. The tree is not optimised, as folding
+// would work in doubles, so its constants are exactly the number and
+// constant tokens, and a postorder walk meets them in token order. ans is
+// the backend's own previous answer, or NULL to read it from vars like any
+// other variable.
+// Returns the status of the evaluation.
+Status numericEval(Numeric* numeric, const TokenArray* tokenArray,
+		const Node* root, const double* vars, const void* ans, void* result) {
+	const NumericType* type = numeric->type;
+	ValueStack stack;
+	Status status = success;
+	int count, next = 0;
+	Node** order = treePostorder((Node*)root, numeric->arena, &count);
+
+	valueStackInit(&stack, numeric->arena, type->size, 16);
+
+	for(int i = 0; i < count && status == success; ++i) {
+		const Node* node = order[i];
+		const Token* token;
+		void* right;
+		void* top;
+
+		switch(node->op) {
+			case opConst:
+				do {
+					token = &tokenArray->tokens[next++];
+				} while(token->kind != number && token->kind != constant);
+
+				top = valueStackPush(&stack);
+
+				if(token->kind == number) {
+					status = type->fromText(numeric, top,
+							tokenArray->input + token->offset, token->length);
+				} else {
+					type->constant(numeric, top, token->code);
+				}
+
+				break;
+			case opVar:
+				top = valueStackPush(&stack);
+
+				if(node->arg == ANS_SLOT && ans != NULL) {
+					memcpy(top, ans, type->size);
+				} else {
+					status = type->fromDouble(numeric, top, vars[node->arg]);
+				}
+
+				break;
+			default:
+				right = (opArity(node->op) == 2) ? valueStackPop(&stack) : NULL;
+				top = valueStackPeek(&stack);
+				status = type->apply(numeric, node->op, node->arg, top, top, right);
+				break;
+		}
+	}
+
+	if(status == success) {
+		memcpy(result, valueStackPeek(&stack), type->size);
+	}
+
+	return status;
+}
+
+void bigInit(Numeric* numeric) {
+	BigState* state = arenaAlloc(numeric->arena, sizeof(BigState));
+
+	state->precision = (numeric->digits + BIG_DIGITS - 1) / BIG_DIGITS
+			+ BIG_GUARD;
+	state->piPrecision = 0;
+	bigSetZero(&state->e);
+	numeric->state = state;
+}
+
+Status bigNumericFromText(Numeric* numeric, void* value, const char* text,
+		int length) {
+	const BigState* state = numeric->state;
+
+	return bigFromText(value, text, length, state->precision, numeric->arena);
+}
+
+Status bigNumericFromDouble(Numeric* numeric, void* value, double x) {
+	const BigState* state = numeric->state;
+
+	return bigFromDouble(value, x, state->precision, numeric->arena);
+}
+
+// Works pi and e out the first time they are used.
+void bigConstant(Numeric* numeric, void* value, int code) {
+	BigState* state = numeric->state;
+
+	if(code == constPi) {
+		bigCopy(value, bigNumericPi(numeric, state->precision),
+				state->precision, numeric->arena);
+		return;
+	}
+
+	if(isBigZero(&state->e)) {
+		BigNum one;
+
+		bigSetSmall(&one, 1, 1, numeric->arena);
+		bigExp(&state->e, &one, state->precision, numeric->arena);
+	}
+
+	*(BigNum*)value = state->e;
+}
+
+// Returns pi to at least the given limbs, reducing large arguments of sin()
+// and cos() needing more than the rest of the evaluation.
+const BigNum* bigNumericPi(Numeric* numeric, int precision) {
+	BigState* state = numeric->state;
+
+	if(state->piPrecision < precision) {
+		bigPi(&state->pi, precision, numeric->arena);
+		state->piPrecision = precision;
+	}
+
+	return &state->pi;
+}
+
+Status bigApply(Numeric* numeric, OpCode op, int arg, void* result,
+		const void* left, const void* right) {
+	const BigState* state = numeric->state;
+	int precision = state->precision;
+	Arena* arena = numeric->arena;
+	BigNum sine, cosine;
+
+	switch(op) {
+		case opAdd:
+			bigAdd(result, left, right, precision, arena);
+			return success;
+		case opSub:
+			bigSub(result, left, right, precision, arena);
+			return success;
+		case opMul:
+			bigMul(result, left, right, precision, arena);
+			return success;
+		case opDiv:
+			return bigDiv(result, left, right, precision, arena);
+		case opPow:
+			return bigPow(result, left, right, precision, arena);
+		case opPowi:
+			return bigPowi(result, left, arg, precision, arena);
+		case opNeg:
+			bigNegate(result, left);
+			return success;
+		case opSqrt:
+			return bigSqrt(result, left, precision, arena);
+		case opExp:
+			return bigExp(result, left, precision, arena);
+		case opLog:
+			return bigLog(result, left, precision, arena);
+		case opSin:
+		case opCos:
+		case opTan: {
+			const BigNum* x = left;
+			int top = (getBigTop(x) > 0) ? getBigTop(x) : 0;
+
+			bigSinCos(&sine, &cosine, x,
+					bigNumericPi(numeric, precision + BIG_GUARD + top),
+					precision, arena);
+
+			if(op == opSin) {
+				*(BigNum*)result = sine;
+				return success;
+			} else if(op == opCos) {
+				*(BigNum*)result = cosine;
+				return success;
+			}
+
+			return bigDiv(result, &sine, &cosine, precision, arena);
+		}
+		default:
+			return evalFail;
+	}
+}
+
+double bigNumericToDouble(Numeric* numeric, const void* value) {
+	return bigToDouble(value, numeric->arena);
+}
+
+size_t bigNumericFormat(Numeric* numeric, const void* value, int digits,
+		char* buffer, size_t size) {
+	return bigFormat(value, digits, buffer, size, numeric->arena);
+}
+
+int bigWorkingDigits(const Numeric* numeric) {
+	const BigState* state = numeric->state;
+
+	return state->precision * BIG_DIGITS;
+}
+
+#endif
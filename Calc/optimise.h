@@ -0,0 +1,133 @@
+#ifndef OPTIMISE_H
+#define OPTIMISE_H
+
+#include <math.h>
+
+#include "program.h"
+#include "tree.h"
+#include "../Memory/arena.h"
+
+// Rewrites applied to a tree before it is emitted. Each gives the result
+// evaluating the original tree would, to the bit, except where noted:
+//   Constant subtrees are folded with the same functions evaluation uses.
+//   A division by a constant zero is left for evaluation to report.
+//   x*1, 1*x, x/1, x-0 and x^1 become x, and -(-x) becomes x.
+//   x+0 and 0+x become x, which turns a result of 0 from x = -0 into -0.
+//   x^n for an integer |n| <= POWI_LIMIT becomes a chain of
+//   multiplications, within about |n| ulp of pow() and exact for n = 2
+//   while x^|n| is a normal double. A negative power is 1/x^|n|, so once
+//   x^|n| overflows or falls into the subnormals it is 0, infinite or
+//   imprecise where pow() is not: (1e39)^-8 is 0, not 1e-312.
+
+void optimiseTree(Node* root, Arena* arena);
+void optimiseNode(Node* node);
+void replaceNode(Node* node, const Node* replacement);
+void foldNode(Node* node, double value);
+
+
+// Function definitions:
+
+// Optimises a tree in place, operands before the operations using them.
+void optimiseTree(Node* root, Arena* arena) {
+	int count;
+	Node** order = treePostorder(root, arena, &count);
+
+	for(int i = 0; i < count; ++i) {
+		optimiseNode(order[i]);
+	}
+}
+
+// Optimises one node whose operands are already optimised.
+void optimiseNode(Node* node) {
+	Node* left = node->left;
+	Node* right = node->right;
+
+	switch(opArity(node->op)) {
+		case 0:
+			return;
+		case 1:
+			if(isConstantNode(left)) {
+				if(node->op == opNeg) {
+					foldNode(node, -left->value);
+				} else if(node->op == opPowi) {
+					foldNode(node, applyPowi(left->value, node->arg));
+				} else {
+					foldNode(node, applyFunction(node->op, left->value));
+				}
+			} else if(node->op == opNeg && left->op == opNeg) {
+				replaceNode(node, left->left);
+			}
+
+			return;
+		default:
+			break;
+	}
+
+	if(isConstantNode(left) && isConstantNode(right)
+			&& !(node->op == opDiv && right->value == 0)) {
+		foldNode(node, applyOperation(node->op, left->value, right->value));
+		return;
+	}
+
+	switch(node->op) {
+		case opAdd:
+			if(isValueNode(right, 0)) {
+				replaceNode(node, left);
+			} else if(isValueNode(left, 0)) {
+				replaceNode(node, right);
+			}
+
+			break;
+		case opSub:
+			if(isValueNode(right, 0)) {
+				replaceNode(node, left);
+			}
+
+			break;
+		case opMul:
+			if(isValueNode(right, 1)) {
+				replaceNode(node, left);
+			} else if(isValueNode(left, 1)) {
+				replaceNode(node, right);
+			}
+
+			break;
+		case opDiv:
+			if(isValueNode(right, 1)) {
+				replaceNode(node, left);
+			}
+
+			break;
+		case opPow:
+			if(isValueNode(right, 1)) {
+				replaceNode(node, left);
+			} else if(isConstantNode(right) && fabs(right->value) <= POWI_LIMIT
+					&& right->value == (int)right->value) {
+				// An exponent of 0 still evaluates the base, so a division
+				// by zero in it is reported.
+				node->op = opPowi;
+				node->arg = (int)right->value;
+				node->right = NULL;
+			}
+
+			break;
+		default:
+			break;
+	}
+}
+
+// Turns a node into a copy of another, so whatever refers to the node now
+// refers to the replacement.
+void replaceNode(Node* node, const Node* replacement) {
+	*node = *replacement;
+}
+
+// Turns a node into a constant.
+void foldNode(Node* node, double value) {
+	node->op = opConst;
+	node->value = value;
+	node->left = NULL;
+	node->right = NULL;
+}
+
+#endif
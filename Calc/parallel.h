@@ -0,0 +1,791 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "status.h"
+#include "program.h"
+#include "../Memory/arena.h"
+
+// Least cost, as summed by opCost(), of a subexpression handed to another
+// thread: about a thousand calls of sin(), enough to outweigh waking a
+// worker for it.
+#define PARALLEL_GRAIN  20000
+
+// Least cost of a program before it is split at all.
+#define PARALLEL_MIN    (4 * PARALLEL_GRAIN)
+
+// Size of the chunks of a plan's arena.
+#define PARALLEL_ARENA  1024
+
+// A subexpression evaluated as one unit. In postfix each subtree is a
+// contiguous run of instructions, from start to end inclusive, so a task is
+// one such run less the runs of the tasks nested in it, its children, whose
+// results it takes rather than evaluates.
+//
+// A long sum or product is a spine of operations, each taking the value so
+// far on its left and a term on its right. A task may instead be a run of
+// consecutive terms of a spine, with the operations between them, which it
+// gives a value each for rather than applying; its parent then folds them
+// into its value in order, so every operation still sees the same operands.
+typedef struct {
+	int start;
+	int end;
+
+	int* children;
+	int childCount;
+
+	// The spine's operations, in order, for a run of terms, and NULL for a
+	// subexpression. Its values, one per operation or one for a
+	// subexpression, start at first in the job's results.
+	int* folds;
+	int foldCount;
+	int first;
+
+	// Tasks that cannot start until this one is done: its parent, and any
+	// task loading a temporary this one stores.
+	int* dependents;
+	int dependentCount;
+	int dependencies;
+} ParallelTask;
+
+// Split of a program into tasks, the whole program last, with every part
+// of it in an arena of its own.
+typedef struct {
+	ParallelTask* tasks;
+	int taskCount;
+	int valueCount;
+	Arena* arena;
+} ParallelPlan;
+
+// Plan of a program evaluated many times, made on its first evaluation
+// with a pool, and NULL if the program is not worth splitting.
+typedef struct {
+	ParallelPlan* plan;
+	int planned;
+} ParallelState;
+
+// One evaluation of a program over a plan.
+typedef struct {
+	const Program* program;
+	const ParallelPlan* plan;
+	const double* vars;
+
+	// Temporaries, each stored by one task and only loaded by tasks that
+	// depend on it, the values of each task, and the dependencies each is
+	// still waiting on.
+	double* temps;
+	double* results;
+	int* waiting;
+
+	// An evaluation stack for each thread.
+	double* stacks;
+
+	int remaining;
+	Status status;
+} ParallelJob;
+
+// A worker's tasks. The worker takes the newest, whose inputs it has just
+// made, and a thief the oldest.
+typedef struct {
+	int* tasks;
+	int top;
+	int bottom;
+} ParallelDeque;
+
+typedef struct _ParallelPool ParallelPool;
+
+// A worker thread's pool and index.
+typedef struct {
+	ParallelPool* pool;
+	int self;
+} ParallelWorker;
+
+// Threads evaluating the tasks of one job at a time, alongside the thread
+// that submits it, which is worker 0. Tasks are at least PARALLEL_GRAIN
+// long, so the deques share the pool's lock rather than having their own.
+struct _ParallelPool {
+	int threadCount;
+	pthread_t* threads;
+	ParallelWorker* workers;
+	ParallelDeque* deques;
+
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+
+	// The job being run, or NULL, and the workers inside it.
+	ParallelJob* job;
+	int active;
+	int stopping;
+};
+
+ParallelPlan* parallelPlan(const Program* program, Arena* scratch);
+int parallelMarkTask(ParallelTask* tasks, int taskCount, int* owner,
+		int start, int end);
+void parallelMarkRun(ParallelPlan* plan, int* owner, const int* previous,
+		int start, int end);
+void parallelLink(ParallelPlan* plan, const Program* program, int* owner,
+		Arena* scratch);
+const ParallelPlan* parallelStatePlan(ParallelState* state,
+		const Program* program, Arena* scratch);
+void parallelStateReset(ParallelState* state);
+void parallelPlanDestroy(ParallelPlan* plan);
+ParallelPool* parallelPoolCreate(int threadCount);
+void* parallelWorker(void* arg);
+Status parallelEval(ParallelPool* pool, const Program* program,
+		const ParallelPlan* plan, const double* vars, Arena* arena,
+		double* result);
+void parallelWork(ParallelPool* pool, ParallelJob* job, int self);
+int parallelTake(ParallelPool* pool, int self);
+void parallelPush(ParallelPool* pool, int self, int task);
+Status parallelRunTask(const ParallelJob* job, int task, double* stack);
+void parallelPoolDestroy(ParallelPool* pool);
+
+
+// Function definitions:
+
+// Splits a program into tasks. Walking the code as the evaluator does,
+// every subtree is costed, less the tasks already cut from it, and is cut
+// out as a task of its own once that reaches PARALLEL_GRAIN. The terms of a
+// spine are costed apart from it, and a run of them is cut out the same way,
+// so a flat sum of many small terms splits into runs that can all be
+// evaluated at once, where its subtrees would only give a chain of tasks
+// each waiting on the last.
+//
+// A temporary is stored once and loaded by later subtrees, and a subtree
+// loading one must wait for the task storing it. That task must not be one
+// of the subtree's own ancestors, which would be waiting on it in turn, so
+// a subtree or run is only cut if every temporary it loads is stored inside
+// it or inside a task already cut, which ends before it begins.
+// Returns the plan, or NULL if the program is not worth splitting. Only the
+// scratch memory of planning comes from scratch.
+ParallelPlan* parallelPlan(const Program* program, Arena* scratch) {
+	if(program->cost < PARALLEL_MIN) {
+		return NULL;
+	}
+
+	int size = program->codeSize;
+	int* starts = arenaAlloc(scratch, size * sizeof(int));
+	long* costs = arenaAlloc(scratch, size * sizeof(long));
+	// Lowest instruction storing a temporary loaded in the subtree and not
+	// yet in a task, or INT_MAX.
+	int* loads = arenaAlloc(scratch, size * sizeof(int));
+	// The run of terms of the subtree's spine not yet in a task, if any: its
+	// first instruction or -1, cost, lowest store loaded as above, and last
+	// operation. Each operation of a run links to the one before it.
+	int* runStarts = arenaAlloc(scratch, size * sizeof(int));
+	long* runCosts = arenaAlloc(scratch, size * sizeof(long));
+	int* runLoads = arenaAlloc(scratch, size * sizeof(int));
+	int* runEnds = arenaAlloc(scratch, size * sizeof(int));
+	int* previous = arenaAlloc(scratch, size * sizeof(int));
+	int* stores = arenaAlloc(scratch, (program->tempCount + 1) * sizeof(int));
+	int* owner = arenaAlloc(scratch, size * sizeof(int));
+	Arena* arena = arenaCreate(PARALLEL_ARENA);
+	ParallelPlan* plan = arenaAlloc(arena, sizeof(ParallelPlan));
+	int depth = 0;
+
+	// There are fewer tasks than PARALLEL_GRAIN divides the cost into.
+	plan->tasks = arenaAlloc(arena, (program->cost / PARALLEL_GRAIN + 1)
+			* sizeof(ParallelTask));
+	plan->taskCount = 0;
+	plan->arena = arena;
+
+	for(int pc = 0; pc < size; ++pc) {
+		owner[pc] = -1;
+	}
+
+	for(int pc = 0; pc < size; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+		int arity = opArity(instruction->op);
+		int start = pc, load = INT_MAX;
+		int runStart = -1, runLoad = INT_MAX, runEnd = -1;
+		long cost = opCost(instruction->op), runCost = 0;
+
+		if(instruction->op == opStore) {
+			stores[instruction->arg] = pc;
+			arity = 1;
+		} else if(instruction->op == opLoad
+				&& owner[stores[instruction->arg]] < 0) {
+			load = stores[instruction->arg];
+		}
+
+		if(arity == 2) {
+			// The right operand is a term of the left's spine, whatever
+			// spine it has of its own being done with, and is costed with
+			// the operation in the spine's run.
+			int term = depth - 1, left = depth - 2;
+			long termCost = costs[term] + runCosts[term];
+			int termLoad = (loads[term] < runLoads[term])
+					? loads[term] : runLoads[term];
+
+			depth -= 2;
+			start = starts[left];
+			runCost = runCosts[left] + termCost + cost;
+			cost = costs[left];
+			load = loads[left];
+			runStart = (runStarts[left] >= 0) ? runStarts[left] : starts[term];
+			runLoad = (runLoads[left] < termLoad) ? runLoads[left] : termLoad;
+			previous[pc] = (runStarts[left] >= 0) ? runEnds[left] : -1;
+			runEnd = pc;
+		} else {
+			for(int i = 0; i < arity; ++i) {
+				--depth;
+				start = starts[depth];
+				cost += costs[depth] + runCosts[depth];
+				load = (loads[depth] < load) ? loads[depth] : load;
+				load = (runLoads[depth] < load) ? runLoads[depth] : load;
+			}
+		}
+
+		if(runStart >= 0 && runCost >= PARALLEL_GRAIN && runLoad >= runStart) {
+			parallelMarkRun(plan, owner, previous, runStart, pc);
+			runStart = -1;
+			runCost = 0;
+			runLoad = INT_MAX;
+		} else if(runStart >= 0 && pc < size - 1
+				&& program->code[pc + 1].op == opStore) {
+			// The value so far is stored, which a run holding the next
+			// operation could not do, so the run ends with the spine.
+			cost += runCost;
+			load = (runLoad < load) ? runLoad : load;
+			runStart = -1;
+			runCost = 0;
+			runLoad = INT_MAX;
+		}
+
+		// A value about to be stored is cut with its store, so the store is
+		// done by the task making the value. The run of a spine still going
+		// is left for a run task, and counted once the spine is done.
+		if(cost >= PARALLEL_GRAIN && load >= start && runLoad >= start
+				&& pc < size - 1 && program->code[pc + 1].op != opStore) {
+			plan->taskCount = parallelMarkTask(plan->tasks, plan->taskCount,
+					owner, start, pc);
+			cost = 0;
+			runStart = -1;
+			runCost = 0;
+			runLoad = INT_MAX;
+		}
+
+		starts[depth] = start;
+		costs[depth] = cost;
+		loads[depth] = load;
+		runStarts[depth] = runStart;
+		runCosts[depth] = runCost;
+		runLoads[depth] = runLoad;
+		runEnds[depth] = runEnd;
+		++depth;
+	}
+
+	if(plan->taskCount == 0) {
+		arenaDestroy(arena);
+		return NULL;
+	}
+
+	plan->taskCount = parallelMarkTask(plan->tasks, plan->taskCount, owner, 0,
+			size - 1);
+	parallelLink(plan, program, owner, scratch);
+
+	// Tasks each waiting on one other at most form a chain, and none of
+	// them could run alongside another.
+	for(int t = 0; t < plan->taskCount; ++t) {
+		if(plan->tasks[t].dependencies > 1) {
+			return plan;
+		}
+	}
+
+	arenaDestroy(arena);
+	return NULL;
+}
+
+// Adds the task of instructions start to end. Tasks are added in order of
+// their ends, so those already added inside the range are nested in it, and
+// the outermost of them are its children. Every instruction of the range
+// outside them is owned by the new task.
+// Returns the new number of tasks.
+int parallelMarkTask(ParallelTask* tasks, int taskCount, int* owner,
+		int start, int end) {
+	ParallelTask* task = &tasks[taskCount];
+
+	task->start = start;
+	task->end = end;
+	task->children = NULL;
+	task->childCount = 0;
+	task->folds = NULL;
+	task->foldCount = 0;
+	task->first = 0;
+	task->dependents = NULL;
+	task->dependentCount = 0;
+	task->dependencies = 0;
+
+	for(int pc = end; pc >= start; --pc) {
+		if(owner[pc] >= 0) {
+			// Skip the child, counted here and listed by parallelLink().
+			++(task->childCount);
+			pc = tasks[owner[pc]].start;
+		} else {
+			owner[pc] = taskCount;
+		}
+	}
+
+	return taskCount + 1;
+}
+
+// Adds the task of a run of terms from start to the operation at end,
+// listing the operations of the spine from the links in previous.
+void parallelMarkRun(ParallelPlan* plan, int* owner, const int* previous,
+		int start, int end) {
+	ParallelTask* run = &plan->tasks[plan->taskCount];
+	int count = 0;
+
+	plan->taskCount = parallelMarkTask(plan->tasks, plan->taskCount, owner,
+			start, end);
+
+	for(int pc = end; pc >= 0; pc = previous[pc]) {
+		++count;
+	}
+
+	run->folds = arenaAlloc(plan->arena, count * sizeof(int));
+	run->foldCount = count;
+
+	for(int pc = end; pc >= 0; pc = previous[pc]) {
+		run->folds[--count] = pc;
+	}
+}
+
+// Lists each task's children, and the tasks depending on it: its parent,
+// and the tasks loading what it stores. Each task is given the place of its
+// values among the job's results.
+void parallelLink(ParallelPlan* plan, const Program* program, int* owner,
+		Arena* scratch) {
+	Arena* arena = plan->arena;
+	int taskCount = plan->taskCount;
+	// Each task's dependencies, at most its children and one per load.
+	int** from = arenaAlloc(scratch, taskCount * sizeof(int*));
+	int* fromCount = arenaAlloc(scratch, taskCount * sizeof(int));
+	int* stores = arenaAlloc(scratch, (program->tempCount + 1) * sizeof(int));
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		if(program->code[pc].op == opStore) {
+			stores[program->code[pc].arg] = pc;
+		}
+	}
+
+	for(int t = 0; t < taskCount; ++t) {
+		ParallelTask* task = &plan->tasks[t];
+		int loadCount = 0, child = task->childCount;
+
+		// Walked from the end, as in parallelMarkTask(), so the first
+		// instruction met of a nested task is the end of the outermost.
+		task->children = arenaAlloc(arena, (task->childCount + 1) * sizeof(int));
+
+		for(int pc = task->end; pc >= task->start; --pc) {
+			if(owner[pc] != t) {
+				task->children[--child] = owner[pc];
+				pc = plan->tasks[owner[pc]].start;
+			} else if(program->code[pc].op == opLoad) {
+				++loadCount;
+			}
+		}
+
+		from[t] = arenaAlloc(scratch, (task->childCount + loadCount + 1)
+				* sizeof(int));
+		fromCount[t] = 0;
+
+		for(int i = 0; i < task->childCount; ++i) {
+			from[t][fromCount[t]++] = task->children[i];
+		}
+
+		for(int pc = task->end; pc >= task->start; --pc) {
+			if(owner[pc] != t) {
+				pc = plan->tasks[owner[pc]].start;
+			} else if(program->code[pc].op == opLoad) {
+				int storer = owner[stores[program->code[pc].arg]];
+				int seen = (storer == t);
+
+				for(int i = 0; i < fromCount[t] && !seen; ++i) {
+					seen = (from[t][i] == storer);
+				}
+
+				if(!seen) {
+					from[t][fromCount[t]++] = storer;
+				}
+			}
+		}
+
+		task->dependencies = fromCount[t];
+
+		for(int i = 0; i < fromCount[t]; ++i) {
+			++(plan->tasks[from[t][i]].dependentCount);
+		}
+	}
+
+	plan->valueCount = 0;
+
+	for(int t = 0; t < taskCount; ++t) {
+		ParallelTask* task = &plan->tasks[t];
+
+		task->dependents = arenaAlloc(arena,
+				(task->dependentCount + 1) * sizeof(int));
+		task->dependentCount = 0;
+		task->first = plan->valueCount;
+		plan->valueCount += (task->foldCount > 0) ? task->foldCount : 1;
+	}
+
+	for(int t = 0; t < taskCount; ++t) {
+		for(int i = 0; i < fromCount[t]; ++i) {
+			ParallelTask* dependency = &plan->tasks[from[t][i]];
+
+			dependency->dependents[dependency->dependentCount++] = t;
+		}
+	}
+}
+
+// Returns the plan of a program kept in state, planning it the first time.
+const ParallelPlan* parallelStatePlan(ParallelState* state,
+		const Program* program, Arena* scratch) {
+	if(!state->planned) {
+		state->plan = parallelPlan(program, scratch);
+		state->planned = 1;
+	}
+
+	return state->plan;
+}
+
+void parallelStateReset(ParallelState* state) {
+	parallelPlanDestroy(state->plan);
+	state->plan = NULL;
+	state->planned = 0;
+}
+
+void parallelPlanDestroy(ParallelPlan* plan) {
+	if(plan != NULL) {
+		arenaDestroy(plan->arena);
+	}
+}
+
+// Starts threadCount - 1 threads, the caller of parallelEval() making up
+// the rest.
+ParallelPool* parallelPoolCreate(int threadCount) {
+	ParallelPool* pool = malloc(sizeof(ParallelPool));
+
+	if(pool == NULL) {
+		fprintf(stderr, "Allocation of thread pool failed.\n");
+		exit(1);
+	}
+
+	pool->threadCount = threadCount;
+	pool->threads = malloc(threadCount * sizeof(pthread_t));
+	pool->workers = malloc(threadCount * sizeof(ParallelWorker));
+	pool->deques = calloc(threadCount, sizeof(ParallelDeque));
+	pool->job = NULL;
+	pool->active = 0;
+	pool->stopping = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	if(pool->threads == NULL || pool->workers == NULL || pool->deques == NULL) {
+		fprintf(stderr, "Allocation of thread pool failed.\n");
+		exit(1);
+	}
+
+	for(int i = 1; i < threadCount; ++i) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].self = i;
+
+		if(pthread_create(&pool->threads[i], NULL, parallelWorker,
+				&pool->workers[i]) != 0) {
+			fprintf(stderr, "Creation of worker thread failed.\n");
+			exit(1);
+		}
+	}
+
+	return pool;
+}
+
+// Joins each job as it is submitted, until the pool is destroyed.
+void* parallelWorker(void* arg) {
+	ParallelWorker* worker = arg;
+	ParallelPool* pool = worker->pool;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while(!pool->stopping) {
+		ParallelJob* job = pool->job;
+
+		if(job == NULL || job->remaining == 0) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+			continue;
+		}
+
+		++(pool->active);
+		pthread_mutex_unlock(&pool->lock);
+		parallelWork(pool, job, worker->self);
+		pthread_mutex_lock(&pool->lock);
+
+		if(--(pool->active) == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+// Evaluates a program split by parallelPlan() across the pool, giving
+// exactly the result of programEval(): every operation is applied to the
+// same operands, only on another thread. Every buffer comes from the arena
+// before any worker starts, so the workers allocate nothing.
+// Returns the status of the evaluation.
+Status parallelEval(ParallelPool* pool, const Program* program,
+		const ParallelPlan* plan, const double* vars, Arena* arena,
+		double* result) {
+	ParallelJob job;
+
+	job.program = program;
+	job.plan = plan;
+	job.vars = vars;
+	job.temps = arenaAlloc(arena, (program->tempCount + 1) * sizeof(double));
+	job.results = arenaAlloc(arena, plan->valueCount * sizeof(double));
+	job.waiting = arenaAlloc(arena, plan->taskCount * sizeof(int));
+	job.stacks = arenaAlloc(arena,
+			(size_t)pool->threadCount * program->maxDepth * sizeof(double));
+	job.remaining = plan->taskCount;
+	job.status = success;
+
+	pthread_mutex_lock(&pool->lock);
+
+	for(int i = 0; i < pool->threadCount; ++i) {
+		pool->deques[i].tasks = arenaAlloc(arena, plan->taskCount * sizeof(int));
+		pool->deques[i].top = 0;
+		pool->deques[i].bottom = 0;
+	}
+
+	// Tasks needing nothing are dealt out, so every worker starts at once.
+	for(int t = 0, next = 0; t < plan->taskCount; ++t) {
+		job.waiting[t] = plan->tasks[t].dependencies;
+
+		if(job.waiting[t] == 0) {
+			parallelPush(pool, next, t);
+			next = (next + 1) % pool->threadCount;
+		}
+	}
+
+	pool->job = &job;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	parallelWork(pool, &job, 0);
+
+	pthread_mutex_lock(&pool->lock);
+
+	while(pool->active > 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+
+	pool->job = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	if(job.status == success) {
+		*result = job.results[plan->tasks[plan->taskCount - 1].first];
+	}
+
+	return job.status;
+}
+
+// Runs the job's tasks, its own first and then stolen ones, until none are
+// left. Finishing a task readies the tasks waiting on it, which go on the
+// finishing worker's deque.
+void parallelWork(ParallelPool* pool, ParallelJob* job, int self) {
+	double* stack = job->stacks + (size_t)self * job->program->maxDepth;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while(job->remaining > 0) {
+		int task = parallelTake(pool, self);
+
+		if(task < 0) {
+			pthread_cond_wait(&pool->wake, &pool->lock);
+			continue;
+		}
+
+		// After a failure the rest are only counted off, as serial
+		// evaluation would have stopped. Division by zero is the only
+		// failure, so which comes first does not change the status.
+		Status status = job->status;
+
+		if(status == success) {
+			pthread_mutex_unlock(&pool->lock);
+			status = parallelRunTask(job, task, stack);
+			pthread_mutex_lock(&pool->lock);
+		}
+
+		const ParallelTask* done = &job->plan->tasks[task];
+		int readied = 0;
+
+		if(status != success) {
+			job->status = status;
+		}
+
+		for(int i = 0; i < done->dependentCount; ++i) {
+			if(--(job->waiting[done->dependents[i]]) == 0) {
+				parallelPush(pool, self, done->dependents[i]);
+				++readied;
+			}
+		}
+
+		if(--(job->remaining) == 0 || readied > 1) {
+			pthread_cond_broadcast(&pool->wake);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Takes the newest task of the worker's own deque, or else steals the
+// oldest of another's. The pool's lock must be held.
+// Returns the task, or -1 if there is none.
+int parallelTake(ParallelPool* pool, int self) {
+	ParallelDeque* own = &pool->deques[self];
+
+	if(own->bottom > own->top) {
+		return own->tasks[--(own->bottom)];
+	}
+
+	for(int i = 1; i < pool->threadCount; ++i) {
+		ParallelDeque* victim = &pool->deques[(self + i) % pool->threadCount];
+
+		if(victim->bottom > victim->top) {
+			return victim->tasks[(victim->top)++];
+		}
+	}
+
+	return -1;
+}
+
+// Queues a task on a worker's deque. The pool's lock must be held. Each
+// task is queued once, so a deque never holds more than the plan's tasks.
+void parallelPush(ParallelPool* pool, int self, int task) {
+	ParallelDeque* deque = &pool->deques[self];
+
+	deque->tasks[(deque->bottom)++] = task;
+}
+
+// Evaluates one task as programEval() would its instructions, taking the
+// results of its children as it reaches them, and folding in those of runs
+// of terms. A run's own terms are handed on as values instead.
+// Returns the status of the evaluation.
+Status parallelRunTask(const ParallelJob* job, int task, double* stack) {
+	const Program* program = job->program;
+	const ParallelTask* tasks = job->plan->tasks;
+	const ParallelTask* self = &tasks[task];
+	double* values = job->results + self->first;
+	double operand;
+	int top = 0, child = 0, fold = 0;
+
+	for(int pc = self->start; pc <= self->end; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+
+		if(child < self->childCount
+				&& pc == tasks[self->children[child]].start) {
+			const ParallelTask* nested = &tasks[self->children[child++]];
+			const double* results = job->results + nested->first;
+
+			if(nested->foldCount == 0) {
+				stack[top++] = results[0];
+			}
+
+			for(int i = 0; i < nested->foldCount; ++i) {
+				OpCode op = program->code[nested->folds[i]].op;
+
+				if(op == opDiv && results[i] == 0) {
+					return divZero;
+				}
+
+				stack[top - 1] = applyOperation(op, stack[top - 1], results[i]);
+			}
+
+			pc = nested->end;
+			continue;
+		}
+
+		if(fold < self->foldCount && pc == self->folds[fold]) {
+			values[fold++] = stack[--top];
+			continue;
+		}
+
+		switch(instruction->op) {
+			case opConst:
+				stack[top++] = program->constants[instruction->arg];
+				break;
+			case opVar:
+				stack[top++] = job->vars[instruction->arg];
+				break;
+			case opNeg:
+				stack[top - 1] = -stack[top - 1];
+				break;
+			case opSqrt:
+			case opSin:
+			case opCos:
+			case opTan:
+			case opExp:
+			case opLog:
+				stack[top - 1] = applyFunction(instruction->op, stack[top - 1]);
+				break;
+			case opPowi:
+				stack[top - 1] = applyPowi(stack[top - 1], instruction->arg);
+				break;
+			case opStore:
+				job->temps[instruction->arg] = stack[top - 1];
+				break;
+			case opLoad:
+				stack[top++] = job->temps[instruction->arg];
+				break;
+			case opDiv:
+				if(stack[top - 1] == 0) {
+					return divZero;
+				}
+				// Fall through.
+			default:
+				operand = stack[--top];
+				stack[top - 1] = applyOperation(instruction->op, stack[top - 1],
+						operand);
+				break;
+		}
+	}
+
+	if(self->foldCount > 0) {
+		return (top == 0) ? success : evalFail;
+	} else if(top != 1) {
+		return evalFail;
+	}
+
+	values[0] = stack[0];
+	return success;
+}
+
+void parallelPoolDestroy(ParallelPool* pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(int i = 1; i < pool->threadCount; ++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->done);
+	free(pool->deques);
+	free(pool->workers);
+	free(pool->threads);
+	free(pool);
+}
+
+#endif
@@ -0,0 +1,437 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "status.h"
+#include "../Lists/Stacks/arraystack.h"
+
+// Slot of the previous answer in the variable binding.
+#define ANS_SLOT 0
+
+// Largest integer exponent a power is expanded into multiplications for.
+#define POWI_LIMIT      8
+
+// Operations of the postfix bytecode. Operands are taken from the evaluation
+// stack; opConst and opVar carry an index in the instruction argument, and
+// opPowi its integer exponent. opStore copies the top of the stack into a
+// temporary without popping it, and opLoad pushes a temporary, so a shared
+// subexpression is evaluated once.
+typedef enum {
+	opConst,
+	opVar,
+	opAdd,
+	opSub,
+	opMul,
+	opDiv,
+	opPow,
+	opNeg,
+	opSqrt,
+	opSin,
+	opCos,
+	opTan,
+	opExp,
+	opLog,
+	opPowi,
+	opStore,
+	opLoad
+} OpCode;
+
+typedef struct {
+	uint32_t op;
+	int32_t arg;
+} Instruction;
+
+// A compiled expression: a flat array of postfix instructions plus the pool
+// of constants they refer to.
+typedef struct _Program {
+	Instruction* code;
+	int codeSize;
+	int codeCapacity;
+
+	double* constants;
+	int constSize;
+	int constCapacity;
+
+	// Depth of the evaluation stack after the last instruction, and the
+	// deepest it gets while running the program.
+	int depth;
+	int maxDepth;
+
+	// Temporaries used by opStore and opLoad, and the operations removed by
+	// sharing repeated subexpressions.
+	int tempCount;
+	int cseEliminated;
+
+	// Deepest the operator stack got while parsing the expression.
+	int operatorDepth;
+
+	// Estimated cost of one run, summed over the instructions by opCost().
+	long cost;
+
+	// Times the buffers have been grown over the program's life.
+	size_t allocations;
+} Program;
+
+#define getProgramSize(program) (program)->codeSize
+#define isProgramEmpty(program) ((program)->codeSize == 0)
+
+Program* programCreate(void);
+Program* programCopy(const Program* program);
+void programReset(Program* program);
+int opArity(OpCode op);
+int opCost(OpCode op);
+int programEmit(Program* program, OpCode op, int arg);
+int programAddConstant(Program* program, double value);
+int programUsesSlot(const Program* program, int slot);
+int programIsConstant(const Program* program);
+int programValidate(const Program* program, int slotCount);
+Status programEval(const Program* program, const double* vars, Arena* arena,
+		double* result);
+double applyOperation(OpCode op, double lOperand, double rOperand);
+double applyFunction(OpCode op, double operand);
+double applyPowi(double base, int exponent);
+void programDestroy(Program* program);
+
+
+// Function definitions:
+
+Program* programCreate(void) {
+	Program* program = calloc(1, sizeof(Program));
+
+	if(program == NULL) {
+		fprintf(stderr, "Allocation of program failed.\n");
+		exit(1);
+	}
+
+	return program;
+}
+
+// Returns a copy of the program with buffers of exactly the size used.
+Program* programCopy(const Program* program) {
+	Program* copy = programCreate();
+
+	*copy = *program;
+	copy->codeCapacity = program->codeSize;
+	copy->constCapacity = program->constSize;
+	copy->allocations = 0;
+	// One spare byte, so an empty constant pool is not mistaken for a
+	// failed allocation.
+	copy->code = malloc(program->codeSize * sizeof(Instruction) + 1);
+	copy->constants = malloc(program->constSize * sizeof(double) + 1);
+
+	if(copy->code == NULL || copy->constants == NULL) {
+		fprintf(stderr, "Allocation of program copy failed.\n");
+		exit(1);
+	}
+
+	memcpy(copy->code, program->code, program->codeSize * sizeof(Instruction));
+	memcpy(copy->constants, program->constants,
+			program->constSize * sizeof(double));
+	return copy;
+}
+
+// Empties the program while keeping its buffers for the next compilation.
+void programReset(Program* program) {
+	program->codeSize = 0;
+	program->constSize = 0;
+	program->depth = 0;
+	program->maxDepth = 0;
+	program->tempCount = 0;
+	program->cseEliminated = 0;
+	program->operatorDepth = 0;
+	program->cost = 0;
+}
+
+// Returns the number of operands an operation takes from the stack.
+int opArity(OpCode op) {
+	switch(op) {
+		case opConst:
+		case opVar:
+		case opLoad:
+			return 0;
+		case opAdd:
+		case opSub:
+		case opMul:
+		case opDiv:
+		case opPow:
+			return 2;
+		default:
+			return 1;
+	}
+}
+
+// Returns the rough cost of running an operation, in simple arithmetic
+// instructions, for judging whether work is worth sharing between threads.
+int opCost(OpCode op) {
+	switch(op) {
+		case opPow:
+			return 40;
+		case opSin:
+		case opCos:
+		case opTan:
+		case opExp:
+		case opLog:
+			return 20;
+		case opDiv:
+		case opSqrt:
+			return 4;
+		default:
+			return 1;
+	}
+}
+
+// Appends an instruction and tracks its effect on the stack depth.
+// Returns -1 if the instruction would run out of operands.
+int programEmit(Program* program, OpCode op, int arg) {
+	int arity = opArity(op);
+
+	if(program->depth < arity) {
+		return -1;
+	}
+
+	program->depth += 1 - arity;
+
+	if(program->depth > program->maxDepth) {
+		program->maxDepth = program->depth;
+	}
+
+	if(program->codeSize == program->codeCapacity) {
+		program->codeCapacity = program->codeCapacity ? 2 * program->codeCapacity : 16;
+		program->code = realloc(program->code,
+				program->codeCapacity * sizeof(Instruction));
+		++(program->allocations);
+
+		if(program->code == NULL) {
+			fprintf(stderr, "Allocation of program code failed.\n");
+			exit(1);
+		}
+	}
+
+	program->code[program->codeSize].op = op;
+	program->code[program->codeSize].arg = arg;
+	++(program->codeSize);
+	program->cost += opCost(op);
+
+	return 0;
+}
+
+// Adds a value to the constant pool.
+// Returns its index.
+int programAddConstant(Program* program, double value) {
+	if(program->constSize == program->constCapacity) {
+		program->constCapacity = program->constCapacity ? 2 * program->constCapacity : 8;
+		program->constants = realloc(program->constants,
+				program->constCapacity * sizeof(double));
+		++(program->allocations);
+
+		if(program->constants == NULL) {
+			fprintf(stderr, "Allocation of constant pool failed.\n");
+			exit(1);
+		}
+	}
+
+	program->constants[program->constSize] = value;
+	return (program->constSize)++;
+}
+
+// Returns 1 if the program reads the given variable slot, 0 otherwise.
+int programUsesSlot(const Program* program, int slot) {
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		if(program->code[pc].op == opVar && program->code[pc].arg == slot) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Returns 1 if the program reads no variables, and so always gives the same
+// result, 0 otherwise.
+int programIsConstant(const Program* program) {
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		if(program->code[pc].op == opVar) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// Checks a program that did not come from the compiler before it is run:
+// every operation is known, every index in range, every opPowi exponent
+// within POWI_LIMIT as the optimiser emits them, temporaries are stored in
+// order before they are loaded, no instruction runs out of operands, and
+// one value is left. maxDepth and tempCount must be exactly what the code
+// uses, as the evaluators size their buffers by them.
+// Returns 0 if the program is safe to run, -1 otherwise.
+int programValidate(const Program* program, int slotCount) {
+	int depth = 0, maxDepth = 0, stored = 0;
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		uint32_t op = program->code[pc].op;
+		int32_t arg = program->code[pc].arg;
+
+		if(op > opLoad || depth < opArity(op)) {
+			return -1;
+		}
+
+		if((op == opConst && (arg < 0 || arg >= program->constSize))
+				|| (op == opVar && (arg < 0 || arg >= slotCount))
+				|| (op == opPowi && (arg < -POWI_LIMIT || arg > POWI_LIMIT))
+				|| (op == opStore && arg != stored)
+				|| (op == opLoad && (arg < 0 || arg >= stored))) {
+			return -1;
+		}
+
+		if(op == opStore) {
+			++stored;
+		}
+
+		depth += 1 - opArity(op);
+
+		if(depth > maxDepth) {
+			maxDepth = depth;
+		}
+	}
+
+	return (depth == 1 && maxDepth == program->maxDepth
+			&& stored == program->tempCount) ? 0 : -1;
+}
+
+// Runs the program against a variable binding, indexed by slot. The
+// evaluation stack is taken from the arena, sized for the whole program.
+// Returns the status of the evaluation.
+Status programEval(const Program* program, const double* vars, Arena* arena,
+		double* result) {
+	DoubleStack evalStack;
+	double* temps = arenaAlloc(arena, program->tempCount * sizeof(double));
+	double operand;
+
+	doubleStackInit(&evalStack, arena, program->maxDepth);
+
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		const Instruction* instruction = &program->code[pc];
+
+		switch(instruction->op) {
+			case opConst:
+				doubleStackPush(&evalStack,
+						program->constants[instruction->arg]);
+				break;
+			case opVar:
+				doubleStackPush(&evalStack, vars[instruction->arg]);
+				break;
+			case opNeg:
+				doubleStackPush(&evalStack, -doubleStackPop(&evalStack));
+				break;
+			case opSqrt:
+			case opSin:
+			case opCos:
+			case opTan:
+			case opExp:
+			case opLog:
+				operand = doubleStackPop(&evalStack);
+				doubleStackPush(&evalStack,
+						applyFunction(instruction->op, operand));
+				break;
+			case opPowi:
+				doubleStackPush(&evalStack, applyPowi(doubleStackPop(&evalStack),
+						instruction->arg));
+				break;
+			case opStore:
+				temps[instruction->arg] = doubleStackPeek(&evalStack);
+				break;
+			case opLoad:
+				doubleStackPush(&evalStack, temps[instruction->arg]);
+				break;
+			case opDiv:
+				if(doubleStackPeek(&evalStack) == 0) {
+					return divZero;
+				}
+				// Fall through.
+			default:
+				operand = doubleStackPop(&evalStack);
+				doubleStackPush(&evalStack, applyOperation(instruction->op,
+						doubleStackPop(&evalStack), operand));
+				break;
+		}
+	}
+
+	if(getArrayStackSize(&evalStack) != 1) {
+		return evalFail;
+	}
+
+	*result = doubleStackPop(&evalStack);
+	return success;
+}
+
+// Applies simple arithmetic operations.
+double applyOperation(OpCode op, double lOperand, double rOperand) {
+	switch(op) {
+		case opAdd:
+			return lOperand + rOperand;
+		case opSub:
+			return lOperand - rOperand;
+		case opMul:
+			return lOperand * rOperand;
+		case opDiv:
+			return lOperand / rOperand;
+		case opPow:
+			return pow(lOperand, rOperand);
+		default:
+			return NAN;
+	}
+}
+
+// Applies single argument functions on a given operand.
+double applyFunction(OpCode op, double operand) {
+	switch(op) {
+		case opSqrt:
+			return sqrt(operand);
+		case opSin:
+			return sin(operand);
+		case opCos:
+			return cos(operand);
+		case opTan:
+			return tan(operand);
+		case opExp:
+			return exp(operand);
+		case opLog:
+			return log(operand);
+		default:
+			return NAN;
+	}
+}
+
+// Raises base to an integer power by repeated squaring, multiplying in the
+// same order as the vector kernels so both give the same result.
+double applyPowi(double base, int exponent) {
+	unsigned power = (exponent < 0) ? -(unsigned)exponent : (unsigned)exponent;
+	double result = 1.0;
+
+	while(power > 0) {
+		if(power & 1) {
+			result *= base;
+		}
+
+		power >>= 1;
+
+		if(power > 0) {
+			base *= base;
+		}
+	}
+
+	return (exponent < 0) ? 1.0 / result : result;
+}
+
+void programDestroy(Program* program) {
+	free(program->code);
+	free(program->constants);
+	free(program);
+}
+
+#endif
@@ -0,0 +1,511 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "calc.h"
+#include "context.h"
+#include "../Lists/dlist.h"
+
+// Events taken from epoll at a time.
+#define SERVER_EVENTS   64
+
+// Bytes read from a connection at a time.
+#define SERVER_READ     65536
+
+// Replies held for a connection before it is no longer read from, so a
+// client that sends without reading cannot grow them without bound.
+#define SERVER_PENDING  (1 << 20)
+
+// Longest request line. A client sending more without a newline is told so
+// and dropped.
+#define SERVER_LINE     (1 << 20)
+
+// Room for one reply besides the text of a precise result.
+#define SERVER_REPLY    64
+
+// A client. Requests are newline delimited expressions, evaluated in the
+// order they arrive, each answered by one line as --batch prints it. Any
+// number may be sent before the first reply is read.
+typedef struct {
+	int fd;
+	CalcContext* context;
+	DListElement* element;
+
+	// Bytes read and not yet evaluated, up to the end of a line.
+	char* input;
+	size_t inputSize;
+	size_t inputCapacity;
+
+	// Replies not yet sent, from outputStart to outputSize.
+	char* output;
+	size_t outputStart;
+	size_t outputSize;
+	size_t outputCapacity;
+
+	// Events the connection is registered for, and whether the client has
+	// finished sending.
+	uint32_t events;
+	int finished;
+} Connection;
+
+// Single threaded server of many connections on a Unix domain socket. Each
+// connection has a context of its own, so its ans and variables are its
+// own.
+typedef struct {
+	const char* path;
+	int listenFd;
+	int epollFd;
+
+	// Whether new connections are being accepted; not while out of file
+	// descriptors.
+	int listening;
+
+	DList* connections;
+
+	// Settings of each connection's context.
+	size_t cacheLimit;
+	unsigned jitThreshold;
+	int precision;
+} Server;
+
+Server* serverCreate(const char* path, size_t cacheLimit,
+		unsigned jitThreshold, int precision);
+int serverRun(Server* server);
+void serverStop(int signal);
+void serverAccept(Server* server);
+void serverListen(Server* server, int listening);
+void connectionRead(Connection* connection);
+void connectionProcess(Connection* connection);
+void connectionReply(Connection* connection, Status status,
+		const CalcResult* result);
+char* connectionReserve(Connection* connection, size_t length);
+void connectionFlush(Connection* connection);
+void connectionDrop(Connection* connection);
+int connectionUpdate(Server* server, Connection* connection);
+void connectionClose(Server* server, Connection* connection);
+void serverDestroy(Server* server);
+
+// Set from a signal handler to end serverRun().
+volatile sig_atomic_t serverStopping = 0;
+
+
+// Function definitions:
+
+// Listens on a Unix domain socket at path. A socket left there by an
+// earlier server, which refuses connections, is replaced; one a server is
+// still listening on, or anything else at path, is an error.
+// Returns the server, or NULL after printing an error.
+Server* serverCreate(const char* path, size_t cacheLimit,
+		unsigned jitThreshold, int precision) {
+	struct sockaddr_un address;
+	struct stat info;
+
+	if(strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Error: socket path '%s' is too long.\n", path);
+		return NULL;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	if(lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+		int probeFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		// Not waiting on a server whose backlog is full, which is in use.
+		int refused = (probeFd >= 0
+				&& fcntl(probeFd, F_SETFL, O_NONBLOCK) == 0
+				&& connect(probeFd, (struct sockaddr*)&address,
+						sizeof(address)) != 0
+				&& errno == ECONNREFUSED);
+
+		if(probeFd >= 0) {
+			close(probeFd);
+		}
+
+		if(!refused) {
+			fprintf(stderr, "Error: cannot listen on '%s': address in use.\n",
+					path);
+			return NULL;
+		}
+
+		unlink(path);
+	}
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if(listenFd < 0 || fcntl(listenFd, F_SETFL, O_NONBLOCK) != 0
+			|| bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0
+			|| listen(listenFd, SOMAXCONN) != 0) {
+		fprintf(stderr, "Error: cannot listen on '%s': %s.\n", path,
+				strerror(errno));
+
+		if(listenFd >= 0) {
+			close(listenFd);
+		}
+
+		return NULL;
+	}
+
+	Server* server = malloc(sizeof(Server));
+
+	if(server == NULL) {
+		fprintf(stderr, "Allocation of server failed.\n");
+		exit(1);
+	}
+
+	server->path = path;
+	server->listenFd = listenFd;
+	server->epollFd = epoll_create1(0);
+	server->listening = 0;
+	server->connections = dlistCreate(NULL);
+	server->cacheLimit = cacheLimit;
+	server->jitThreshold = jitThreshold;
+	server->precision = precision;
+
+	if(server->epollFd < 0) {
+		fprintf(stderr, "Error: cannot create epoll instance: %s.\n",
+				strerror(errno));
+		serverDestroy(server);
+		return NULL;
+	}
+
+	serverListen(server, 1);
+	return server;
+}
+
+// Serves connections until SIGINT or SIGTERM.
+// Returns 0 when stopped by a signal, -1 on error.
+int serverRun(Server* server) {
+	struct epoll_event events[SERVER_EVENTS];
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = serverStop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	while(!serverStopping) {
+		int count = epoll_wait(server->epollFd, events, SERVER_EVENTS, -1);
+
+		if(count < 0 && errno == EINTR) {
+			continue;
+		} else if(count < 0) {
+			fprintf(stderr, "Error: epoll_wait failed: %s.\n", strerror(errno));
+			return -1;
+		}
+
+		for(int i = 0; i < count; ++i) {
+			Connection* connection = events[i].data.ptr;
+
+			if(connection == NULL) {
+				serverAccept(server);
+				continue;
+			}
+
+			// A hang up or error is seen by the read or write it ends.
+			if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				connectionRead(connection);
+			}
+
+			if(events[i].events & EPOLLOUT) {
+				connectionFlush(connection);
+				connectionProcess(connection);
+			}
+
+			if(connectionUpdate(server, connection) != 0) {
+				connectionClose(server, connection);
+			}
+		}
+	}
+
+	return 0;
+}
+
+void serverStop(int signal) {
+	(void)signal;
+	serverStopping = 1;
+}
+
+// Accepts every waiting connection.
+void serverAccept(Server* server) {
+	while(1) {
+		int fd = accept(server->listenFd, NULL, NULL);
+
+		if(fd < 0) {
+			// Out of file descriptors, the listener would be reported ready
+			// again at once, so it is left alone until a connection closes.
+			if(errno == EMFILE || errno == ENFILE) {
+				serverListen(server, 0);
+			}
+
+			return;
+		}
+
+		Connection* connection = calloc(1, sizeof(Connection));
+
+		if(connection == NULL) {
+			fprintf(stderr, "Allocation of connection failed.\n");
+			exit(1);
+		}
+
+		connection->fd = fd;
+		connection->context = calcContextCreate();
+		calcSetCacheLimit(connection->context, server->cacheLimit);
+		calcSetJitThreshold(connection->context, server->jitThreshold);
+		calcSetPrecision(connection->context, server->precision);
+
+		dlistAddNext(server->connections, getDListTail(server->connections),
+				connection);
+		connection->element = getDListTail(server->connections);
+
+		if(fcntl(fd, F_SETFL, O_NONBLOCK) != 0
+				|| connectionUpdate(server, connection) != 0) {
+			connectionClose(server, connection);
+		}
+	}
+}
+
+// Starts or stops accepting connections.
+void serverListen(Server* server, int listening) {
+	struct epoll_event event;
+
+	if(server->listening == listening) {
+		return;
+	}
+
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	epoll_ctl(server->epollFd, listening ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+			server->listenFd, &event);
+	server->listening = listening;
+}
+
+// Reads what the client has sent and evaluates every complete line. The
+// end of input ends the last line, newline or not.
+void connectionRead(Connection* connection) {
+	if(connection->inputCapacity - connection->inputSize < SERVER_READ) {
+		connection->inputCapacity = connection->inputSize + SERVER_READ;
+		connection->input = realloc(connection->input,
+				connection->inputCapacity);
+
+		if(connection->input == NULL) {
+			fprintf(stderr, "Allocation of connection input failed.\n");
+			exit(1);
+		}
+	}
+
+	ssize_t got = read(connection->fd, connection->input
+			+ connection->inputSize, SERVER_READ);
+
+	if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+		return;
+	} else if(got < 0) {
+		connectionDrop(connection);
+		return;
+	} else if(got == 0) {
+		connection->finished = 1;
+	}
+
+	connection->inputSize += got;
+	connectionProcess(connection);
+}
+
+// Evaluates complete lines until the input runs out or too many replies
+// are waiting to be sent, keeping any partial line for the next read.
+void connectionProcess(Connection* connection) {
+	size_t start = 0;
+
+	while(start < connection->inputSize
+			&& connection->outputSize - connection->outputStart < SERVER_PENDING) {
+		const char* line = connection->input + start;
+		const char* newline = memchr(line, '\n', connection->inputSize - start);
+		size_t length = (newline != NULL) ? (size_t)(newline - line)
+				: connection->inputSize - start;
+		CalcResult result;
+
+		if(newline == NULL && !connection->finished) {
+			if(length >= SERVER_LINE) {
+				const char* message = "Error: Request line too long.\n";
+
+				memcpy(connectionReserve(connection, strlen(message)), message,
+						strlen(message));
+				connection->outputSize += strlen(message);
+				connection->finished = 1;
+				start = connection->inputSize;
+			}
+
+			break;
+		}
+
+		Status status = calcEvaluate(connection->context, line, length, &result);
+
+		connectionReply(connection, status, &result);
+		start += length + (newline != NULL);
+	}
+
+	memmove(connection->input, connection->input + start,
+			connection->inputSize - start);
+	connection->inputSize -= start;
+}
+
+// Queues the reply to one request.
+void connectionReply(Connection* connection, Status status,
+		const CalcResult* result) {
+	size_t length = (status == success && result->text != NULL)
+			? strlen(result->text) : 0;
+	char* text = connectionReserve(connection, length + SERVER_REPLY);
+
+	if(status != success) {
+		connection->outputSize += sprintf(text, "Error: %s\n",
+				calcStatusMessage(status));
+	} else if(result->empty) {
+		text[0] = '\n';
+		++(connection->outputSize);
+	} else if(result->text != NULL) {
+		memcpy(text, result->text, length);
+		text[length] = '\n';
+		connection->outputSize += length + 1;
+	} else {
+		connection->outputSize += sprintf(text, "%.17g\n", result->value);
+	}
+}
+
+// Returns room for length more bytes of replies, to be counted into
+// outputSize once written.
+char* connectionReserve(Connection* connection, size_t length) {
+	// Sent replies are dropped before the buffer grows.
+	if(connection->outputStart == connection->outputSize) {
+		connection->outputStart = 0;
+		connection->outputSize = 0;
+	}
+
+	if(connection->outputCapacity - connection->outputSize < length) {
+		connection->outputCapacity = 2 * connection->outputCapacity + length;
+		connection->output = realloc(connection->output,
+				connection->outputCapacity);
+
+		if(connection->output == NULL) {
+			fprintf(stderr, "Allocation of connection output failed.\n");
+			exit(1);
+		}
+	}
+
+	return connection->output + connection->outputSize;
+}
+
+// Sends as many waiting replies as the socket takes. A write to a client
+// that has gone is not an error for the server; the connection is closed
+// by the next update.
+void connectionFlush(Connection* connection) {
+	while(connection->outputStart < connection->outputSize) {
+		ssize_t sent = send(connection->fd,
+				connection->output + connection->outputStart,
+				connection->outputSize - connection->outputStart, MSG_NOSIGNAL);
+
+		if(sent < 0 && errno == EINTR) {
+			continue;
+		} else if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		} else if(sent < 0) {
+			connectionDrop(connection);
+			return;
+		}
+
+		connection->outputStart += sent;
+	}
+}
+
+// Gives up on a client that can no longer be read from or written to,
+// discarding its requests and replies, so the next update closes it.
+void connectionDrop(Connection* connection) {
+	connection->finished = 1;
+	connection->inputSize = 0;
+	connection->outputStart = connection->outputSize;
+}
+
+// Registers for the events the connection now needs: input while replies
+// are not backed up, and output while any wait.
+// Returns 0, or -1 if the connection is done with.
+int connectionUpdate(Server* server, Connection* connection) {
+	struct epoll_event event;
+	size_t pending;
+
+	// Replies are sent as soon as they are made, and only wait on the
+	// socket when it is full.
+	connectionFlush(connection);
+	pending = connection->outputSize - connection->outputStart;
+
+	// Requests held back while replies were backed up are taken as soon as
+	// they drain, as no read may come to prompt it.
+	while(pending < SERVER_PENDING && connection->inputSize > 0
+			&& (connection->finished || memchr(connection->input, '\n',
+					connection->inputSize) != NULL)) {
+		connectionProcess(connection);
+		connectionFlush(connection);
+		pending = connection->outputSize - connection->outputStart;
+	}
+
+	if(connection->finished && pending == 0 && connection->inputSize == 0) {
+		return -1;
+	}
+
+	event.events = (!connection->finished && pending < SERVER_PENDING)
+			? EPOLLIN : 0;
+	event.events |= (pending > 0) ? EPOLLOUT : 0;
+	event.data.ptr = connection;
+
+	if(connection->events == 0) {
+		connection->events = event.events;
+		return epoll_ctl(server->epollFd, EPOLL_CTL_ADD, connection->fd, &event);
+	} else if(event.events != connection->events) {
+		connection->events = event.events;
+		return epoll_ctl(server->epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+	}
+
+	return 0;
+}
+
+// Closes and frees a connection. epoll reports a descriptor once per wait,
+// so nothing later in the same batch of events refers to it.
+void connectionClose(Server* server, Connection* connection) {
+	void* data;
+
+	// Closing the descriptor also takes it out of the epoll set.
+	close(connection->fd);
+	dlistDel(server->connections, connection->element, &data);
+	calcContextDestroy(connection->context);
+	free(connection->input);
+	free(connection->output);
+	free(connection);
+	serverListen(server, 1);
+}
+
+void serverDestroy(Server* server) {
+	while(getDListSize(server->connections) > 0) {
+		connectionClose(server, getDListHead(server->connections)->data);
+	}
+
+	close(server->listenFd);
+
+	if(server->epollFd >= 0) {
+		close(server->epollFd);
+	}
+
+	unlink(server->path);
+	dlistDestroy(server->connections);
+	free(server);
+}
+
+#endif
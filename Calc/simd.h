@@ -0,0 +1,258 @@
+// Vector kernel template. kernels.h includes this file once per instruction
+// set with the following defined:
+//   SIMD_SUFFIX   appended to every kernel name, e.g. Avx2.
+//   SIMD_WIDTH    number of doubles per vector.
+//   SIMD_TARGET   function attribute enabling the instruction set.
+//   SIMD_SQRT(v)  hardware square root of a vector.
+//
+// sin, cos and tan reduce the argument by pi/2 with a three part Cody-Waite
+// reduction and evaluate the fdlibm minimax polynomials on [-pi/4, pi/4].
+// Error bounds over |x| <= TRIG_LIMIT, measured against long double on 2^20
+// random arguments per range:
+//   sin, cos  below 1.5 ulp.
+//   tan       below 3 ulp, as the quotient of the two polynomials.
+// Lanes outside TRIG_LIMIT, infinities and NaNs are passed to libm.
+//
+// powi raises a block to an integer exponent n by repeated squaring, giving
+// the same results as applyPowi(), within |n| ulp of libm for small n. pow
+// uses it for a block with a common integer exponent |n| <= POWI_LIMIT, and
+// passes any other block to libm.
+
+#define SIMD_CAT_(a, b) a##b
+#define SIMD_CAT(a, b) SIMD_CAT_(a, b)
+#define SIMD_FN(name) SIMD_CAT(name, SIMD_SUFFIX)
+
+#define VEC SIMD_FN(VecD)
+#define IVEC SIMD_FN(VecI)
+#define SELECT(mask, a, b) \
+	((VEC)(((IVEC)(a) & (mask)) | ((IVEC)(b) & ~(mask))))
+
+typedef double VEC __attribute__((vector_size(8 * SIMD_WIDTH)));
+typedef long long IVEC __attribute__((vector_size(8 * SIMD_WIDTH)));
+
+// Loads and stores n <= SIMD_WIDTH lanes, so the tail of a block goes
+// through the same code as the rest of it.
+static inline SIMD_TARGET VEC SIMD_FN(vecLoad)(const double* src, int n) {
+	VEC v = { 0 };
+
+	if(n == SIMD_WIDTH) {
+		memcpy(&v, src, sizeof(VEC));
+	} else {
+		memcpy(&v, src, n * sizeof(double));
+	}
+
+	return v;
+}
+
+static inline SIMD_TARGET void SIMD_FN(vecStore)(double* dst, VEC v, int n) {
+	if(n == SIMD_WIDTH) {
+		memcpy(dst, &v, sizeof(VEC));
+	} else {
+		memcpy(dst, &v, n * sizeof(double));
+	}
+}
+
+static inline SIMD_TARGET int SIMD_FN(vecAny)(IVEC mask) {
+	long long any = 0;
+
+	for(int lane = 0; lane < SIMD_WIDTH; ++lane) {
+		any |= mask[lane];
+	}
+
+	return any != 0;
+}
+
+// Reduces x to y0 + y1 in [-pi/4, pi/4] and the quadrant q of x.
+static inline SIMD_TARGET VEC SIMD_FN(vecReduce)(VEC x, VEC* y1, IVEC* q) {
+	const double shift = 0x1.8p52;
+	VEC t = x * 0x1.45f306dc9c883p-1 + shift;
+	VEC fn = t - shift;
+	VEC r, w, y0;
+
+	// The low mantissa bits of t hold the rounded quotient.
+	*q = (IVEC)t & 3;
+
+	r = x - fn * 0x1.921fb54400000p+0;
+	w = fn * 0x1.0b4611a600000p-34;
+	t = r;
+	r = t - w;
+	w = fn * 0x1.3198a2e037073p-69 - ((t - r) - w);
+	t = r;
+	w = fn * 0x1.3198a2e000000p-69;
+	r = t - w;
+	w = fn * 0x1.b839a252049c1p-104 - ((t - r) - w);
+
+	y0 = r - w;
+	*y1 = (r - y0) - w;
+	return y0;
+}
+
+static inline SIMD_TARGET VEC SIMD_FN(vecKernelSin)(VEC x, VEC y) {
+	VEC z = x * x;
+	VEC w = z * z;
+	VEC r = 0x1.111111110f8a6p-7 + z * (-0x1.a01a019c161d5p-13
+			+ z * 0x1.71de357b1fe7dp-19)
+			+ z * w * (-0x1.ae5e68a2b9cebp-26 + z * 0x1.5d93a5acfd57cp-33);
+	VEC v = z * x;
+
+	return x - ((z * (0.5 * y - v * r) - y) - v * -0x1.5555555555549p-3);
+}
+
+static inline SIMD_TARGET VEC SIMD_FN(vecKernelCos)(VEC x, VEC y) {
+	VEC z = x * x;
+	VEC w = z * z;
+	VEC r = z * (0x1.555555555554cp-5 + z * (-0x1.6c16c16c15177p-10
+			+ z * 0x1.a01a019cb1590p-16))
+			+ w * w * (-0x1.27e4f809c52adp-22 + z * (0x1.1ee9ebdb4b1c4p-29
+			+ z * -0x1.8fae9be8838d4p-37));
+	VEC hz = 0.5 * z;
+
+	w = 1.0 - hz;
+	return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+// Mask of the lanes the polynomial cannot handle.
+static inline SIMD_TARGET IVEC SIMD_FN(vecTrigFallback)(VEC x) {
+	VEC magnitude = (VEC)((IVEC)x & 0x7fffffffffffffffLL);
+	return ~(magnitude <= TRIG_LIMIT);
+}
+
+static inline SIMD_TARGET VEC SIMD_FN(vecSin)(VEC x) {
+	VEC y0, y1, s, c;
+	IVEC q;
+
+	y0 = SIMD_FN(vecReduce)(x, &y1, &q);
+	s = SIMD_FN(vecKernelSin)(y0, y1);
+	c = SIMD_FN(vecKernelCos)(y0, y1);
+	s = SELECT((q & 1) != 0, c, s);
+	return SELECT((q & 2) != 0, -s, s);
+}
+
+static inline SIMD_TARGET VEC SIMD_FN(vecCos)(VEC x) {
+	VEC y0, y1, s, c;
+	IVEC q;
+
+	y0 = SIMD_FN(vecReduce)(x, &y1, &q);
+	s = SIMD_FN(vecKernelSin)(y0, y1);
+	c = SIMD_FN(vecKernelCos)(y0, y1);
+	q = q + 1;
+	s = SELECT((q & 1) != 0, c, s);
+	return SELECT((q & 2) != 0, -s, s);
+}
+
+static inline SIMD_TARGET VEC SIMD_FN(vecTan)(VEC x) {
+	VEC y0, y1, s, c;
+	IVEC q, odd;
+
+	y0 = SIMD_FN(vecReduce)(x, &y1, &q);
+	s = SIMD_FN(vecKernelSin)(y0, y1);
+	c = SIMD_FN(vecKernelCos)(y0, y1);
+	odd = (q & 1) != 0;
+	return SELECT(odd, -c, s) / SELECT(odd, s, c);
+}
+
+// Defines a kernel applying a vector function to a block, handing the lanes
+// the vector function cannot handle to the scalar fallback.
+#define SIMD_UNARY_TRIG(name, vecFunction, scalarFunction) \
+SIMD_TARGET void SIMD_FN(name)(double* dst, const double* a, int n) { \
+	for(int i = 0; i < n; i += SIMD_WIDTH) { \
+		int lanes = (n - i < SIMD_WIDTH) ? n - i : SIMD_WIDTH; \
+		VEC x = SIMD_FN(vecLoad)(a + i, lanes); \
+		VEC result = SIMD_FN(vecFunction)(x); \
+		IVEC fallback = SIMD_FN(vecTrigFallback)(x); \
+		\
+		if(SIMD_FN(vecAny)(fallback)) { \
+			for(int lane = 0; lane < lanes; ++lane) { \
+				if(fallback[lane]) { \
+					result[lane] = scalarFunction(x[lane]); \
+				} \
+			} \
+		} \
+		\
+		SIMD_FN(vecStore)(dst + i, result, lanes); \
+	} \
+}
+
+SIMD_UNARY_TRIG(batchSin, vecSin, sin)
+SIMD_UNARY_TRIG(batchCos, vecCos, cos)
+SIMD_UNARY_TRIG(batchTan, vecTan, tan)
+
+#define SIMD_BINARY(name, expression) \
+SIMD_TARGET void SIMD_FN(name)(double* dst, const double* a, \
+		const double* b, int n) { \
+	for(int i = 0; i < n; i += SIMD_WIDTH) { \
+		int lanes = (n - i < SIMD_WIDTH) ? n - i : SIMD_WIDTH; \
+		VEC l = SIMD_FN(vecLoad)(a + i, lanes); \
+		VEC r = SIMD_FN(vecLoad)(b + i, lanes); \
+		SIMD_FN(vecStore)(dst + i, expression, lanes); \
+	} \
+}
+
+SIMD_BINARY(batchAdd, l + r)
+SIMD_BINARY(batchSub, l - r)
+SIMD_BINARY(batchMul, l * r)
+SIMD_BINARY(batchDiv, l / r)
+
+SIMD_TARGET void SIMD_FN(batchSqrt)(double* dst, const double* a, int n) {
+	for(int i = 0; i < n; i += SIMD_WIDTH) {
+		int lanes = (n - i < SIMD_WIDTH) ? n - i : SIMD_WIDTH;
+		VEC x = SIMD_FN(vecLoad)(a + i, lanes);
+		SIMD_FN(vecStore)(dst + i, SIMD_SQRT(x), lanes);
+	}
+}
+
+SIMD_TARGET void SIMD_FN(batchPowi)(double* dst, const double* a,
+		int exponent, int n) {
+	for(int i = 0; i < n; i += SIMD_WIDTH) {
+		int lanes = (n - i < SIMD_WIDTH) ? n - i : SIMD_WIDTH;
+		unsigned power = (exponent < 0) ? -(unsigned)exponent : (unsigned)exponent;
+		VEC base = SIMD_FN(vecLoad)(a + i, lanes);
+		VEC result = { 0 };
+
+		result += 1.0;
+
+		while(power > 0) {
+			if(power & 1) {
+				result = result * base;
+			}
+
+			power >>= 1;
+
+			if(power > 0) {
+				base = base * base;
+			}
+		}
+
+		if(exponent < 0) {
+			result = 1.0 / result;
+		}
+
+		SIMD_FN(vecStore)(dst + i, result, lanes);
+	}
+}
+
+SIMD_TARGET void SIMD_FN(batchPow)(double* dst, const double* a,
+		const double* b, int n) {
+	double exponent = b[0];
+	int uniform = (fabs(exponent) <= POWI_LIMIT && exponent == (int)exponent);
+
+	for(int i = 1; i < n && uniform; ++i) {
+		uniform = (b[i] == exponent);
+	}
+
+	if(!uniform) {
+		batchPow(dst, a, b, n);
+		return;
+	}
+
+	SIMD_FN(batchPowi)(dst, a, (int)exponent, n);
+}
+
+#undef SIMD_UNARY_TRIG
+#undef SIMD_BINARY
+#undef SELECT
+#undef IVEC
+#undef VEC
+#undef SIMD_FN
+#undef SIMD_CAT
+#undef SIMD_CAT_
@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "calc.h"
+#include "program.h"
+
+// Names of the operations counted in CalcStats, indexed by OpCode.
+const char* const opNames[] = {
+	"const", "var", "+", "-", "*", "/", "^", "neg", "sqrt", "sin", "cos",
+	"tan", "exp", "log", "powi", "store", "load"
+};
+
+// Fails to compile if CALC_OPS and OpCode disagree.
+typedef char OpNamesCheck[(sizeof(opNames) / sizeof(opNames[0]) == CALC_OPS
+		&& CALC_OPS == opLoad + 1) ? 1 : -1];
+
+uint64_t statsNow(void);
+uint64_t statsLap(uint64_t* clock);
+void statsCountProgram(CalcStats* stats, const Program* program);
+
+
+// Function definitions:
+
+// Returns monotonic time in nanoseconds. On Linux this is read from the vDSO
+// without entering the kernel.
+uint64_t statsNow(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+// Returns the time since *clock, and moves *clock on to now.
+uint64_t statsLap(uint64_t* clock) {
+	uint64_t now = statsNow();
+	uint64_t elapsed = now - *clock;
+
+	*clock = now;
+	return elapsed;
+}
+
+// Counts one run of a program. The bytecode has no branches, so every
+// instruction runs exactly once and its operations can be counted from the
+// code rather than in the evaluation loop.
+void statsCountProgram(CalcStats* stats, const Program* program) {
+	for(int pc = 0; pc < program->codeSize; ++pc) {
+		++(stats->opCounts[program->code[pc].op]);
+	}
+
+	if(program->maxDepth > stats->maxEvalDepth) {
+		stats->maxEvalDepth = program->maxDepth;
+	}
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+typedef enum {
+	success,
+	divZero,
+	evalFail,
+	unknownToken,
+	unpairedBracket,
+	noDigit,
+	noOperator,
+	extraDecimalSep,
+	invalidAssignment,
+	outOfDomain,
+} Status;
+
+// Number of statuses. New ones are only ever added at the end, so a status
+// saved by an older build keeps its meaning.
+#define STATUS_COUNT    (outOfDomain + 1)
+
+#endif
@@ -0,0 +1,667 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "calc.h"
+#include "status.h"
+#include "program.h"
+#include "names.h"
+#include "cache.h"
+#include "stats.h"
+#include "context.h"
+#include "../IO/mapfile.h"
+#include "../IO/writer.h"
+
+#define STORE_MAGIC     "CALCSTOR"
+#define STORE_VERSION   1
+
+// Room for the name of an operation in the opcode table.
+#define STORE_OP_NAME   8
+
+// Every section starts on a multiple of this, so the instructions and
+// constants can be read in place.
+#define STORE_ALIGN     8
+
+// A file of compiled programs, evaluated straight from a read only mapping.
+// It holds, each section starting on a multiple of STORE_ALIGN:
+//
+//   StoreHeader
+//   opcode table:   opCount names of STORE_OP_NAME bytes, padded with zeros
+//   slot names:     slotCount StoreName, ans first
+//   entries:        entryCount StoreEntry, one per expression
+//   buckets:        bucketCount uint32_t, an entry index plus one, or 0
+//   code:           codeSize Instruction
+//   constants:      constSize double
+//   text:           textSize bytes of names and expressions, each followed
+//                   by a zero byte
+//
+// Numbers are in the byte order of the machine that wrote the file. The
+// opcode table names every operation by the OpCode it had when written, so
+// a file whose operations have since been renumbered is refused rather than
+// misread.
+typedef struct {
+	char magic[8];
+	uint32_t version;
+
+	// 1 as written, so a file from a machine of the other byte order is
+	// refused.
+	uint32_t byteOrder;
+
+	uint32_t opCount;
+	uint32_t statusCount;
+	uint32_t slotCount;
+	uint32_t entryCount;
+	uint32_t bucketCount;
+	uint32_t codeSize;
+	uint32_t constSize;
+	uint32_t textSize;
+	uint64_t fileSize;
+} StoreHeader;
+
+typedef struct {
+	uint32_t offset;
+	uint32_t length;
+} StoreName;
+
+// An expression and its compiled program. Offsets are into the text, code
+// and constant sections, and an entry that failed to compile keeps the
+// status and error position it failed with, and no code.
+typedef struct {
+	uint32_t text;
+	uint32_t textLength;
+	uint32_t code;
+	uint32_t codeSize;
+	uint32_t constants;
+	uint32_t constSize;
+	int32_t maxDepth;
+	int32_t tempCount;
+	int32_t eliminated;
+	uint32_t status;
+	int32_t errorOffset;
+	int32_t errorLength;
+	int32_t empty;
+	uint32_t reserved;
+} StoreEntry;
+
+struct _CalcStore {
+	MappedFile file;
+	const StoreHeader* header;
+	const StoreName* names;
+	const StoreEntry* entries;
+	const uint32_t* buckets;
+	const char* text;
+
+	// A program per entry, its code and constants pointing into the file.
+	// Only the JIT state is ever written.
+	Program* programs;
+	CalcProgram* compiled;
+};
+
+// Sections being gathered for a new store.
+typedef struct {
+	char* data;
+	size_t size;
+	size_t capacity;
+} StoreBuffer;
+
+size_t storeAlign(size_t size);
+void storeOpName(char* name, int op);
+int storeLayout(const StoreHeader* header, size_t* offsets);
+void storeAppend(StoreBuffer* buffer, const void* data, size_t length);
+uint32_t storeAddText(StoreBuffer* text, const char* data, size_t length);
+int storeWriteFile(const char* path, const StoreHeader* header,
+		const StoreBuffer* sections);
+int storeCheckName(const char* text, uint32_t textSize, uint32_t offset,
+		uint32_t length);
+int storeCheck(CalcStore* store);
+int storeBindSlots(CalcContext* context, const CalcStore* store);
+
+
+// Function definitions:
+
+size_t storeAlign(size_t size) {
+	return (size + STORE_ALIGN - 1) & ~(size_t)(STORE_ALIGN - 1);
+}
+
+// Writes the name of an operation as it appears in the opcode table.
+void storeOpName(char* name, int op) {
+	memset(name, 0, STORE_OP_NAME);
+	memcpy(name, opNames[op], strlen(opNames[op]));
+}
+
+// Works out where each section starts from the counts in the header, with
+// offsets[7] the end of the file.
+// Returns 0 if the file is exactly that long, -1 otherwise.
+int storeLayout(const StoreHeader* header, size_t* offsets) {
+	// The counts are 32 bit, so none of the sizes can overflow.
+	uint64_t sizes[7] = {
+		sizeof(StoreHeader),
+		(uint64_t)header->opCount * STORE_OP_NAME,
+		(uint64_t)header->slotCount * sizeof(StoreName),
+		(uint64_t)header->entryCount * sizeof(StoreEntry),
+		(uint64_t)header->bucketCount * sizeof(uint32_t),
+		(uint64_t)header->codeSize * sizeof(Instruction),
+		(uint64_t)header->constSize * sizeof(double)
+	};
+	uint64_t offset = 0;
+
+	for(int i = 0; i < 7; ++i) {
+		offsets[i] = offset;
+		offset = storeAlign(offset + sizes[i]);
+	}
+
+	offsets[7] = offset;
+	return (offset + header->textSize == header->fileSize) ? 0 : -1;
+}
+
+void storeAppend(StoreBuffer* buffer, const void* data, size_t length) {
+	if(buffer->size + length > buffer->capacity) {
+		while(buffer->size + length > buffer->capacity) {
+			buffer->capacity = buffer->capacity ? 2 * buffer->capacity : 4096;
+		}
+
+		buffer->data = realloc(buffer->data, buffer->capacity);
+
+		if(buffer->data == NULL) {
+			fprintf(stderr, "Allocation of store buffer failed.\n");
+			exit(1);
+		}
+	}
+
+	memcpy(buffer->data + buffer->size, data, length);
+	buffer->size += length;
+}
+
+// Adds text followed by a zero byte.
+// Returns its offset.
+uint32_t storeAddText(StoreBuffer* text, const char* data, size_t length) {
+	uint32_t offset = text->size;
+
+	storeAppend(text, data, length);
+	storeAppend(text, "", 1);
+	return offset;
+}
+
+// Compiles count expressions into a store at path. expressions[i] is
+// lengths[i] bytes long, or a string if lengths is NULL. Each is compiled
+// as by calcCompile(), against the context's variables, which the store
+// records by slot; one that fails is kept with its status. The file is
+// written beside path and renamed over it, so a store mapped by another
+// process is never changed under it. failed may be NULL.
+// Returns 0 with the number of expressions that failed in *failed, or -1 if
+// the file cannot be written.
+int calcStoreWrite(CalcContext* context, const char* path,
+		const char* const* expressions, const size_t* lengths, size_t count,
+		size_t* failed) {
+	StoreHeader header;
+	StoreBuffer sections[8];
+	StoreName* names = calloc(context->varCount, sizeof(StoreName));
+	char opTable[CALC_OPS][STORE_OP_NAME];
+	uint32_t bucketCount = 1;
+
+	if(names == NULL) {
+		fprintf(stderr, "Allocation of store names failed.\n");
+		exit(1);
+	}
+
+	memset(sections, 0, sizeof(sections));
+
+	if(failed != NULL) {
+		*failed = 0;
+	}
+
+	for(int op = 0; op < CALC_OPS; ++op) {
+		storeOpName(opTable[op], op);
+	}
+
+	storeAppend(&sections[1], opTable, sizeof(opTable));
+
+	// Slots are numbered in the order variables were defined, which a
+	// context opening the store repeats.
+	for(int i = 0; i < context->names->capacity; ++i) {
+		const NameEntry* entry = &context->names->entries[i];
+
+		if(entry->name != NULL && entry->kind == variableName) {
+			names[entry->code].offset = storeAddText(&sections[7], entry->name,
+					entry->length);
+			names[entry->code].length = entry->length;
+		}
+	}
+
+	storeAppend(&sections[2], names, context->varCount * sizeof(StoreName));
+	free(names);
+
+	for(size_t i = 0; i < count; ++i) {
+		size_t length = (lengths != NULL) ? lengths[i] : strlen(expressions[i]);
+		const Program* program = context->program;
+		StoreEntry entry;
+		CalcResult result;
+		Status status = contextCompile(context, expressions[i], length, &result);
+
+		memset(&entry, 0, sizeof(StoreEntry));
+		entry.text = storeAddText(&sections[7], expressions[i], length);
+		entry.textLength = length;
+		entry.code = sections[5].size / sizeof(Instruction);
+		entry.constants = sections[6].size / sizeof(double);
+		entry.status = status;
+		entry.errorOffset = result.errorOffset;
+		entry.errorLength = result.errorLength;
+		entry.empty = result.empty;
+
+		if(status == success) {
+			entry.codeSize = program->codeSize;
+			entry.constSize = program->constSize;
+			entry.maxDepth = program->maxDepth;
+			entry.tempCount = program->tempCount;
+			entry.eliminated = program->cseEliminated;
+			storeAppend(&sections[5], program->code,
+					program->codeSize * sizeof(Instruction));
+			storeAppend(&sections[6], program->constants,
+					program->constSize * sizeof(double));
+		} else if(failed != NULL) {
+			++(*failed);
+		}
+
+		storeAppend(&sections[3], &entry, sizeof(StoreEntry));
+	}
+
+	// Offsets into the sections are 32 bit.
+	if(count > INT32_MAX || sections[7].size > INT32_MAX
+			|| sections[5].size / sizeof(Instruction) > INT32_MAX
+			|| sections[6].size / sizeof(double) > INT32_MAX) {
+		for(int i = 0; i < 8; ++i) {
+			free(sections[i].data);
+		}
+
+		return -1;
+	}
+
+	// At most half full, so a probe for a missing expression ends soon.
+	while(bucketCount < 2 * count) {
+		bucketCount *= 2;
+	}
+
+	uint32_t* buckets = calloc(bucketCount, sizeof(uint32_t));
+
+	if(buckets == NULL) {
+		fprintf(stderr, "Allocation of store buckets failed.\n");
+		exit(1);
+	}
+
+	// The first of repeated expressions is the one found.
+	for(size_t i = 0; i < count; ++i) {
+		const StoreEntry* entry = (const StoreEntry*)sections[3].data + i;
+		const char* text = sections[7].data + entry->text;
+		uint32_t slot = cacheHash((const unsigned char*)text, entry->textLength)
+				& (bucketCount - 1);
+
+		while(buckets[slot] != 0) {
+			const StoreEntry* other = (const StoreEntry*)sections[3].data
+					+ buckets[slot] - 1;
+
+			if(other->textLength == entry->textLength && memcmp(text,
+					sections[7].data + other->text, entry->textLength) == 0) {
+				break;
+			}
+
+			slot = (slot + 1) & (bucketCount - 1);
+		}
+
+		if(buckets[slot] == 0) {
+			buckets[slot] = i + 1;
+		}
+	}
+
+	storeAppend(&sections[4], buckets, bucketCount * sizeof(uint32_t));
+	free(buckets);
+
+	memset(&header, 0, sizeof(StoreHeader));
+	memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+	header.version = STORE_VERSION;
+	header.byteOrder = 1;
+	header.opCount = CALC_OPS;
+	header.statusCount = STATUS_COUNT;
+	header.slotCount = context->varCount;
+	header.entryCount = count;
+	header.bucketCount = bucketCount;
+	header.codeSize = sections[5].size / sizeof(Instruction);
+	header.constSize = sections[6].size / sizeof(double);
+	header.textSize = sections[7].size;
+
+	size_t offsets[8];
+
+	storeLayout(&header, offsets);
+	header.fileSize = offsets[7] + header.textSize;
+	storeAppend(&sections[0], &header, sizeof(StoreHeader));
+
+	int status = storeWriteFile(path, &header, sections);
+
+	for(int i = 0; i < 8; ++i) {
+		free(sections[i].data);
+	}
+
+	return status;
+}
+
+// Writes the sections, each padded to where storeLayout() puts the next,
+// to a file beside path, and renames it over path.
+// Returns 0 on success, -1 on error.
+int storeWriteFile(const char* path, const StoreHeader* header,
+		const StoreBuffer* sections) {
+	static const char padding[STORE_ALIGN];
+	size_t pathLength = strlen(path);
+	char* temporary = malloc(pathLength + 5);
+	size_t offsets[8];
+
+	if(temporary == NULL) {
+		fprintf(stderr, "Allocation of store path failed.\n");
+		exit(1);
+	}
+
+	memcpy(temporary, path, pathLength);
+	memcpy(temporary + pathLength, ".tmp", 5);
+	storeLayout(header, offsets);
+
+	int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if(fd < 0) {
+		free(temporary);
+		return -1;
+	}
+
+	Writer* writer = writerCreate(fd, 0);
+
+	for(int i = 0; i < 8; ++i) {
+		writerWrite(writer, sections[i].data, sections[i].size);
+
+		if(i < 7) {
+			writerWrite(writer, padding, offsets[i + 1] - offsets[i]
+					- sections[i].size);
+		}
+	}
+
+	int status = writerDestroy(writer);
+
+	if(close(fd) != 0 || status != 0 || rename(temporary, path) != 0) {
+		unlink(temporary);
+		status = -1;
+	}
+
+	free(temporary);
+	return status;
+}
+
+// Opens a store written by calcStoreWrite(), mapping it rather than reading
+// it. Everything is checked before use: the header and every offset against
+// the file's size, the opcode table against the operations of this build,
+// each stored status against the statuses it knows, and each program with
+// programValidate(). The store's variables are then defined in the context,
+// which must give them the slots they had when written: a fresh context
+// does, as does one that defined the same variables first, in order.
+// Returns 0 on success, -1 if the file cannot be read, is not a valid store
+// or its variables do not fit the context.
+int calcStoreOpen(CalcContext* context, const char* path, CalcStore** store) {
+	CalcStore* opened = calloc(1, sizeof(CalcStore));
+
+	*store = NULL;
+
+	if(opened == NULL) {
+		fprintf(stderr, "Allocation of store failed.\n");
+		exit(1);
+	}
+
+	if(mappedFileOpen(path, &opened->file) != 0) {
+		free(opened);
+		return -1;
+	}
+
+	if(storeCheck(opened) != 0 || storeBindSlots(context, opened) != 0) {
+		calcStoreClose(opened);
+		return -1;
+	}
+
+	*store = opened;
+	return 0;
+}
+
+// Checks an opened file, setting up the store's sections and programs as
+// it goes.
+// Returns 0 if the file is a valid store, -1 otherwise.
+int storeCheck(CalcStore* store) {
+	const char* data = store->file.data;
+	const StoreHeader* header = (const StoreHeader*)data;
+	size_t offsets[8];
+
+	if(store->file.size < sizeof(StoreHeader)
+			|| memcmp(header->magic, STORE_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != STORE_VERSION || header->byteOrder != 1
+			|| header->fileSize != store->file.size
+			|| storeLayout(header, offsets) != 0) {
+		return -1;
+	}
+
+	// A status this build does not know cannot be reported, so only older
+	// or equal sets are accepted.
+	if(header->opCount != CALC_OPS || header->statusCount > STATUS_COUNT
+			|| header->slotCount < 1 || header->slotCount > INT32_MAX
+			|| header->bucketCount == 0
+			|| (header->bucketCount & (header->bucketCount - 1)) != 0) {
+		return -1;
+	}
+
+	for(int op = 0; op < CALC_OPS; ++op) {
+		char name[STORE_OP_NAME];
+
+		storeOpName(name, op);
+
+		if(memcmp(data + offsets[1] + op * STORE_OP_NAME, name,
+				STORE_OP_NAME) != 0) {
+			return -1;
+		}
+	}
+
+	const Instruction* code = (const Instruction*)(data + offsets[5]);
+	const double* constants = (const double*)(data + offsets[6]);
+
+	store->header = header;
+	store->names = (const StoreName*)(data + offsets[2]);
+	store->entries = (const StoreEntry*)(data + offsets[3]);
+	store->buckets = (const uint32_t*)(data + offsets[4]);
+	store->text = data + offsets[7];
+
+	for(uint32_t slot = 0; slot < header->slotCount; ++slot) {
+		if(storeCheckName(store->text, header->textSize,
+				store->names[slot].offset, store->names[slot].length) != 0) {
+			return -1;
+		}
+	}
+
+	if(store->names[ANS_SLOT].length != 3 || memcmp(store->text
+			+ store->names[ANS_SLOT].offset, "ans", 3) != 0) {
+		return -1;
+	}
+
+	for(uint32_t i = 0; i < header->bucketCount; ++i) {
+		if(store->buckets[i] > header->entryCount) {
+			return -1;
+		}
+	}
+
+	store->programs = calloc(header->entryCount + 1, sizeof(Program));
+	store->compiled = calloc(header->entryCount + 1, sizeof(CalcProgram));
+
+	if(store->programs == NULL || store->compiled == NULL) {
+		fprintf(stderr, "Allocation of store programs failed.\n");
+		exit(1);
+	}
+
+	for(uint32_t i = 0; i < header->entryCount; ++i) {
+		const StoreEntry* entry = &store->entries[i];
+		Program* program = &store->programs[i];
+
+		store->compiled[i].program = program;
+
+		// An error's location is in the text, or is -1 with no length for
+		// an error that has none.
+		int located = (entry->errorOffset != -1 || entry->errorLength != 0);
+
+		if((uint64_t)entry->text + entry->textLength >= header->textSize
+				|| store->text[entry->text + entry->textLength] != '\0'
+				|| (located && (entry->errorOffset < 0 || entry->errorLength < 0
+				|| (int64_t)entry->errorOffset + entry->errorLength
+				> (int64_t)entry->textLength))
+				|| entry->status >= header->statusCount
+				|| (uint64_t)entry->code + entry->codeSize > header->codeSize
+				|| (uint64_t)entry->constants + entry->constSize > header->constSize
+				|| entry->codeSize > INT32_MAX || entry->constSize > INT32_MAX) {
+			return -1;
+		}
+
+		if(entry->status != success) {
+			if(entry->codeSize != 0) {
+				return -1;
+			}
+
+			continue;
+		}
+
+		// The code and constants are only read.
+		program->code = (Instruction*)(code + entry->code);
+		program->codeSize = entry->codeSize;
+		program->constants = (double*)(constants + entry->constants);
+		program->constSize = entry->constSize;
+		program->depth = 1;
+		program->maxDepth = entry->maxDepth;
+		program->tempCount = entry->tempCount;
+		program->cseEliminated = entry->eliminated;
+
+		if(programValidate(program, header->slotCount) != 0) {
+			return -1;
+		}
+
+		for(int pc = 0; pc < program->codeSize; ++pc) {
+			program->cost += opCost(program->code[pc].op);
+		}
+	}
+
+	return 0;
+}
+
+// Returns 0 if length bytes at offset in the text are an identifier followed
+// by a zero byte, -1 otherwise.
+int storeCheckName(const char* text, uint32_t textSize, uint32_t offset,
+		uint32_t length) {
+	if(length == 0 || (uint64_t)offset + length >= textSize
+			|| text[offset + length] != '\0'
+			|| !isIdentifierStart(text[offset])) {
+		return -1;
+	}
+
+	for(uint32_t i = 1; i < length; ++i) {
+		if(!isIdentifierChar(text[offset + i])) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Defines the store's variables in the context, at 0, unless already
+// defined.
+// Returns 0 if every variable has the slot it was written with, -1
+// otherwise.
+int storeBindSlots(CalcContext* context, const CalcStore* store) {
+	for(uint32_t slot = 0; slot < store->header->slotCount; ++slot) {
+		const char* name = store->text + store->names[slot].offset;
+		int found = calcVariableSlot(context, name);
+
+		if(found < 0) {
+			found = calcDefineVariable(context, name, 0.0);
+		}
+
+		if(found != (int)slot) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Returns the number of expressions in the store.
+size_t calcStoreSize(const CalcStore* store) {
+	return store->header->entryCount;
+}
+
+// Looks up an expression by its text, exactly as it was written.
+// Returns its index, or -1 if the store does not hold it.
+long calcStoreFind(const CalcStore* store, const char* expression,
+		size_t length) {
+	uint32_t mask = store->header->bucketCount - 1;
+	uint32_t slot = cacheHash((const unsigned char*)expression, length) & mask;
+
+	while(store->buckets[slot] != 0) {
+		const StoreEntry* entry = &store->entries[store->buckets[slot] - 1];
+
+		if(entry->textLength == length
+				&& memcmp(store->text + entry->text, expression, length) == 0) {
+			return store->buckets[slot] - 1;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return -1;
+}
+
+// Gives the program of the expression at index, below calcStoreSize(), to
+// be run by calcRun() and
+// calcRunBatch() with the slots of the context the store was opened in. It
+// belongs to the store and is not to be passed to calcProgramDestroy(). The
+// source of the expression is given in *expression, which may be NULL, and
+// result is filled in as by calcCompile().
+// Returns the status the expression compiled with, with *program NULL on
+// failure.
+Status calcStoreGet(CalcStore* store, size_t index, CalcProgram** program,
+		const char** expression, CalcResult* result) {
+	const StoreEntry* entry = &store->entries[index];
+
+	if(expression != NULL) {
+		*expression = store->text + entry->text;
+	}
+
+	result->value = 0.0;
+	result->text = NULL;
+	result->empty = entry->empty;
+	result->errorOffset = entry->errorOffset;
+	result->errorLength = entry->errorLength;
+	result->eliminated = entry->eliminated;
+	result->usesAns = (entry->status == success
+			&& programUsesSlot(&store->programs[index], ANS_SLOT));
+	*program = (entry->status == success) ? &store->compiled[index] : NULL;
+
+	return entry->status;
+}
+
+// Frees the store, and the native code and plans of any of its programs,
+// and unmaps the file.
+void calcStoreClose(CalcStore* store) {
+	if(store->compiled != NULL) {
+		for(uint32_t i = 0; i < store->header->entryCount; ++i) {
+			jitFree(store->compiled[i].jit.code);
+			parallelStateReset(&store->compiled[i].parallel);
+		}
+	}
+
+	free(store->programs);
+	free(store->compiled);
+	mappedFileClose(&store->file);
+	free(store);
+}
+
+#endif
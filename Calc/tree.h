@@ -0,0 +1,168 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <stdlib.h>
+
+#include "program.h"
+#include "../Memory/arena.h"
+#include "../Lists/Stacks/arraystack.h"
+
+// Expression tree node, taken from an arena. A node holds an OpCode and as
+// many operands as the operation takes; opConst carries its value, opVar
+// its slot and opPowi its exponent in arg. Once common subexpressions are
+// shared the tree becomes a DAG, and a node may have several users.
+typedef struct _Node {
+	OpCode op;
+	int arg;
+	double value;
+	struct _Node* left;
+	struct _Node* right;
+
+	// The equal node this one was merged into, if any, the number of
+	// operations using the node, and its temporary once emitted, or -1.
+	struct _Node* merged;
+	int uses;
+	int temp;
+} Node;
+
+// A node waiting to be emitted, and whether its operands already are.
+typedef struct {
+	Node* node;
+	int expanded;
+} NodeVisit;
+
+ARRAY_STACK(NodeStack, nodeStack, Node*)
+ARRAY_STACK(VisitStack, visitStack, NodeVisit)
+
+#define isConstantNode(node) ((node)->op == opConst)
+#define isValueNode(node, v) ((node)->op == opConst && (node)->value == (v))
+
+Node* nodeCreate(Arena* arena, OpCode op, int arg, double value);
+int treePush(NodeStack* stack, Arena* arena, OpCode op, int arg, double value);
+Node** treePostorder(Node* root, Arena* arena, int* count);
+void treeEmit(Node* root, Program* program, Arena* arena);
+
+
+// Function definitions:
+
+Node* nodeCreate(Arena* arena, OpCode op, int arg, double value) {
+	Node* node = arenaAlloc(arena, sizeof(Node));
+
+	node->op = op;
+	node->arg = arg;
+	node->value = value;
+	node->left = NULL;
+	node->right = NULL;
+	node->merged = NULL;
+	node->uses = 0;
+	node->temp = -1;
+
+	return node;
+}
+
+// Makes a node of op whose operands are taken from the top of the stack, and
+// pushes it in their place.
+// Returns -1 if the stack holds too few operands.
+int treePush(NodeStack* stack, Arena* arena, OpCode op, int arg, double value) {
+	int arity = opArity(op);
+
+	if(getArrayStackSize(stack) < arity) {
+		return -1;
+	}
+
+	Node* node = nodeCreate(arena, op, arg, value);
+
+	if(arity == 2) {
+		node->right = nodeStackPop(stack);
+	}
+
+	if(arity >= 1) {
+		node->left = nodeStackPop(stack);
+	}
+
+	nodeStackPush(stack, node);
+	return 0;
+}
+
+// Lists the nodes of a tree with every node after its operands, left before
+// right. The walk keeps its own stack, as a long chain of operators makes a
+// tree far deeper than the call stack allows.
+// Returns the list, taken from the arena.
+Node** treePostorder(Node* root, Arena* arena, int* count) {
+	NodeStack pending, visited;
+
+	nodeStackInit(&pending, arena, 16);
+	nodeStackInit(&visited, arena, 16);
+	nodeStackPush(&pending, root);
+
+	// Visiting node, right, left and reversing gives left, right, node.
+	while(getArrayStackSize(&pending) > 0) {
+		Node* node = nodeStackPop(&pending);
+
+		nodeStackPush(&visited, node);
+
+		if(node->left != NULL) {
+			nodeStackPush(&pending, node->left);
+		}
+
+		if(node->right != NULL) {
+			nodeStackPush(&pending, node->right);
+		}
+	}
+
+	Node** order = visited.data;
+	*count = getArrayStackSize(&visited);
+
+	for(int i = 0, j = *count - 1; i < j; ++i, --j) {
+		Node* swap = order[i];
+		order[i] = order[j];
+		order[j] = swap;
+	}
+
+	return order;
+}
+
+// Appends the tree to the program as postfix instructions. An operation
+// with several users is stored to a temporary the first time it is emitted
+// and loaded from it after that.
+void treeEmit(Node* root, Program* program, Arena* arena) {
+	VisitStack pending;
+	NodeVisit visit = { root, 0 };
+
+	visitStackInit(&pending, arena, 16);
+	visitStackPush(&pending, visit);
+
+	while(getArrayStackSize(&pending) > 0) {
+		visit = visitStackPop(&pending);
+		Node* node = visit.node;
+
+		if(node->temp >= 0) {
+			programEmit(program, opLoad, node->temp);
+		} else if(!visit.expanded && node->left != NULL) {
+			// Come back to the node once its operands are emitted, left
+			// first.
+			visit.expanded = 1;
+			visitStackPush(&pending, visit);
+
+			if(node->right != NULL) {
+				NodeVisit right = { node->right, 0 };
+				visitStackPush(&pending, right);
+			}
+
+			NodeVisit left = { node->left, 0 };
+			visitStackPush(&pending, left);
+		} else if(node->op == opConst) {
+			programEmit(program, opConst,
+					programAddConstant(program, node->value));
+		} else {
+			programEmit(program, node->op, node->arg);
+
+			if(node->uses > 1 && node->left != NULL) {
+				node->temp = (program->tempCount)++;
+				programEmit(program, opStore, node->temp);
+			}
+		}
+	}
+}
+
+#endif
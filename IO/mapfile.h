@@ -0,0 +1,116 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read only view of a whole file. Regular files are mapped, so reading the
+// input never copies it; anything that cannot be mapped, such as a pipe, is
+// read into memory instead.
+typedef struct {
+	const char* data;
+	size_t size;
+	int mapped;
+} MappedFile;
+
+int mappedFileOpen(const char* path, MappedFile* file);
+int mappedFileRead(int fd, MappedFile* file);
+void mappedFileClose(MappedFile* file);
+
+
+// Function definitions:
+
+// Opens the file at path.
+// Returns 0 on success, -1 if the file cannot be opened or read.
+int mappedFileOpen(const char* path, MappedFile* file) {
+	struct stat info;
+	int fd = open(path, O_RDONLY);
+
+	file->data = NULL;
+	file->size = 0;
+	file->mapped = 0;
+
+	if(fd < 0) {
+		return -1;
+	}
+
+	if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+		// An empty file cannot be mapped, and needs nothing read either.
+		if(info.st_size == 0) {
+			close(fd);
+			return 0;
+		}
+
+		void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if(data != MAP_FAILED) {
+			posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);
+			file->data = data;
+			file->size = info.st_size;
+			file->mapped = 1;
+			close(fd);
+			return 0;
+		}
+	}
+
+	int status = mappedFileRead(fd, file);
+
+	close(fd);
+	return status;
+}
+
+// Reads everything left in fd into memory.
+// Returns 0 on success, -1 on a read error.
+int mappedFileRead(int fd, MappedFile* file) {
+	size_t capacity = 1 << 16, size = 0;
+	char* data = malloc(capacity);
+
+	if(data == NULL) {
+		fprintf(stderr, "Allocation of file buffer failed.\n");
+		exit(1);
+	}
+
+	while(1) {
+		if(size == capacity) {
+			capacity *= 2;
+			data = realloc(data, capacity);
+
+			if(data == NULL) {
+				fprintf(stderr, "Allocation of file buffer failed.\n");
+				exit(1);
+			}
+		}
+
+		ssize_t got = read(fd, data + size, capacity - size);
+
+		if(got == 0) {
+			break;
+		} else if(got < 0) {
+			free(data);
+			return -1;
+		}
+
+		size += got;
+	}
+
+	file->data = data;
+	file->size = size;
+	return 0;
+}
+
+void mappedFileClose(MappedFile* file) {
+	if(file->mapped) {
+		munmap((void*)file->data, file->size);
+	} else {
+		free((void*)file->data);
+	}
+
+	file->data = NULL;
+	file->size = 0;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Capacity used when none is given.
+#define WRITER_SIZE     (1 << 20)
+
+// Room reserved for one formatted number.
+#define NUMBER_TEXT     32
+
+// Output buffer in front of a file descriptor. Text is formatted straight
+// into the buffer, which is written with one system call whenever it fills,
+// rather than going through stdio a line at a time.
+typedef struct {
+	int fd;
+	char* buffer;
+	size_t size;
+	size_t capacity;
+
+	// Set once a write fails; later output is dropped.
+	int failed;
+} Writer;
+
+Writer* writerCreate(int fd, size_t capacity);
+char* writerReserve(Writer* writer, size_t length);
+void writerCommit(Writer* writer, size_t length);
+void writerWrite(Writer* writer, const char* data, size_t length);
+void writerNumber(Writer* writer, const char* format, double value);
+int writerFlush(Writer* writer);
+int writeAll(int fd, const char* data, size_t length);
+int writerDestroy(Writer* writer);
+
+
+// Function definitions:
+
+Writer* writerCreate(int fd, size_t capacity) {
+	Writer* writer = malloc(sizeof(Writer));
+
+	if(writer == NULL) {
+		fprintf(stderr, "Allocation of writer failed.\n");
+		exit(1);
+	}
+
+	writer->fd = fd;
+	writer->capacity = capacity ? capacity : WRITER_SIZE;
+	writer->size = 0;
+	writer->failed = 0;
+	writer->buffer = malloc(writer->capacity);
+
+	if(writer->buffer == NULL) {
+		fprintf(stderr, "Allocation of writer buffer failed.\n");
+		exit(1);
+	}
+
+	return writer;
+}
+
+// Returns space for length bytes at the end of the buffer, flushing first if
+// needed. Follow with writerCommit() for the bytes actually used.
+// length must not exceed the capacity.
+char* writerReserve(Writer* writer, size_t length) {
+	if(writer->capacity - writer->size < length) {
+		writerFlush(writer);
+	}
+
+	return writer->buffer + writer->size;
+}
+
+void writerCommit(Writer* writer, size_t length) {
+	writer->size += length;
+}
+
+// Appends data. Anything at least as large as the buffer is written directly
+// rather than copied.
+void writerWrite(Writer* writer, const char* data, size_t length) {
+	if(length >= writer->capacity) {
+		writerFlush(writer);
+
+		if(!writer->failed && writeAll(writer->fd, data, length) != 0) {
+			writer->failed = 1;
+		}
+
+		return;
+	}
+
+	memcpy(writerReserve(writer, length), data, length);
+	writerCommit(writer, length);
+}
+
+// Appends a number formatted by a printf format taking one double.
+void writerNumber(Writer* writer, const char* format, double value) {
+	char* text = writerReserve(writer, NUMBER_TEXT);
+	writerCommit(writer, snprintf(text, NUMBER_TEXT, format, value));
+}
+
+// Writes out the buffer.
+// Returns 0 on success, -1 if this or an earlier write failed.
+int writerFlush(Writer* writer) {
+	if(!writer->failed && writer->size > 0
+			&& writeAll(writer->fd, writer->buffer, writer->size) != 0) {
+		writer->failed = 1;
+	}
+
+	writer->size = 0;
+	return writer->failed ? -1 : 0;
+}
+
+// Writes length bytes, retrying partial and interrupted writes.
+// Returns 0 on success, -1 on error.
+int writeAll(int fd, const char* data, size_t length) {
+	while(length > 0) {
+		ssize_t written = write(fd, data, length);
+
+		if(written < 0 && errno == EINTR) {
+			continue;
+		} else if(written < 0) {
+			return -1;
+		}
+
+		data += written;
+		length -= written;
+	}
+
+	return 0;
+}
+
+// Flushes and frees the writer.
+// Returns 0 if all output was written, -1 otherwise.
+int writerDestroy(Writer* writer) {
+	int status = writerFlush(writer);
+
+	free(writer->buffer);
+	free(writer);
+	return status;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef ARRAYSTACK_H
+#define ARRAYSTACK_H
+
+#include "../../Memory/arena.h"
+
+// Contiguous, value-typed stacks whose memory comes from an arena. Growing
+// a stack doubles its capacity; the old storage is reclaimed when the arena
+// is reset.
+//
+// ARRAY_STACK(Name, prefix, type) defines the type Name and the functions
+// prefixInit, prefixPush, prefixPop and prefixPeek.
+#define ARRAY_STACK(Name, prefix, type) \
+typedef struct { \
+	type* data; \
+	int size; \
+	int capacity; \
+	Arena* arena; \
+} Name; \
+\
+static inline void prefix##Init(Name* stack, Arena* arena, int capacity) { \
+	stack->arena = arena; \
+	stack->size = 0; \
+	stack->capacity = (capacity > 0) ? capacity : 1; \
+	stack->data = arenaAlloc(arena, stack->capacity * sizeof(type)); \
+} \
+\
+static inline void prefix##Push(Name* stack, type value) { \
+	if(stack->size == stack->capacity) { \
+		stack->data = arenaGrow(stack->arena, stack->data, \
+				stack->capacity * sizeof(type), \
+				2 * stack->capacity * sizeof(type)); \
+		stack->capacity *= 2; \
+	} \
+	\
+	stack->data[stack->size++] = value; \
+} \
+\
+static inline type prefix##Pop(Name* stack) { \
+	return stack->data[--(stack->size)]; \
+} \
+\
+static inline type prefix##Peek(const Name* stack) { \
+	return stack->data[stack->size - 1]; \
+}
+
+ARRAY_STACK(DoubleStack, doubleStack, double)
+ARRAY_STACK(OpStack, opStack, unsigned char)
+
+// Stack of values whose size is only known at run time, such as those of a
+// numeric backend. Pushing returns the slot for the caller to fill, and
+// popping the slot given up, which stays valid until the next push.
+typedef struct {
+	char* data;
+	size_t elementSize;
+	int size;
+	int capacity;
+	Arena* arena;
+} ValueStack;
+
+static inline void valueStackInit(ValueStack* stack, Arena* arena,
+		size_t elementSize, int capacity) {
+	stack->arena = arena;
+	stack->elementSize = elementSize;
+	stack->size = 0;
+	stack->capacity = (capacity > 0) ? capacity : 1;
+	stack->data = arenaAlloc(arena, stack->capacity * elementSize);
+}
+
+static inline void* valueStackPush(ValueStack* stack) {
+	if(stack->size == stack->capacity) {
+		stack->data = arenaGrow(stack->arena, stack->data,
+				stack->capacity * stack->elementSize,
+				2 * stack->capacity * stack->elementSize);
+		stack->capacity *= 2;
+	}
+
+	return stack->data + (stack->size)++ * stack->elementSize;
+}
+
+static inline void* valueStackPop(ValueStack* stack) {
+	return stack->data + --(stack->size) * stack->elementSize;
+}
+
+static inline void* valueStackPeek(const ValueStack* stack) {
+	return stack->data + (stack->size - 1) * stack->elementSize;
+}
+
+#define getArrayStackSize(stack) (stack)->size
+
+#endif
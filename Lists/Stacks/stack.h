@@ -8,6 +8,7 @@ typedef ListElement StackElement;
 
 
 #define stackCreate listCreate
+#define stackCreatePooled listCreatePooled
 #define getStackSize getListSize
 #define stackDestroy listDestroy
 #define stackPeek(stack) ((stack)->head->data == NULL ? NULL : (stack)->head->data)
@@ -0,0 +1,237 @@
+#ifndef DLIST_H
+#define DLIST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Doubly linked list with the interface of list.h. Each element also knows
+// the one before it, so deleting at the tail is O(1) and an index is reached
+// from whichever of the head, the tail or the last index reached is nearest.
+
+typedef struct _DListElement {
+	void* data;
+	struct _DListElement* next;
+	struct _DListElement* previous;
+} DListElement;
+
+typedef struct {
+	int size;
+
+	DListElement* head;
+	DListElement* tail;
+
+	void (*destroyFunction)(void* data);
+
+	// Element last reached by index, and its index. NULL when a change may
+	// have moved it.
+	DListElement* cached;
+	int cachedIndex;
+} DList;
+
+#define getDListSize(list) list->size
+#define getDListHead(list) list->head
+#define getDListTail(list) list->tail
+#define getPreviousElement(element) element->previous
+
+DList* dlistCreate(void (*destroyFunction)(void* data));
+int dlistAddNext(DList* list, DListElement* element, const void* data);
+int dlistDelNext(DList* list, DListElement* element, void** data);
+int dlistDel(DList* list, DListElement* element, void** data);
+int dlistAddIndex(DList* list, int index, const void* data);
+int dlistDelIndex(DList* list, int index, void** data);
+int dlistCat(DList* list1, DList* list2);
+void dlistDestroy(DList* list);
+DListElement* dlistElementAt(DList* list, int index);
+
+
+// Function definitions:
+
+DList* dlistCreate(void (*destroyFunction)(void* data)) {
+	DList* list = malloc(sizeof(DList));
+
+	if(list == NULL) {
+		fprintf(stderr, "Allocation of list failed.\n");
+		exit(1);
+	}
+
+	list->size = 0;
+
+	list->head = NULL;
+	list->tail = NULL;
+
+	// destroyFunction is the function used to deallocated data.
+	// Use NULL for static allocation and free() for malloc, calloc, etc.
+	list->destroyFunction = destroyFunction;
+
+	list->cached = NULL;
+	list->cachedIndex = 0;
+
+	return list;
+}
+
+// Inserts after element, or at the head if element is NULL.
+int dlistAddNext(DList* list, DListElement* element, const void* data) {
+	DListElement* newElement = malloc(sizeof(DListElement));
+
+	if(newElement == NULL) {
+		fprintf(stderr, "Allocation of list element failed.\n");
+		exit(1);
+	}
+
+	newElement->data = (void*) data;
+	newElement->previous = element;
+	newElement->next = (element == NULL) ? list->head : element->next;
+	list->cached = NULL;
+
+	if(element == NULL) {
+		list->head = newElement;
+	} else {
+		element->next = newElement;
+	}
+
+	if(newElement->next == NULL) {
+		list->tail = newElement;
+	} else {
+		newElement->next->previous = newElement;
+	}
+
+	++(list->size);
+	return 0;
+}
+
+// Deletes the element after element, or the head if element is NULL.
+// void** data will hold the data from the deleted element.
+int dlistDelNext(DList* list, DListElement* element, void** data) {
+	if(getDListSize(list) == 0 || element == list->tail) {
+		return -1;
+	}
+
+	return dlistDel(list, (element == NULL) ? list->head : element->next, data);
+}
+
+// Deletes element itself, which needs no walk to find the one before it.
+int dlistDel(DList* list, DListElement* element, void** data) {
+	if(element == NULL) {
+		return -1;
+	}
+
+	if(element->previous == NULL) {
+		list->head = element->next;
+	} else {
+		element->previous->next = element->next;
+	}
+
+	if(element->next == NULL) {
+		list->tail = element->previous;
+	} else {
+		element->next->previous = element->previous;
+	}
+
+	*data = element->data;
+	list->cached = NULL;
+	--(list->size);
+	free(element);
+
+	return 0;
+}
+
+// Adds a new element at the specified index of the list.
+int dlistAddIndex(DList* list, int index, const void* data) {
+	if(index > getDListSize(list)) {
+		fprintf(stderr, "Attempting to add element at index %d, ", index);
+		fprintf(stderr, "but list is only of size %d.\n", getDListSize(list));
+		exit(1);
+	} else if(index == 0) {
+		dlistAddNext(list, NULL, data);
+	} else {
+		DListElement* previous = dlistElementAt(list, index - 1);
+
+		dlistAddNext(list, previous, data);
+
+		// Nothing before the new element moved.
+		list->cached = previous;
+		list->cachedIndex = index - 1;
+	}
+
+	return 0;
+}
+
+int dlistDelIndex(DList* list, int index, void** data) {
+	if(index > getDListSize(list) - 1) {
+		fprintf(stderr, "There is no element to delete at the specified index.\n");
+		exit(1);
+	}
+
+	DListElement* element = dlistElementAt(list, index);
+	DListElement* previous = element->previous;
+
+	dlistDel(list, element, data);
+
+	if(previous != NULL) {
+		list->cached = previous;
+		list->cachedIndex = index - 1;
+	}
+
+	return 0;
+}
+
+// Appends list2 to list1.
+int dlistCat(DList* list1, DList* list2) {
+	if(getDListSize(list1) == 0 || getDListSize(list2) == 0) {
+		return -1;
+	}
+
+	list1->tail->next = list2->head;
+	list2->head->previous = list1->tail;
+	list1->tail = list2->tail;
+	list1->size += list2->size;
+
+	return 0;
+}
+
+// Safely delete list.
+void dlistDestroy(DList* list) {
+	void* data;
+
+	while(getDListSize(list) > 0) {
+		if(dlistDel(list, list->tail, &data) == 0
+				&& list->destroyFunction != NULL) {
+			list->destroyFunction(data);
+		}
+	}
+
+	free(list);
+}
+
+// Returns the element at index, walking from whichever of the head, the tail
+// and the last element reached by index is nearest.
+DListElement* dlistElementAt(DList* list, int index) {
+	DListElement* current = list->head;
+	int position = 0;
+	int distance = index;
+
+	if(getDListSize(list) - 1 - index < distance) {
+		current = list->tail;
+		position = getDListSize(list) - 1;
+		distance = position - index;
+	}
+
+	if(list->cached != NULL && abs(index - list->cachedIndex) < distance) {
+		current = list->cached;
+		position = list->cachedIndex;
+	}
+
+	for(; position < index; ++position) {
+		current = current->next;
+	}
+
+	for(; position > index; --position) {
+		current = current->previous;
+	}
+
+	list->cached = current;
+	list->cachedIndex = index;
+	return current;
+}
+
+#endif
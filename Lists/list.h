@@ -5,11 +5,32 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Elements in the first slab of a pool. Each slab is twice the size of the
+// last.
+#define LIST_SLAB 64
+
 typedef struct _ListElement {
 	void* data;
 	struct _ListElement* next;
 } ListElement;
 
+// Block of elements allocated at once, followed by the elements themselves.
+typedef struct _ListSlab {
+	struct _ListSlab* next;
+	int capacity;
+	int used;
+} ListSlab;
+
+// Slab allocator for list elements. Freed elements are kept on a free list
+// and handed out again before any new slab is allocated, so lists that have
+// reached their working size never call malloc() or free(). A pool can be
+// shared by several lists, and is only freed as a whole.
+typedef struct {
+	ListSlab* slabs;
+	ListElement* freeList;
+	int slabCapacity;
+} ListPool;
+
 typedef struct {
 	int size;
 
@@ -17,8 +38,29 @@ typedef struct {
 	ListElement* tail;
 
 	void (*destroyFunction)(void* data);
+
+	// Where elements come from, or NULL for malloc(). A pool the list
+	// created itself is destroyed with it.
+	ListPool* pool;
+	int ownsPool;
+
+	// Element last reached by index, so the next index operation at or
+	// past it walks on from there rather than from the head. NULL when a
+	// change may have moved it.
+	ListElement* cached;
+	int cachedIndex;
 } List;
 
+// Position in a list for sequential access: current is the element at index
+// and previous the one before it, so inserting or deleting there is O(1).
+// Only changes made through the cursor keep it valid.
+typedef struct {
+	List* list;
+	ListElement* previous;
+	ListElement* current;
+	int index;
+} ListCursor;
+
 #define getElementData(element) element->data
 #define getListSize(list) list->size
 #define getListHead(list) list->head
@@ -26,15 +68,28 @@ typedef struct {
 #define getNextElement(element) element->next
 #define isListHead(list, element) list->head == element ? 1 : 0
 #define isListTail(list, element) list->tail == element ? 1 : 0
+#define getCursorData(cursor) (cursor)->current->data
+#define isCursorAtEnd(cursor) ((cursor)->current == NULL)
 
 //void listInit(List* list, void (*destroyFunction)(void* data));
 List* listCreate(void (*destroyFunction)(void* data));
+List* listCreatePooled(void (*destroyFunction)(void* data), ListPool* pool);
 int listAddNext(List* list, ListElement* element, const void* data);
 int listDelNext(List* list, ListElement* element, void** data);
 int listAddIndex(List* list, int index, const void* data);
 int listDelIndex(List* list, int index, void** data);
 int listCat(List* list1, List* list2);
 void listDestroy(List* list);
+ListElement* listElementAt(List* list, int index);
+void listCursorInit(List* list, ListCursor* cursor);
+int listCursorSeek(ListCursor* cursor, int index);
+void listCursorNext(ListCursor* cursor);
+int listCursorInsert(ListCursor* cursor, const void* data);
+int listCursorDelete(ListCursor* cursor, void** data);
+ListPool* listPoolCreate(int slabCapacity);
+ListElement* listPoolAlloc(ListPool* pool);
+void listPoolFree(ListPool* pool, ListElement* element);
+void listPoolDestroy(ListPool* pool);
 
 
 // Function definitions:
@@ -42,6 +97,11 @@ void listDestroy(List* list);
 List* listCreate(void (*destroyFunction)(void* data)) {
 	List* list = malloc(sizeof(List));
 
+	if(list == NULL) {
+		fprintf(stderr, "Allocation of list failed.\n");
+		exit(1);
+	}
+
 	list->size = 0;
 
 	list->head = NULL;
@@ -51,11 +111,29 @@ List* listCreate(void (*destroyFunction)(void* data)) {
 	// Use NULL for static allocation and free() for malloc, calloc, etc.
 	list->destroyFunction = destroyFunction;
 
+	list->pool = NULL;
+	list->ownsPool = 0;
+
+	list->cached = NULL;
+	list->cachedIndex = 0;
+
+	return list;
+}
+
+// Creates a list taking its elements from pool, or from a pool of its own
+// if pool is NULL.
+List* listCreatePooled(void (*destroyFunction)(void* data), ListPool* pool) {
+	List* list = listCreate(destroyFunction);
+
+	list->ownsPool = (pool == NULL);
+	list->pool = (pool != NULL) ? pool : listPoolCreate(LIST_SLAB);
+
 	return list;
 }
 
 int listAddNext(List* list, ListElement* element, const void* data) {
-	ListElement* newElement = malloc(sizeof(ListElement));
+	ListElement* newElement = (list->pool != NULL)
+			? listPoolAlloc(list->pool) : malloc(sizeof(ListElement));
 
 	if(newElement == NULL) {
 		fprintf(stderr, "Allocation of list element failed.\n");
@@ -63,6 +141,7 @@ int listAddNext(List* list, ListElement* element, const void* data) {
 	}
 
 	newElement->data = (void*) data;
+	list->cached = NULL;
 
 	// Insert at head.
 	if(element == NULL) {
@@ -97,6 +176,8 @@ int listDelNext(List* list, ListElement* element, void** data) {
 		return -1;
 	}
 
+	list->cached = NULL;
+
 	if(element == NULL) {
 		oldElement = list->head;
 		*data = oldElement->data;
@@ -121,14 +202,19 @@ int listDelNext(List* list, ListElement* element, void** data) {
 	}
 
 	--(list->size);
-	free(oldElement);
+
+	if(list->pool != NULL) {
+		listPoolFree(list->pool, oldElement);
+	} else {
+		free(oldElement);
+	}
+
 	return 0;
 }
 
-// Adds a new element at the specified index of the list.
+// Adds a new element at the specified index of the list. Adding at or just
+// past the last index reached is O(1), so filling a list in order is linear.
 int listAddIndex(List* list, int index, const void* data) {
-	ListElement* current = getListHead(list);
-
 	if(index > getListSize(list)) {
 		fprintf(stderr, "Attempting to add element at index %d, ", index);
 		fprintf(stderr, "but list is only of size %d.\n", getListSize(list));
@@ -136,45 +222,44 @@ int listAddIndex(List* list, int index, const void* data) {
 	// Add at head.
 	} else if(index == 0) {
 		listAddNext(list, NULL, data);
-	// Add at tail.
-	} else if(index == getListSize(list)) {
-		listAddNext(list, list->tail, data);
-	// Add elsewhere.
+	// Add elsewhere, the tail included.
 	} else {
-		for(int i = 0; i < index - 1; ++i) {
-			current = getNextElement(current);
-		}
+		ListElement* previous = listElementAt(list, index - 1);
+
+		listAddNext(list, previous, data);
 
-		listAddNext(list, current, data);
+		// Nothing before the new element moved.
+		list->cached = previous;
+		list->cachedIndex = index - 1;
 	}
 
 	return 0;
 }
 
 int listDelIndex(List* list, int index, void** data) {
-	ListElement* current = getListHead(list);
-
 	if(index > getListSize(list) - 1) {
 		fprintf(stderr, "There is no element to delete at the specified index.\n");
 		exit(1);
 	// Delete at head.
 	} else if(index == 0) {
 		listDelNext(list, NULL, data);
-	// Add elsewhere.
+	// Delete elsewhere.
 	} else {
-		for(int i = 0; i < index - 1; ++i) {
-			current = getNextElement(current);
-		}
+		ListElement* previous = listElementAt(list, index - 1);
 
-		listDelNext(list, current, data);
+		listDelNext(list, previous, data);
+		list->cached = previous;
+		list->cachedIndex = index - 1;
 	}
 
 	return 0;
 }
 
-// Appends list2 to list1.
+// Appends list2 to list1. Both must take their elements from the same
+// place: malloc(), or a pool they share.
 int listCat(List* list1, List* list2) {
-	if(getListSize(list1) == 0 || getListSize(list2) == 0) {
+	if(getListSize(list1) == 0 || getListSize(list2) == 0
+			|| list1->pool != list2->pool) {
 		return -1;
 	}
 
@@ -185,19 +270,187 @@ int listCat(List* list1, List* list2) {
 	return 0;
 }
 
-// Safely delete list.
+// Safely delete list. Pooled elements are not freed one by one: a pool of
+// the list's own goes all at once, and the elements of a shared pool are
+// spliced onto its free list whole. Either way only data to destroy needs a
+// walk of the list.
 void listDestroy(List* list) {
 	void* data;
 
-	while(getListSize(list) > 0) {
-		if(listDelNext(list, NULL, (void**) &data) == 0 \
-				&& list->destroyFunction != NULL) {
+	if(list->pool == NULL) {
+		while(getListSize(list) > 0) {
+			if(listDelNext(list, NULL, (void**) &data) == 0 \
+					&& list->destroyFunction != NULL) {
+
+					list->destroyFunction(data);
+			}
+		}
+
+		free(list);
+		return;
+	}
 
-				list->destroyFunction(data);
+	if(list->destroyFunction != NULL) {
+		for(ListElement* element = list->head; element != NULL;
+				element = element->next) {
+			list->destroyFunction(element->data);
 		}
 	}
 
+	if(list->ownsPool) {
+		listPoolDestroy(list->pool);
+	} else if(getListSize(list) > 0) {
+		list->tail->next = list->pool->freeList;
+		list->pool->freeList = list->head;
+	}
+
 	free(list);
 }
 
+// Returns the element at index, walking on from the last element reached
+// by index when that comes first. The tail is found directly.
+ListElement* listElementAt(List* list, int index) {
+	ListElement* current = getListHead(list);
+	int position = 0;
+
+	if(index == getListSize(list) - 1) {
+		return getListTail(list);
+	}
+
+	if(list->cached != NULL && list->cachedIndex <= index) {
+		current = list->cached;
+		position = list->cachedIndex;
+	}
+
+	for(; position < index; ++position) {
+		current = getNextElement(current);
+	}
+
+	list->cached = current;
+	list->cachedIndex = index;
+	return current;
+}
+
+// Places a cursor at the head of the list.
+void listCursorInit(List* list, ListCursor* cursor) {
+	cursor->list = list;
+	cursor->previous = NULL;
+	cursor->current = getListHead(list);
+	cursor->index = 0;
+}
+
+// Moves a cursor to index, which may be the size of the list to stand past
+// the tail. Seeking forwards walks on from the cursor, backwards restarts
+// from the head.
+// Returns 0 on success, -1 if index is out of range.
+int listCursorSeek(ListCursor* cursor, int index) {
+	if(index < 0 || index > getListSize(cursor->list)) {
+		return -1;
+	}
+
+	if(index < cursor->index) {
+		listCursorInit(cursor->list, cursor);
+	}
+
+	while(cursor->index < index) {
+		listCursorNext(cursor);
+	}
+
+	return 0;
+}
+
+void listCursorNext(ListCursor* cursor) {
+	cursor->previous = cursor->current;
+	cursor->current = getNextElement(cursor->current);
+	++(cursor->index);
+}
+
+// Inserts before the cursor, which then stands on the new element.
+// Returns 0 on success.
+int listCursorInsert(ListCursor* cursor, const void* data) {
+	listAddNext(cursor->list, cursor->previous, data);
+	cursor->current = (cursor->previous == NULL)
+			? getListHead(cursor->list) : getNextElement(cursor->previous);
+
+	return 0;
+}
+
+// Deletes the element under the cursor, which then stands on the next one.
+// Returns 0 on success, -1 if the cursor is past the tail.
+int listCursorDelete(ListCursor* cursor, void** data) {
+	if(isCursorAtEnd(cursor)) {
+		return -1;
+	}
+
+	listDelNext(cursor->list, cursor->previous, data);
+	cursor->current = (cursor->previous == NULL)
+			? getListHead(cursor->list) : getNextElement(cursor->previous);
+
+	return 0;
+}
+
+// Creates an empty pool whose first slab holds slabCapacity elements.
+ListPool* listPoolCreate(int slabCapacity) {
+	ListPool* pool = malloc(sizeof(ListPool));
+
+	if(pool == NULL) {
+		fprintf(stderr, "Allocation of list pool failed.\n");
+		exit(1);
+	}
+
+	pool->slabs = NULL;
+	pool->freeList = NULL;
+	pool->slabCapacity = (slabCapacity > 0) ? slabCapacity : LIST_SLAB;
+
+	return pool;
+}
+
+// Takes an element from the free list, or else the newest slab, adding a
+// slab when that is full.
+ListElement* listPoolAlloc(ListPool* pool) {
+	ListElement* element = pool->freeList;
+
+	if(element != NULL) {
+		pool->freeList = element->next;
+		return element;
+	}
+
+	ListSlab* slab = pool->slabs;
+
+	if(slab == NULL || slab->used == slab->capacity) {
+		slab = malloc(sizeof(ListSlab) + pool->slabCapacity * sizeof(ListElement));
+
+		if(slab == NULL) {
+			fprintf(stderr, "Allocation of list slab failed.\n");
+			exit(1);
+		}
+
+		slab->next = pool->slabs;
+		slab->capacity = pool->slabCapacity;
+		slab->used = 0;
+		pool->slabs = slab;
+		pool->slabCapacity *= 2;
+	}
+
+	return (ListElement*)(slab + 1) + (slab->used)++;
+}
+
+void listPoolFree(ListPool* pool, ListElement* element) {
+	element->next = pool->freeList;
+	pool->freeList = element;
+}
+
+// Frees every slab, and so every element of every list using the pool.
+void listPoolDestroy(ListPool* pool) {
+	ListSlab* slab = pool->slabs;
+
+	while(slab != NULL) {
+		ListSlab* next = slab->next;
+		free(slab);
+		slab = next;
+	}
+
+	free(pool);
+}
+
 #endif
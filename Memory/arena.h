@@ -0,0 +1,163 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every allocation is aligned for any scalar or vector type. Chunks are
+// allocated on this boundary, and offsets into them rounded to it.
+#define ARENA_ALIGN 32
+
+typedef struct _ArenaChunk {
+	struct _ArenaChunk* next;
+	size_t size;
+	size_t used;
+} ArenaChunk;
+
+// Bump allocator. Memory is handed out from large chunks and given back all
+// at once by arenaReset(), which keeps the chunks for the next round.
+typedef struct {
+	ArenaChunk* head;
+	ArenaChunk* current;
+	size_t chunkSize;
+
+	// Chunks allocated over the arena's life.
+	size_t allocations;
+} Arena;
+
+// Position in an arena, to give back everything allocated after it.
+typedef struct {
+	ArenaChunk* chunk;
+	size_t used;
+} ArenaMark;
+
+#define getChunkData(chunk) ((char*)(chunk) + ARENA_ALIGN)
+
+Arena* arenaCreate(size_t chunkSize);
+void* arenaAlloc(Arena* arena, size_t size);
+void* arenaGrow(Arena* arena, void* data, size_t oldSize, size_t newSize);
+void arenaReset(Arena* arena);
+ArenaMark arenaMark(const Arena* arena);
+void arenaRelease(Arena* arena, ArenaMark mark);
+void arenaDestroy(Arena* arena);
+
+
+// Function definitions:
+
+Arena* arenaCreate(size_t chunkSize) {
+	Arena* arena = malloc(sizeof(Arena));
+
+	if(arena == NULL) {
+		fprintf(stderr, "Allocation of arena failed.\n");
+		exit(1);
+	}
+
+	arena->head = NULL;
+	arena->current = NULL;
+	arena->chunkSize = chunkSize;
+	arena->allocations = 0;
+
+	return arena;
+}
+
+void* arenaAlloc(Arena* arena, size_t size) {
+	ArenaChunk* chunk = arena->current;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	// Move on to the next kept chunk, or add one, until the request fits.
+	while(chunk == NULL || chunk->used + size > chunk->size) {
+		ArenaChunk* next = (chunk == NULL) ? arena->head : chunk->next;
+
+		if(next == NULL || next->size < size) {
+			size_t chunkSize = (size > arena->chunkSize) ? size : arena->chunkSize;
+			ArenaChunk* newChunk;
+
+			// malloc() only promises 16 bytes.
+			if(posix_memalign((void**)&newChunk, ARENA_ALIGN,
+					ARENA_ALIGN + chunkSize) != 0) {
+				fprintf(stderr, "Allocation of arena chunk failed.\n");
+				exit(1);
+			}
+
+			newChunk->size = chunkSize;
+			newChunk->next = next;
+			++(arena->allocations);
+
+			if(chunk == NULL) {
+				arena->head = newChunk;
+			} else {
+				chunk->next = newChunk;
+			}
+
+			next = newChunk;
+		}
+
+		chunk = next;
+		chunk->used = 0;
+	}
+
+	arena->current = chunk;
+	chunk->used += size;
+
+	return getChunkData(chunk) + chunk->used - size;
+}
+
+// Resizes an allocation. The last allocation grows in place when its chunk
+// has room, anything else is copied to a new allocation.
+void* arenaGrow(Arena* arena, void* data, size_t oldSize, size_t newSize) {
+	ArenaChunk* chunk = arena->current;
+	size_t oldAligned = (oldSize + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	size_t newAligned = (newSize + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if(data != NULL && chunk != NULL
+			&& (char*)data + oldAligned == getChunkData(chunk) + chunk->used
+			&& chunk->used - oldAligned + newAligned <= chunk->size) {
+		chunk->used = chunk->used - oldAligned + newAligned;
+		return data;
+	}
+
+	void* newData = arenaAlloc(arena, newSize);
+
+	if(data != NULL) {
+		memcpy(newData, data, oldSize);
+	}
+
+	return newData;
+}
+
+// Releases every allocation at once while keeping the chunks.
+void arenaReset(Arena* arena) {
+	arena->current = NULL;
+}
+
+ArenaMark arenaMark(const Arena* arena) {
+	ArenaMark mark = { arena->current,
+			(arena->current != NULL) ? arena->current->used : 0 };
+
+	return mark;
+}
+
+// Releases every allocation made since the mark, keeping the chunks.
+void arenaRelease(Arena* arena, ArenaMark mark) {
+	arena->current = mark.chunk;
+
+	if(mark.chunk != NULL) {
+		mark.chunk->used = mark.used;
+	}
+}
+
+void arenaDestroy(Arena* arena) {
+	ArenaChunk* chunk = arena->head;
+
+	while(chunk != NULL) {
+		ArenaChunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	free(arena);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../Calc/context.h"
+
+// Significant digits the arbitrary precision backend is checked to.
+#define CHECK_DIGITS    300
+
+typedef struct {
+	const char* expression;
+	const char* expected;
+} Check;
+
+// Logarithms to CHECK_DIGITS significant digits, from Python's decimal
+// module. Near 1 and far from it, both signs of the result, and arguments
+// scaled by powers of BIG_BASE.
+const Check checks[] = {
+	{ "log(7)",
+			"1.94591014905531330510535274344317972963708472958186118845939014"
+			"9937579862752069267787658498587871526993061694205851140911723752"
+			"2576777868431489580951639007759078244681042747833822593490084673"
+			"7441250497370485355176783557748624015102774180886867107514121348"
+			"093879741831081025182316849301407330639328771" },
+	{ "log(2)",
+			"0.69314718055994530941723212145817656807550013436025525412068000"
+			"9493393621969694715605863326996418687542001481020570685733685520"
+			"2357581305570326707516350759619307275708283714351903070386238916"
+			"7347112335011536449795523912047517268157493206515552473413952588"
+			"295045300709532636664265410423915781495204374" },
+	{ "log(123456789012)",
+			"25.5391570452473550861277037999797596706148592017840281324173934"
+			"9743533903393135345249324065723482589816835909587787344256186672"
+			"3098923288943734508087384357527790219773659096419574197250856305"
+			"1939858415594566611196612625507506132017091071014148729656218422"
+			"428924056073492969910998204228701984428915352" },
+	{ "log(0.000000000000001234)",
+			"-34.328515469427489188909042384250188344029891744318795113773816"
+			"1262028588296067936284293831333176521027562164421758132882586773"
+			"8140561617024936882680151507642160266621701060431057859698688752"
+			"2784919464102784302592862897410060091697817057277985256657107752"
+			"5431378601124576189711963123041564143912254549" },
+	{ "log(1.0000001)",
+			"9.99999950000003333333083333353333331666666809523797023810634920"
+			"5349206440115431782107551337479908986575645950646634470099502785"
+			"3232181834349564631098785339622598535030716022904396399542468710"
+			"1181765654401713863061037935154084313053867280855781022386886884"
+			"000444998070017767479155142697215451482753212e-08" },
+};
+
+// Evaluates every check on the arbitrary precision backend, printing those
+// whose text differs from the expected digits.
+// Returns the exit code: 0 if all pass, 1 otherwise.
+int main(void) {
+	CalcContext* context = calcContextCreate();
+	int count = sizeof(checks) / sizeof(checks[0]);
+	int failed = 0;
+
+	calcSetPrecision(context, CHECK_DIGITS);
+
+	for(int i = 0; i < count; ++i) {
+		CalcResult result;
+		Status status = calcEvaluate(context, checks[i].expression,
+				strlen(checks[i].expression), &result);
+
+		if(status != success || result.text == NULL
+				|| strcmp(result.text, checks[i].expected) != 0) {
+			fprintf(stderr, "FAIL %s\n  got      %s\n  expected %s\n",
+					checks[i].expression,
+					(status == success && result.text != NULL)
+					? result.text : calcStatusMessage(status),
+					checks[i].expected);
+			++failed;
+		}
+	}
+
+	printf("%d of %d bignum checks passed.\n", count - failed, count);
+	calcContextDestroy(context);
+	return (failed > 0) ? 1 : 0;
+}
@@ -1,691 +1,882 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
-
-#include "Lists/Stacks/stack.h"
-
-#define MK_STRING(x)      #x
-#define CONV_TO_STRING(x) MK_STRING(x)
-
-#define E               2.7182818284590452354
-#define PI              3.1415926535897932384
-#define STR_E           CONV_TO_STRING(E)
-#define STR_PI          CONV_TO_STRING(PI)
-#define CONST_ACC       strlen(STR_PI)
-#define BUFFER          256
-#define CHUNK_SIZE      8
-
-typedef enum {
-	success,
-	divZero,
-	evalFail,
-	unknownToken,
-	unpairedBracket,
-	noDigit,
-	noOperator,
-	extraDecimalSep,
-} Status;
-
-typedef enum {
-	unknown,
-	digit,
-	decimalSep,
-	operator,
-	lbracket,
-	rbracket,
-	constant,
-	function,
-	whitespace,
-	EOL
-} TokenType;
-
-typedef enum {
-	none,
-	sqrt_,
-	sin_,
-	cos_,
-	tan_
-} FunctionType;
-
-typedef enum {
-	left,
-	right
-} AssocType;
-
-void shuntingYard(char* inputString, double* prevAns);
-char** strToMathArray(char* inputString, double* prevAns);
-Status popAndEval(Stack* opStack, Stack* evalStack);
-double* applyOperation(void* operator, void* lOperandPtr, void* rOperandPtr);
-double* applyFunction(FunctionType functionKey, void* operandPtr);
-int getPriority(void* operator1, void* operator2);
-AssocType getAssoc(void* operator);
-TokenType tokenType(void* token);
-FunctionType functionType(void* token);
+#include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "Memory/arena.h"
+#include "Calc/program.h"
+#include "Calc/batch.h"
+#include "Calc/batchfile.h"
+#include "Calc/lexer.h"
+#include "Calc/compiler.h"
+#include "Calc/context.h"
+#include "Calc/store.h"
+#include "Calc/server.h"
+#include "Calc/codegen.h"
+#include "IO/mapfile.h"
+#include "IO/writer.h"
+
+#define MAP_ROWS        65536
+#define MAP_VARS        64
+
+int mapColumn(const char* expression, const char* vars);
+int gradientRows(const char* expression, const char* vars);
+int boundRows(const char* expression, const char* vars);
+int parseRow(const char* line, int count, double* values);
+int emitC(const char* expression, const char* vars);
+int defineVariables(CalcContext* context, const char* vars, int* slots);
+int batchFile(const char* path, int threadCount, size_t cacheLimit,
+		unsigned jitThreshold, int showStats);
+int buildStore(const char* path, const char* vars);
+int serve(const char* path, size_t cacheLimit, unsigned jitThreshold,
+		int precision);
+int parseSize(const char* text, size_t* size);
 void printStatus(Status status);
+void printCacheStats(const CalcCacheStats* stats);
+void printStats(const CalcStats* stats);
+void printUsage(const char* name);
+
+int main(int argc, char** argv) {
+	const char* mapExpression = NULL;
+	const char* emitExpression = NULL;
+	const char* gradientExpression = NULL;
+	const char* boundExpression = NULL;
+	const char* mapVars = NULL;
+	const char* batchPath = NULL;
+	const char* storePath = NULL;
+	const char* servePath = NULL;
+	// Default to one worker per online processor.
+	long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t cacheLimit = 0;
+	long jitThreshold = JIT_THRESHOLD;
+	long precision = 0;
+	int showStats = 0;
+
+	for(int i = 1; i < argc; ++i) {
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		char* end;
+
+		// The only option without a value.
+		if(strcmp(argv[i], "--stats") == 0) {
+			showStats = 1;
+			continue;
+		}
+
+		if(value == NULL) {
+			printUsage(argv[0]);
+			return 1;
+		} else if(strcmp(argv[i], "--map") == 0) {
+			mapExpression = value;
+		} else if(strcmp(argv[i], "--emit-c") == 0) {
+			emitExpression = value;
+		} else if(strcmp(argv[i], "--gradient") == 0) {
+			gradientExpression = value;
+		} else if(strcmp(argv[i], "--bound") == 0) {
+			boundExpression = value;
+		} else if(strcmp(argv[i], "--vars") == 0) {
+			mapVars = value;
+		} else if(strcmp(argv[i], "--batch") == 0) {
+			batchPath = value;
+		} else if(strcmp(argv[i], "--build-store") == 0) {
+			storePath = value;
+		} else if(strcmp(argv[i], "--serve") == 0) {
+			servePath = value;
+		} else if(strcmp(argv[i], "--threads") == 0) {
+			threadCount = strtol(value, &end, 10);
+
+			if(*end != '\0' || threadCount < 1 || threadCount > 1024) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "--jit") == 0) {
+			jitThreshold = strtol(value, &end, 10);
+
+			if(*end != '\0' || jitThreshold < 0 || jitThreshold > UINT_MAX) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "--precision") == 0) {
+			precision = strtol(value, &end, 10);
+
+			if(*end != '\0' || precision < 1 || precision > 1000000) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "--cache") == 0) {
+			if(parseSize(value, &cacheLimit) != 0) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+
+		++i;
+	}
+
+	int modes = (mapExpression != NULL) + (emitExpression != NULL)
+			+ (gradientExpression != NULL) + (boundExpression != NULL)
+			+ (batchPath != NULL) + (storePath != NULL) + (servePath != NULL);
+
+	// Only the interactive mode and the server work to a set precision.
+	if(modes > 1 || (mapVars != NULL && mapExpression == NULL
+			&& emitExpression == NULL && gradientExpression == NULL
+			&& boundExpression == NULL && storePath == NULL)
+			|| (modes > 0 && precision > 0 && servePath == NULL)) {
+		printUsage(argv[0]);
+		return 1;
+	} else if(servePath != NULL) {
+		return serve(servePath, cacheLimit, (unsigned)jitThreshold,
+				(int)precision);
+	} else if(storePath != NULL) {
+		return buildStore(storePath, mapVars);
+	} else if(emitExpression != NULL) {
+		return emitC(emitExpression, mapVars);
+	} else if(mapExpression != NULL) {
+		return mapColumn(mapExpression, mapVars);
+	} else if(gradientExpression != NULL) {
+		return gradientRows(gradientExpression, mapVars);
+	} else if(boundExpression != NULL) {
+		return boundRows(boundExpression, mapVars);
+	} else if(batchPath != NULL) {
+		return batchFile(batchPath, (threadCount < 1) ? 1 : (int)threadCount,
+				cacheLimit, (unsigned)jitThreshold, showStats);
+	}
+
+	CalcContext* context = calcContextCreate();
+	calcSetCacheLimit(context, cacheLimit);
+	calcSetJitThreshold(context, (unsigned)jitThreshold);
+	calcEnableStats(context, showStats);
+	calcSetPrecision(context, (int)precision);
+	calcSetThreads(context, (int)threadCount);
 
-double prevAns = 0.0;
+	// Grown by getline() to fit the longest line so far.
+	char* inputString = NULL;
+	size_t inputCapacity = 0;
 
-int main(void) {
 	while(1) {
-		char inputString[BUFFER];
+		CalcResult result;
 
 		printf("Cal>> ");
-		fgets(inputString, sizeof(inputString), stdin);
 
-		if(strncmp(inputString, "quit\n", 5) == 0) {
+		ssize_t inputLength = getline(&inputString, &inputCapacity, stdin);
+
+		if(inputLength < 0 || strcmp(inputString, "quit\n") == 0
+				|| strcmp(inputString, "quit") == 0) {
 			printf("\nQuitting...\n");
 			break;
 		}
 
-		shuntingYard(inputString, &prevAns);
+		Status status = calcEvaluate(context, inputString, inputLength, &result);
+
+		if(status == unknownToken) {
+			fprintf(stderr, "Error: '%.*s' is an unrecognised token.\n",
+					result.errorLength, inputString + result.errorOffset);
+		}
+
+		printStatus(status);
+
+		if(status == success && !result.empty && result.text != NULL) {
+			printf("ANS>> %s\n", result.text);
+		} else if(status == success && !result.empty) {
+			printf("ANS>> %g\n", result.value);
+		}
+	}
+
+	if(cacheLimit > 0) {
+		CalcCacheStats stats;
+
+		calcGetCacheStats(context, &stats);
+		printCacheStats(&stats);
 	}
 
+	if(showStats) {
+		CalcStats stats;
+
+		calcGetStats(context, &stats);
+		printStats(&stats);
+	}
+
+	free(inputString);
+	calcContextDestroy(context);
 	return 0;
 }
 
-// Implements the shunting yard algorithm to evaluate the expression on a
-// reverse polish stack.
-void shuntingYard(char* inputString, double* prevAns) {
-	Stack* opStack = stackCreate(free);
-	Stack* evalStack = stackCreate(free);
-	char** exprArray = strToMathArray(inputString, prevAns);
-
-	Status tmpStatus, evalStatus = success;
-	int exprPos, prevOpPos = -1;
-
-	for(exprPos = 0; *exprArray[exprPos] != '\n'; ++exprPos) {
-		char* token = exprArray[exprPos];
-		TokenType tokenGroup = tokenType(token);
-		int isSign = 0;
-
-		if(*token == '+' || *token == '-') {
-			// If the following character is a digit.
-			if(tokenType(token + 1) == digit) {
-				isSign = 1;
-			}
-		}
+// Evaluates one expression over rows of numbers read from stdin, one row per
+// line. With no variables named each row is a single number bound to ans;
+// otherwise it holds a value for each of vars, a comma separated list of
+// names, in order. The expression is compiled once and evaluated in blocks
+// of rows.
+// Returns the exit code.
+int mapColumn(const char* expression, const char* vars) {
+	CalcContext* context = calcContextCreate();
+	CalcProgram* program;
+	CalcResult result;
+	int slots[MAP_VARS];
+	int varCount = defineVariables(context, vars, slots);
+
+	if(varCount < 0) {
+		calcContextDestroy(context);
+		return 1;
+	}
+
+	Status status = calcCompile(context, expression, strlen(expression),
+			&program, &result);
 
-		// If the current token is a number.
-		if(tokenGroup == digit || tokenGroup == decimalSep || isSign) {
-			double* mathToken = malloc(sizeof(double));
-			*mathToken = atof(token);
-			stackPush(evalStack, mathToken);
+	if(status == unknownToken) {
+		fprintf(stderr, "Error: '%.*s' is an unrecognised token.\n",
+				result.errorLength, expression + result.errorOffset);
+	}
+
+	if(status != success) {
+		printStatus(status);
+		calcContextDestroy(context);
+		return 1;
+	}
 
-			free(token);
+	// Slots not read from the input, ans among them when variables are
+	// named, stay at 0.
+	int slotCount = calcVariableCount(context);
+	double* storage = calloc((size_t)(slotCount + 1) * MAP_ROWS, sizeof(double));
+	const double** columns = malloc(slotCount * sizeof(double*));
+	double* results = storage + (size_t)slotCount * MAP_ROWS;
+	Status* rowStatus = malloc(MAP_ROWS * sizeof(Status));
+	Writer* writer = writerCreate(STDOUT_FILENO, WRITER_SIZE);
+	char* line = NULL;
+	size_t lineCapacity = 0;
+	size_t rows = 0, rowOffset = 0;
+	int endOfInput = 0;
+
+	if(storage == NULL || columns == NULL || rowStatus == NULL) {
+		fprintf(stderr, "Allocation of column buffers failed.\n");
+		exit(1);
+	}
+
+	for(int slot = 0; slot < slotCount; ++slot) {
+		columns[slot] = storage + (size_t)slot * MAP_ROWS;
+	}
 
-		// If the current token is an operator.
-		} else if(tokenGroup == operator) {
-			// If previous token was an operator.
-			if(exprPos > 1 && prevOpPos == exprPos - 1) {
-				stackPush(opStack, token);
+	while(!endOfInput) {
+		endOfInput = (getline(&line, &lineCapacity, stdin) < 0);
+
+		if(!endOfInput) {
+			double row[MAP_VARS];
+			int parsed = parseRow(line, varCount, row);
+
+			// Skip blank lines.
+			if(parsed > 0) {
 				continue;
+			} else if(parsed < 0) {
+				fprintf(stderr, "Error: row %zu does not hold %d number%s.\n",
+						rowOffset + rows + 1, varCount, (varCount == 1) ? "" : "s");
 			}
 
-			// If operator stack is non-empty and is not topped by
-			// a left bracket.
-			if(getStackSize(opStack) > 0
-					&& *(char*)stackPeek(opStack) != '(') {
-				// While there is an operator on the opStack
-				// with greater or equal precedence.
-				while(tokenType(stackPeek(opStack)) == operator &&
-						getPriority(token, stackPeek(opStack)) <= 0) {
-					if(getPriority(token, stackPeek(opStack)) == 0
-							&& getAssoc(token) == right) {
-						break;
-					}
-
-					tmpStatus = popAndEval(opStack, evalStack);
-
-					if(tmpStatus != success) {
-						evalStatus = tmpStatus;
-					}
-
-					if(getStackSize(opStack) == 0) {
-						break;
-					}
-				}
+			for(int i = 0; i < varCount; ++i) {
+				storage[(size_t)slots[i] * MAP_ROWS + rows] = row[i];
 			}
 
-			stackPush(opStack, token);
-			prevOpPos = exprPos;
+			++rows;
+		}
 
-		} else if(tokenGroup == lbracket) {
-			stackPush(opStack, token);
-		} else if(tokenGroup == rbracket) {
-			if(getStackSize(opStack) != 0) {
-				while(*(char*)stackPeek(opStack) != '(') {
-					tmpStatus = popAndEval(opStack, evalStack);
+		if(rows == MAP_ROWS || (endOfInput && rows > 0)) {
+			calcRunBatch(program, columns, rows, results, rowStatus);
 
-					if(tmpStatus != success) {
-						evalStatus = tmpStatus;
-					}
+			for(size_t i = 0; i < rows; ++i) {
+				if(rowStatus[i] != success) {
+					fprintf(stderr, "Row %zu: ", rowOffset + i + 1);
+					printStatus(rowStatus[i]);
 				}
 
-				// Dummy variable to hold the left bracket before it is
-				// deallocated.
-				void** tempLBracket = malloc(sizeof(void*));
-				stackPop(opStack, tempLBracket);
-				// Discard left bracket.
-				free(*tempLBracket);
-				free(tempLBracket);
-			} else {
-				evalStatus = evalFail;
+				writerNumber(writer, "%g\n", results[i]);
 			}
 
-			// Discard right bracket.
-			free(token);
-		} else if(tokenGroup == function) {
-			stackPush(opStack, token);
+			rowOffset += rows;
+			rows = 0;
 		}
 	}
 
-	// Free the endToken (marked by the newline).
-	free(exprArray[exprPos]);
+	int exitCode = (writerDestroy(writer) == 0) ? 0 : 1;
 
-	while(getStackSize(opStack) > 0 && evalStatus == success) {
-		tmpStatus = popAndEval(opStack, evalStack);
+	free(line);
+	free(storage);
+	free(columns);
+	free(rowStatus);
+	calcProgramDestroy(program);
+	calcContextDestroy(context);
+	return exitCode;
+}
 
-		if(tmpStatus != success) {
-			evalStatus = tmpStatus;
-		}
+// Evaluates one expression and its gradient over rows of numbers read from
+// stdin, as --map reads them, printing the value and then its partial
+// derivative by each variable in the order named. Every row is one reverse
+// differentiation, rather than two evaluations per variable.
+// Returns the exit code.
+int gradientRows(const char* expression, const char* vars) {
+	CalcContext* context = calcContextCreate();
+	CalcProgram* program;
+	CalcResult result;
+	int slots[MAP_VARS];
+	int varCount = defineVariables(context, vars, slots);
+
+	if(varCount < 0) {
+		calcContextDestroy(context);
+		return 1;
 	}
 
-	printStatus(evalStatus);
+	Status status = calcCompile(context, expression, strlen(expression),
+			&program, &result);
 
-	if(exprPos != 0 && evalStatus == success) {
-		double result = *(double*)stackPeek(evalStack);
-		printf("ANS>> %g\n", result);
-		*prevAns = result;
+	if(status == unknownToken) {
+		fprintf(stderr, "Error: '%.*s' is an unrecognised token.\n",
+				result.errorLength, expression + result.errorOffset);
 	}
 
-	stackDestroy(opStack);
-	stackDestroy(evalStack);
-	free(exprArray);
-}
+	if(status != success) {
+		printStatus(status);
+		calcContextDestroy(context);
+		return 1;
+	}
+
+	// As for --map, slots not read from the input stay at 0.
+	int slotCount = calcVariableCount(context);
+	double* values = calloc(2 * (size_t)slotCount, sizeof(double));
+	double* gradient = values + slotCount;
+	Writer* writer = writerCreate(STDOUT_FILENO, WRITER_SIZE);
+	char* line = NULL;
+	size_t lineCapacity = 0;
+	size_t rowCount = 0;
+
+	if(values == NULL) {
+		fprintf(stderr, "Allocation of gradient buffers failed.\n");
+		exit(1);
+	}
+
+	while(getline(&line, &lineCapacity, stdin) >= 0) {
+		double row[MAP_VARS], value;
+		int parsed = parseRow(line, varCount, row);
 
-// Converts the input string into a ragged array.
-// Returns a pointer to the array.
-char** strToMathArray(char* inputString, double* prevAns) {
-	int exprPos = 0, exprSize = CHUNK_SIZE;
-	char** exprArray = malloc(exprSize * sizeof(char*));
-	int lbracketCount = 0, rbracketCount = 0, digitCount = 0,
-		emptyInput = 0, opCount = 0;
-	Status parseStatus = success;
-
-	for(unsigned int i = 0; i < strlen(inputString); ++i) {
-		// Reallocate more space in chunks if necessary.
-		if((exprPos + 1) % CHUNK_SIZE == 0) {
-			exprSize += CHUNK_SIZE;
-			exprArray = realloc(exprArray, exprSize * sizeof(char*));
+		// Skip blank lines.
+		if(parsed > 0) {
+			continue;
 		}
 
-		char token = inputString[i];
-		TokenType tokenGroup = tokenType(inputString + i);
+		++rowCount;
 
-		// Is the variable a positive (+) or negative (-) sign.
-		int isSign = 0;
+		if(parsed < 0) {
+			fprintf(stderr, "Error: row %zu does not hold %d number%s.\n",
+					rowCount, varCount, (varCount == 1) ? "" : "s");
+		}
 
-		if(token == '+' || token == '-') {
-			TokenType nextToken = tokenType(inputString + i + 1);
+		for(int i = 0; i < varCount; ++i) {
+			values[slots[i]] = row[i];
+		}
 
-			if(i == 0 && nextToken == digit) {
-				isSign = 1;
-			} else {
-				TokenType prevToken = tokenType(inputString + i - 1);
+		status = calcGradient(context, program, values, &value, gradient);
 
-				if((prevToken == lbracket
-						|| prevToken == operator)
-						&& nextToken == digit) {
+		if(status != success) {
+			fprintf(stderr, "Row %zu: ", rowCount);
+			printStatus(status);
+			value = NAN;
 
-					isSign = 1;
-				}
+			for(int slot = 0; slot < slotCount; ++slot) {
+				gradient[slot] = NAN;
 			}
 		}
 
-		if(tokenGroup == EOL) {
-			char* endToken = malloc(2);
-			endToken[0] = '\n';
-			endToken[1] = '\0';
-			exprArray[exprPos] = endToken;
-			++exprPos;
-
-			emptyInput = (*inputString == '\n');
+		writerNumber(writer, "%g", value);
 
-		// Necessary to make sure the string is split correctly into
-		// full numbers and not just single digits.
-		} else if(tokenGroup == digit ||
-				tokenGroup == decimalSep
-				|| isSign) {
-
-			int numLen = 1, tokenSize = CHUNK_SIZE, sepCount;
-			char* numToken = malloc(tokenSize);
+		for(int i = 0; i < varCount; ++i) {
+			writerNumber(writer, ",%g", gradient[slots[i]]);
+		}
 
-			(tokenGroup == digit) ? (digitCount = 1) : (digitCount = 0);
+		writerWrite(writer, "\n", 1);
+	}
 
-			// Ignore the positive sign as it is assumed.
-			if(token == '+') {
-				++i;
-			}
+	int exitCode = (writerDestroy(writer) == 0) ? 0 : 1;
 
-			// Count the length of the number by iterating until
-			// token is no longer a digit or decimal point.
-			while(tokenType(inputString + i + numLen) == digit
-					|| tokenType(inputString + i + numLen)
-					== decimalSep) {
+	free(line);
+	free(values);
+	calcProgramDestroy(program);
+	calcContextDestroy(context);
+	return exitCode;
+}
 
-				// Add more space in chunks if needed.
-				if((numLen + 1) % CHUNK_SIZE == 0) {
-					tokenSize += CHUNK_SIZE;
-					numToken = realloc(numToken, tokenSize);
-				}
+// Bounds one expression over rows of ranges read from stdin, each holding
+// the least and greatest value of every variable in turn, with ans the one
+// variable if none are named. Prints the least and greatest value the
+// expression takes over each row's ranges, rounded outward, so that they
+// enclose it exactly.
+// Returns the exit code.
+int boundRows(const char* expression, const char* vars) {
+	CalcContext* context = calcContextCreate();
+	CalcProgram* program;
+	CalcResult result;
+	int slots[MAP_VARS];
+	int varCount = defineVariables(context, vars, slots);
+
+	if(varCount < 0) {
+		calcContextDestroy(context);
+		return 1;
+	}
 
-				// Track number of digits and decimal points.
-				if(tokenType(inputString + i + numLen) == digit) {
-					++digitCount;
-				}
+	Status status = calcCompile(context, expression, strlen(expression),
+			&program, &result);
 
-				++numLen;
-			}
+	if(status == unknownToken) {
+		fprintf(stderr, "Error: '%.*s' is an unrecognised token.\n",
+				result.errorLength, expression + result.errorOffset);
+	}
 
-			// Copy data over and attach the pointer to the array.
-			strncpy(numToken, inputString + i, numLen);
-			numToken[numLen] = '\0';
-			exprArray[exprPos] = numToken;
-			++exprPos;
+	if(status != success) {
+		printStatus(status);
+		calcContextDestroy(context);
+		return 1;
+	}
 
-			// Skip to after the number.
-			i += numLen - 1;
+	// Slots not read from the input stay at [0, 0].
+	int slotCount = calcVariableCount(context);
+	CalcInterval* ranges = calloc(slotCount, sizeof(CalcInterval));
+	Writer* writer = writerCreate(STDOUT_FILENO, WRITER_SIZE);
+	char* line = NULL;
+	size_t lineCapacity = 0;
+	size_t rowCount = 0;
+
+	if(ranges == NULL) {
+		fprintf(stderr, "Allocation of ranges failed.\n");
+		exit(1);
+	}
 
-			// The number of decimal places in the number.
-			sepCount = numLen - digitCount;
+	while(getline(&line, &lineCapacity, stdin) >= 0) {
+		double row[2 * MAP_VARS];
+		CalcInterval bound;
+		int parsed = parseRow(line, 2 * varCount, row);
 
-			if(sepCount > 1) {
-				parseStatus = extraDecimalSep;
-				break;
-			}
+		// Skip blank lines.
+		if(parsed > 0) {
+			continue;
+		}
 
-		// Handle brackets and operators.
-		} else if(tokenGroup == lbracket || tokenGroup == rbracket
-				|| tokenGroup == operator) {
+		++rowCount;
 
-			if(tokenGroup == lbracket) {
-				++lbracketCount;
-			} else if(tokenGroup == rbracket) {
-				++rbracketCount;
-			} else {
-				++opCount;
-			}
+		if(parsed < 0) {
+			fprintf(stderr, "Error: row %zu does not hold %d numbers.\n",
+					rowCount, 2 * varCount);
+		}
 
-			char* symToken = malloc(sizeof(char*));
-			*symToken = token;
-			*(symToken + 1) = '\0';
-			exprArray[exprPos] = symToken;
-			++exprPos;
-		} else if(tokenGroup == constant) {
-			char* constToken = malloc(CONST_ACC + 2);
-
-			if(strncmp(inputString + i, "ans", 3) == 0) {
-				snprintf(constToken, CONST_ACC + 2, "%lf\n", *prevAns);
-				i += 2;
-			} else if(strncmp(inputString + i, "pi", 2) == 0) {
-				strncpy(constToken, STR_PI, CONST_ACC + 1);
-				i += 1;
-			} else if(strncmp(inputString + i, "e", 1) == 0) {
-				strncpy(constToken, STR_E, CONST_ACC + 1);
-			}
+		for(int i = 0; i < varCount; ++i) {
+			ranges[slots[i]].lo = row[2 * i];
+			ranges[slots[i]].hi = row[2 * i + 1];
 
-			++digitCount;
-			exprArray[exprPos] = constToken;
-			++exprPos;
-		} else if(tokenGroup == function) {
-			FunctionType functionKey = functionType(inputString + i);
-			char* funcToken = malloc(CHUNK_SIZE);
-			int functionLen;
-
-			// Add function to the expression array and move to the
-			// next token position.
-			switch(functionKey) {
-				case sqrt_:
-					functionLen = 4;
-					strncpy(funcToken, "sqrt", functionLen + 1);
-					break;
-				case sin_:
-					functionLen = 3;
-					strncpy(funcToken, "sin", functionLen + 1);
-					break;
-				case cos_:
-					functionLen = 3;
-					strncpy(funcToken, "cos", functionLen + 1);
-					break;
-				case tan_:
-					functionLen = 3;
-					strncpy(funcToken, "tan", functionLen + 1);
-					break;
-				default:
-					break;
+			if(row[2 * i] > row[2 * i + 1]) {
+				fprintf(stderr, "Error: row %zu has a range with its least value"
+						" greater than its greatest.\n", rowCount);
+				ranges[slots[i]].lo = NAN;
+				ranges[slots[i]].hi = NAN;
 			}
+		}
 
-			exprArray[exprPos] = funcToken;
-			++opCount;
-			++exprPos;
-			i += functionLen - 1;
+		status = calcBound(context, program, ranges, &bound);
 
-		// Ignore spaces, and tabs.
-		} else if(tokenGroup == whitespace) {
-			continue;
-		} else if(tokenGroup == unknown) {
-			parseStatus = unknownToken;
-			fprintf(stderr, "Error: '%c' is an unrecognised token.\n", token);
-			break;
+		if(status != success) {
+			fprintf(stderr, "Row %zu: ", rowCount);
+			printStatus(status);
+			bound.lo = NAN;
+			bound.hi = NAN;
 		}
+
+		writerNumber(writer, "%.17g", bound.lo);
+		writerNumber(writer, ",%.17g\n", bound.hi);
 	}
 
-	if(lbracketCount != rbracketCount) {
-		parseStatus = unpairedBracket;
-	} else if(digitCount == 0 && emptyInput == 0
-			&& parseStatus != unknownToken) {
+	int exitCode = (writerDestroy(writer) == 0) ? 0 : 1;
 
-		parseStatus = noDigit;
-	} else if(opCount == 0 && exprPos != 2 && emptyInput == 0) {
-		parseStatus = noOperator;
+	free(line);
+	free(ranges);
+	calcProgramDestroy(program);
+	calcContextDestroy(context);
+	return exitCode;
+}
+
+// Reads count numbers, separated by commas or whitespace, from a line of
+// input into values, with NAN for any missing.
+// Returns 0, 1 if the line is blank, or -1 if it does not hold exactly count
+// numbers.
+int parseRow(const char* line, int count, double* values) {
+	const char* pos = line;
+	int bad = 0;
+
+	while(charType(*pos) == whitespace) {
+		++pos;
+	}
+
+	if(charType(*pos) == EOL) {
+		return 1;
 	}
 
-	if(parseStatus != success) {
-		printStatus(parseStatus);
+	for(int i = 0; i < count; ++i) {
+		char* end;
 
-		// Deallocate all tokens.
-		for(int i = 0; i < exprPos; ++i) {
-			free(exprArray[i]);
+		values[i] = strtod(pos, &end);
+
+		if(end == pos) {
+			values[i] = NAN;
+			bad = 1;
 		}
 
-		// Mark exprArray as empty.
-		char* endToken = malloc(2);
-		endToken[0] = '\n';
-		endToken[1] = '\0';
-		exprArray[0] = endToken;
+		pos = end;
+
+		while(charType(*pos) == whitespace || *pos == ',') {
+			++pos;
+		}
 	}
 
-	return exprArray;
+	return (bad || charType(*pos) != EOL) ? -1 : 0;
 }
 
-// Pops operands off the evaluation stack, applies the next mathematical
-// procedure, and pushes the result back.
-// Returns the status of the evaluation.
-Status popAndEval(Stack* opStack, Stack* evalStack) {
-	void** opToken = malloc(sizeof(void*));
-	stackPop(opStack, opToken);
+// Prints an expression as a standalone C function of its variables, vars
+// being a comma separated list of their names as for --map.
+// Returns the exit code.
+int emitC(const char* expression, const char* vars) {
+	CalcContext* context = calcContextCreate();
+	CalcProgram* program;
+	CalcResult result;
+	int slots[MAP_VARS];
+
+	if(vars != NULL && defineVariables(context, vars, slots) < 0) {
+		calcContextDestroy(context);
+		return 1;
+	}
 
-	FunctionType functionKey = functionType(*opToken);
+	Status status = calcCompile(context, expression, strlen(expression),
+			&program, &result);
 
-	if(functionKey != none) {
-		void** operand = malloc(sizeof(void*));
-		stackPop(evalStack, operand);
+	if(status == unknownToken) {
+		fprintf(stderr, "Error: '%.*s' is an unrecognised token.\n",
+				result.errorLength, expression + result.errorOffset);
+	}
 
-		double* result = applyFunction(functionKey, *operand);
-		stackPush(evalStack, result);
+	printStatus(status);
 
-		free(*opToken);
-		free(opToken);
-		free(*operand);
-		free(operand);
-		return success;
+	if(status != success) {
+		calcContextDestroy(context);
+		return 1;
 	}
 
-	// evalStack only can only support unary operations.
-	if(getStackSize(evalStack) == 1) {
-		if(**(char**)opToken == '-') {
-				void** operand = malloc(sizeof(void*));
-				stackPop(evalStack, operand);
+	int exitCode = (programEmitC(program->program, context->names, expression,
+			stdout) == 0) ? 0 : 1;
 
-				**(double**)operand *= -1;
-				stackPush(evalStack, *operand);
+	calcProgramDestroy(program);
+	calcContextDestroy(context);
+	return exitCode;
+}
+
+// Defines the variables in vars, a comma separated list of names, in
+// order, or just binds ans if vars is NULL.
+// Returns the number of variables with their slots, or -1 after printing an
+// error.
+int defineVariables(CalcContext* context, const char* vars, int* slots) {
+	int varCount = 0;
+
+	if(vars == NULL) {
+		slots[varCount++] = ANS_SLOT;
+		return varCount;
+	}
+
+	while(1) {
+		const char* comma = strchr(vars, ',');
+		size_t length = (comma == NULL) ? strlen(vars) : (size_t)(comma - vars);
+		char name[64];
 
-				free(operand);
-		} else if(**(char**)opToken != '+' && **(char**)opToken != '-') {
-			free(*opToken);
-			free(opToken);
-			return evalFail;
+		if(varCount == MAP_VARS || length >= sizeof(name)) {
+			fprintf(stderr, "Error: too many or too long variable names.\n");
+			return -1;
 		}
 
-	// evalStack has enough items for binary operator evaluation.
-	} else {
-		// (-) to be treated as a negative sign.
-		if(getStackSize(opStack) >= 1
-				&& *(char*)stackPeek(opStack) != '('
-				&& getPriority(*opToken, stackPeek(opStack)) <= 0
-				&& **(char**)opToken == '-') {
+		memcpy(name, vars, length);
+		name[length] = '\0';
+		slots[varCount] = calcDefineVariable(context, name, 0.0);
 
-			void** operand = malloc(sizeof(void*));
-			stackPop(evalStack, operand);
+		if(slots[varCount] < 0) {
+			fprintf(stderr, "Error: '%s' cannot be a variable.\n", name);
+			return -1;
+		}
 
-			**(double**)operand *= -1;
-			stackPush(evalStack, *operand);
+		++varCount;
 
-			free(operand);
-		} else {
-			void** lOperand = malloc(sizeof(void*));
-			void** rOperand = malloc(sizeof(void*));
-			double *result;
-			stackPop(evalStack, rOperand);
-			stackPop(evalStack, lOperand);
-
-			if((**(double**)rOperand) == 0 && **(char**)opToken == '/') {
-				free(*opToken);
-				free(opToken);
-				free(*lOperand);
-				free(lOperand);
-				free(*rOperand);
-				free(rOperand);
-				return divZero;
-			}
+		if(comma == NULL) {
+			return varCount;
+		}
+
+		vars = comma + 1;
+	}
+}
+
+// Evaluates a file of expressions, one per line, across threadCount workers
+// and prints one result per line in input order. The file is mapped and
+// split on newlines in place, a window of lines at a time, so no line is
+// copied or limited in length.
+// Returns the exit code.
+int batchFile(const char* path, int threadCount, size_t cacheLimit,
+		unsigned jitThreshold, int showStats) {
+	MappedFile input;
+
+	if(mappedFileOpen(path, &input) != 0) {
+		fprintf(stderr, "Error: cannot read '%s'.\n", path);
+		return 1;
+	}
+
+	BatchEvaluator* evaluator = batchEvaluatorCreate(threadCount, cacheLimit,
+			jitThreshold);
+	batchEnableStats(evaluator, showStats);
+	Writer* writer = writerCreate(STDOUT_FILENO, WRITER_SIZE);
+	size_t* starts = malloc((BATCH_LINES + 1) * sizeof(size_t));
+	size_t pos = 0;
 
-			result = applyOperation(*opToken,*lOperand,*rOperand);
+	if(starts == NULL) {
+		fprintf(stderr, "Allocation of line offsets failed.\n");
+		exit(1);
+	}
 
-			stackPush(evalStack, result);
-			free(*lOperand);
-			free(lOperand);
-			free(*rOperand);
-			free(rOperand);
+	while(pos < input.size) {
+		int count = 0;
+
+		// The last line of the file need not end in a newline.
+		while(count < BATCH_LINES && pos < input.size) {
+			const char* newline = memchr(input.data + pos, '\n', input.size - pos);
+
+			starts[count++] = pos;
+			pos = (newline == NULL) ? input.size : (size_t)(newline - input.data) + 1;
 		}
+
+		starts[count] = pos;
+		batchEvaluateLines(evaluator, input.data, starts, count, writer);
 	}
 
-	free(*opToken);
-	free(opToken);
-	return success;
+	int exitCode = 0;
+
+	if(writerDestroy(writer) != 0) {
+		fprintf(stderr, "Error: failed writing output.\n");
+		exitCode = 1;
+	}
+
+	if(cacheLimit > 0) {
+		CalcCacheStats stats;
+
+		batchGetCacheStats(evaluator, &stats);
+		printCacheStats(&stats);
+	}
+
+	if(showStats) {
+		CalcStats stats;
+
+		batchGetStats(evaluator, &stats);
+		printStats(&stats);
+	}
+
+	free(starts);
+	batchEvaluatorDestroy(evaluator);
+	mappedFileClose(&input);
+	return exitCode;
 }
 
-// Applies simple arithmetic operations.
-double* applyOperation(void* operator, void* lOperandPtr, void* rOperandPtr) {
-	double lOperand = *(double*)lOperandPtr;
-	double rOperand = *(double*)rOperandPtr;
-	double* result = malloc(sizeof(double));
+// Compiles the expressions read from stdin, one per line, into a store at
+// path, with the variables in vars defined first as for --map. The store is
+// then opened, which checks it as any reader would, and the lines that
+// failed to compile are reported from it.
+// Returns the exit code.
+int buildStore(const char* path, const char* vars) {
+	CalcContext* context = calcContextCreate();
+	CalcContext* reader = calcContextCreate();
+	MappedFile input;
+	int slots[MAP_VARS];
+
+	if(vars != NULL && defineVariables(context, vars, slots) < 0) {
+		calcContextDestroy(context);
+		calcContextDestroy(reader);
+		return 1;
+	} else if(mappedFileRead(STDIN_FILENO, &input) != 0) {
+		fprintf(stderr, "Error: cannot read the expressions.\n");
+		calcContextDestroy(context);
+		calcContextDestroy(reader);
+		return 1;
+	}
 
-	switch(*(char*)operator) {
-		case '+':
-			*result = lOperand + rOperand;
-			break;
-		case '-':
-			*result = lOperand - rOperand;
-			break;
-		case '*':
-			*result = lOperand * rOperand;
-			break;
-		case '/':
-			*result = lOperand / rOperand;
-			break;
-		case '^':
-			*result = pow(lOperand, rOperand);
-			break;
+	size_t count = 0, capacity = 1024, failed;
+	const char** lines = malloc(capacity * sizeof(char*));
+	size_t* lengths = malloc(capacity * sizeof(size_t));
+
+	for(size_t pos = 0; pos < input.size; ++count) {
+		const char* newline = memchr(input.data + pos, '\n', input.size - pos);
+		size_t end = (newline == NULL) ? input.size
+				: (size_t)(newline - input.data);
+
+		if(count == capacity) {
+			capacity *= 2;
+			lines = realloc(lines, capacity * sizeof(char*));
+			lengths = realloc(lengths, capacity * sizeof(size_t));
+		}
+
+		if(lines == NULL || lengths == NULL) {
+			fprintf(stderr, "Allocation of line offsets failed.\n");
+			exit(1);
+		}
+
+		lines[count] = input.data + pos;
+		lengths[count] = end - pos;
+		pos = end + 1;
+	}
+
+	int exitCode = 0;
+	CalcStore* store;
+
+	if(calcStoreWrite(context, path, lines, lengths, count, &failed) != 0) {
+		fprintf(stderr, "Error: cannot write '%s'.\n", path);
+		exitCode = 1;
+	} else if(calcStoreOpen(reader, path, &store) != 0) {
+		fprintf(stderr, "Error: '%s' is not a valid store.\n", path);
+		exitCode = 1;
+	}
+
+	for(size_t i = 0; exitCode == 0 && failed > 0 && i < count; ++i) {
+		CalcProgram* program;
+		CalcResult result;
+		const char* expression;
+		Status status = calcStoreGet(store, i, &program, &expression, &result);
+
+		if(status == unknownToken) {
+			fprintf(stderr, "Line %zu: '%.*s' is an unrecognised token.\n",
+					i + 1, result.errorLength, expression + result.errorOffset);
+		} else if(status != success) {
+			fprintf(stderr, "Line %zu: %s\n", i + 1, calcStatusMessage(status));
+		}
+	}
+
+	if(exitCode == 0) {
+		fprintf(stderr, "Stored %zu expressions, %zu failed.\n", count, failed);
+		calcStoreClose(store);
 	}
 
-	return result;
+	free(lines);
+	free(lengths);
+	mappedFileClose(&input);
+	calcContextDestroy(context);
+	calcContextDestroy(reader);
+	return exitCode;
 }
 
-// Applies single argument functions on a given operand.
-double* applyFunction(FunctionType functionKey, void* operandPtr) {
-	double operand = *(double*)operandPtr;
-	double* result = malloc(sizeof(double));
+// Serves clients on a Unix domain socket at path until interrupted, each
+// with a context of its own set up as the prompt's would be.
+// Returns the exit code.
+int serve(const char* path, size_t cacheLimit, unsigned jitThreshold,
+		int precision) {
+	Server* server = serverCreate(path, cacheLimit, jitThreshold, precision);
 
-	switch(functionKey) {
-		case sqrt_:
-			*result = sqrt(operand);
-			break;
-		case sin_:
-			*result = sin(operand);
-			break;
-		case cos_:
-			*result = cos(operand);
-			break;
-		case tan_:
-			*result = tan(operand);
-			break;
-		default:
-			result = NULL;
+	if(server == NULL) {
+		return 1;
 	}
 
-	return result;
+	int exitCode = (serverRun(server) == 0) ? 0 : 1;
+
+	serverDestroy(server);
+	return exitCode;
 }
 
-// Get the priority of operator1 relative to operator2.
-int getPriority(void* operator1, void* operator2) {
-	int priority1, priority2;
+// Reads a byte count with an optional K, M or G suffix.
+// Returns 0 on success, -1 if the text is not a size, or is too large.
+int parseSize(const char* text, size_t* size) {
+	char* end;
+	int shifts = 0;
 
-	switch(*(char*)operator1) {
-		case '+':
-		case '-':
-			priority1 = 1;
-			break;
-		case '*':
-		case '/':
-			priority1 = 2;
-			break;
-		case '^':
-			priority1 = 3;
-			break;
+	errno = 0;
+	unsigned long long value = strtoull(text, &end, 10);
+
+	if(end == text || *text == '-' || errno == ERANGE || value > SIZE_MAX) {
+		return -1;
 	}
 
-	switch(*(char*)operator2) {
-		case '+':
-		case '-':
-			priority2 = 1;
-			break;
-		case '*':
-		case '/':
-			priority2 = 2;
+	switch(*end) {
+		case 'G':
+			++shifts;
+			// Fall through.
+		case 'M':
+			++shifts;
+			// Fall through.
+		case 'K':
+			++shifts;
+			++end;
 			break;
-		case '^':
-			priority2 = 3;
+		default:
 			break;
 	}
 
-	return priority1 - priority2;
+	if(*end != '\0') {
+		return -1;
+	}
+
+	for(int i = 0; i < shifts; ++i) {
+		if(value > SIZE_MAX >> 10) {
+			return -1;
+		}
+
+		value <<= 10;
+	}
+
+	*size = value;
+	return 0;
 }
 
-// Returns the associativity of a given token.
-AssocType getAssoc(void* operator) {
-	switch(*(char*)operator) {
-		case '^':
-		case '!':
-			return right;
-		default:
-			return left;
+// Prints the corresponding message to the supplied status.
+void printStatus(Status status) {
+	// Success or error handled elsewhere.
+	if(status == success || status == unknownToken) {
+		return;
 	}
+
+	fprintf(stderr, "Error: %s\n", calcStatusMessage(status));
 }
 
-// Returns the classification of a given token.
-TokenType tokenType(void* token) {
-	if(token == NULL) {
-		return unknown;
-	}
-
-	char* charToken = (char*)token;
-
-	switch(*charToken) {
-		case '0':
-		case '1':
-		case '2':
-		case '3':
-		case '4':
-		case '5':
-		case '6':
-		case '7':
-		case '8':
-		case '9':
-			return digit;
-		case '.':
-			return decimalSep;
-		case '+':
-		case '-':
-		case '*':
-		case '/':
-		case '^':
-			return operator;
-		case '(':
-			return lbracket;
-		case ')':
-			return rbracket;
-		case ' ':
-		case '\t':
-			return whitespace;
-		case '\n':
-		case '\0':
-			return EOL;
-	}
-
-	if(strncmp(charToken, "pi", 2) == 0
-			|| strncmp(charToken, "e", 1) == 0
-			|| strncmp(charToken, "ans", 3) == 0) {
-
-		return constant;
-	}
-
-	if(functionType(charToken)) {
-		return function;
-	}
-
-	return unknown;
+void printCacheStats(const CalcCacheStats* stats) {
+	fprintf(stderr, "Cache: %zu hits, %zu misses, %zu evictions, "
+			"%zu entries in %zu of %zu bytes.\n", stats->hits, stats->misses,
+			stats->evictions, stats->entries, stats->bytes, stats->limit);
 }
 
-// Returns the function type of a given token.
-FunctionType functionType(void* token) {
-	char* charToken = (char*) token;
+// Prints where the time went, and how often each operation ran.
+void printStats(const CalcStats* stats) {
+	const char* phases[] = { "Lexing", "Compiling", "Evaluating" };
+	uint64_t times[] = { stats->lexTime, stats->compileTime, stats->evalTime };
+	size_t counts[] = { stats->lexed, stats->compiled, stats->evaluated };
 
-	if(strncmp(charToken, "sqrt", 4) == 0) {
-		return sqrt_;
-	}else if(strncmp(charToken, "sin", 3) == 0) {
-		return sin_;
-	} else if(strncmp(charToken, "cos", 3) == 0) {
-		return cos_;
-	} else if(strncmp(charToken, "tan", 3) == 0) {
-		return tan_;
+	for(int i = 0; i < 3; ++i) {
+		fprintf(stderr, "%-11s %10zu in %10.3f ms, %8.1f ns each.\n", phases[i],
+				counts[i], times[i] * 1e-6,
+				(counts[i] > 0) ? (double)times[i] / counts[i] : 0.0);
 	}
 
-	return none;
-}
+	fprintf(stderr, "Heap allocations: %zu.\n", stats->allocations);
+	fprintf(stderr, "Deepest operator stack: %d, evaluation stack: %d.\n",
+			stats->maxOperatorDepth, stats->maxEvalDepth);
+	fprintf(stderr, "Shared subexpressions: %zu operations left out.\n",
+			stats->eliminated);
+	fprintf(stderr, "Operations run:\n");
 
-// Prints the corresponding message to the supplied status.
-void printStatus(Status status) {
-	switch(status) {
-		case evalFail:
-			fprintf(stderr, "Error: Failed to evaluate expression.\n");
-			break;
-		case divZero:
-			fprintf(stderr, "Error: Division by zero.\n");
-			break;
-		case unpairedBracket:
-			fprintf(stderr, "Error: Unpaired brackets.\n");
-			break;
-		case noDigit:
-			fprintf(stderr, "Error: operands must contain at least one digit.\n");
-			break;
-		case noOperator:
-			fprintf(stderr, "Error: expressions must contain at least one operator.\n");
-			break;
-		case extraDecimalSep:
-			fprintf(stderr, "Error: Extra decimal point.\n");
-			break;
-		// Success or error handled elsewhere.
-		default:
-			break;
+	for(int op = 0; op < CALC_OPS; ++op) {
+		if(stats->opCounts[op] > 0) {
+			fprintf(stderr, "  %-6s %12zu\n", calcOpName(op), stats->opCounts[op]);
+		}
 	}
 }
+
+void printUsage(const char* name) {
+	fprintf(stderr, "Usage: %s [--stats] [--cache bytes] [--jit count]"
+			" [--precision digits] [--threads n] [--map expression [--vars x,y,...]"
+			" | --emit-c expression [--vars x,y,...]"
+			" | --gradient expression [--vars x,y,...]"
+			" | --bound expression [--vars x,y,...] | --batch file"
+			" | --build-store file [--vars x,y,...] | --serve socket]\n", name);
+}